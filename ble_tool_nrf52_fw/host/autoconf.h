@@ -0,0 +1,44 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Kconfig values for the host build, the firmware gets these from the
+   generated autoconf.h */
+
+#ifndef AUTOCONF_H_
+#define AUTOCONF_H_
+
+#define CONFIG_BLE_UART_TX_BUF_SIZE 2048
+#define CONFIG_BLE_UART_TX_FLUSH_MS 5
+#define CONFIG_BLE_UART_TX_CREDITS 4
+#define CONFIG_BLE_FRAME_SCRIPT_SIZE 8192
+#define CONFIG_LISP_HEAP_SIZE 2048
+#define CONFIG_LISP_GC_STATS_PERIOD_MS 1000
+#define CONFIG_LISP_EVAL_STACK_SIZE 4096
+#define CONFIG_LISP_EVAL_QUEUE_DEPTH 4
+#define CONFIG_LISP_EVAL_TIMEOUT_MS 0
+#define CONFIG_LISP_PRELUDE_IMAGE 1
+#define CONFIG_LISP_SAVE_SIZE 2048
+#define CONFIG_BLE_FRAME_WINDOW 8
+
+#define CONFIG_BT 1
+#define CONFIG_BT_PERIPHERAL 1
+#define CONFIG_BT_GATT_CLIENT 1
+#define CONFIG_SETTINGS 1
+#define CONFIG_MINIMAL_LIBC_MALLOC_ARENA_SIZE 65536
+
+#endif
@@ -0,0 +1,411 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Simulated Bluetooth stack. A client of the transport socket is a
+   connected central: what it sends is written to the BLE UART
+   characteristic in ATT MTU sized pieces, and notifications on the
+   service are sent back to it. With a connection interval set,
+   notifications complete a few per connection event, as they would
+   over the air. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <zephyr.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+#include <bluetooth/services/bas.h>
+#include <bluetooth/services/hrs.h>
+
+#include "shim.h"
+
+#define ATT_DEFAULT_MTU 23
+#define MAX_SERVICES 8
+#define MAX_PENDING 64
+
+struct bt_conn {
+  atomic_t ref;
+  int fd;
+  u16_t mtu;
+  struct bt_gatt_exchange_params *exchange;
+};
+
+/* The service a BLE UART terminal talks to, 6e400001-b5a3-f393-e0a9-e50e24dcca9e */
+static const u8_t uart_service_uuid[16] = {
+  0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0,
+  0x93, 0xF3, 0xA3, 0xB5, 0x01, 0x00, 0x40, 0x6E
+};
+
+static const struct bt_gatt_service_static *services[MAX_SERVICES];
+static int num_services;
+static const struct bt_gatt_service_static *uart_service;
+static const struct bt_gatt_attr *uart_write_attr;
+
+static struct bt_conn_cb *conn_cbs;
+static struct bt_conn conn = { .fd = -1 };
+static bt_ready_cb_t ready_cb;
+static char device_name[65] = "ble_tool_host";
+static u8_t battery_level = 100;
+
+static const char *socket_path = "/tmp/ble_tool_nrf52_fw.sock";
+static u16_t link_mtu = 247;
+static int link_interval_ms;
+static int link_packets = 6;
+
+/* Notifications waiting for a connection event to complete */
+static pthread_mutex_t tx_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bt_gatt_complete_func_t pending[MAX_PENDING];
+static int pending_first;
+static int pending_num;
+
+void bt_shim_transport(const char *path) {
+  socket_path = path;
+}
+
+void bt_shim_link(u16_t mtu, int interval_ms, int packets) {
+  link_mtu = mtu < ATT_DEFAULT_MTU ? ATT_DEFAULT_MTU : mtu;
+  link_interval_ms = interval_ms;
+  link_packets = packets > 0 ? packets : 1;
+}
+
+/* ------------------------------------------------------------
+   GATT
+   ------------------------------------------------------------ */
+
+static bool is_uart_service(const struct bt_gatt_service_static *svc) {
+  const struct bt_uuid_128 *uuid = svc->attrs[0].user_data;
+
+  return uuid && uuid->uuid.type == BT_UUID_TYPE_128 &&
+    memcmp(uuid->val, uart_service_uuid, 16) == 0;
+}
+
+void bt_shim_register_service(const struct bt_gatt_service_static *svc) {
+  if (num_services == MAX_SERVICES) return;
+  services[num_services++] = svc;
+
+  if (!uart_service && is_uart_service(svc)) {
+    uart_service = svc;
+    for (size_t i = 0; i < svc->attr_count; i++) {
+      if (svc->attrs[i].write) {
+	uart_write_attr = &svc->attrs[i];
+	break;
+      }
+    }
+  }
+}
+
+ssize_t bt_gatt_attr_read(struct bt_conn *c, const struct bt_gatt_attr *attr,
+			  void *buf, u16_t buf_len, u16_t offset,
+			  const void *value, u16_t value_len) {
+  (void) c;
+  (void) attr;
+
+  if (offset > value_len) {
+    return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+  }
+  u16_t len = MIN(buf_len, value_len - offset);
+  memcpy(buf, (const u8_t *)value + offset, len);
+  return len;
+}
+
+static void complete_pending(int max) {
+  bt_gatt_complete_func_t done[MAX_PENDING];
+  int n = 0;
+
+  pthread_mutex_lock(&tx_mutex);
+  while (pending_num > 0 && n < max) {
+    done[n++] = pending[pending_first];
+    pending_first = (pending_first + 1) % MAX_PENDING;
+    pending_num--;
+  }
+  pthread_mutex_unlock(&tx_mutex);
+
+  for (int i = 0; i < n; i++) {
+    if (done[i]) done[i](&conn);
+  }
+}
+
+int bt_gatt_notify_cb(struct bt_conn *c, struct bt_gatt_notify_params *params) {
+  const struct bt_gatt_attr *attr = params->attr;
+  bool queued = false;
+
+  if (c && c != &conn) return -EINVAL;
+
+  pthread_mutex_lock(&tx_mutex);
+  if (conn.fd < 0) {
+    pthread_mutex_unlock(&tx_mutex);
+    return -ENOTCONN;
+  }
+  if (params->len > conn.mtu - 3) {
+    pthread_mutex_unlock(&tx_mutex);
+    return -EMSGSIZE;
+  }
+
+  /* only the UART service is carried by the socket */
+  if (uart_service &&
+      attr >= uart_service->attrs &&
+      attr < uart_service->attrs + uart_service->attr_count) {
+    ssize_t n = write(conn.fd, params->data, params->len);
+    (void) n;
+  }
+
+  if (link_interval_ms > 0 && pending_num < MAX_PENDING) {
+    pending[(pending_first + pending_num) % MAX_PENDING] = params->func;
+    pending_num++;
+    queued = true;
+  }
+  pthread_mutex_unlock(&tx_mutex);
+
+  if (!queued && params->func) params->func(&conn);
+  return 0;
+}
+
+int bt_gatt_exchange_mtu(struct bt_conn *c, struct bt_gatt_exchange_params *params) {
+  if (c != &conn) return -EINVAL;
+  /* answered by the Bluetooth thread once the connected callbacks have run */
+  conn.exchange = params;
+  return 0;
+}
+
+u16_t bt_gatt_get_mtu(struct bt_conn *c) {
+  return c ? c->mtu : 0;
+}
+
+/* ------------------------------------------------------------
+   Connections
+   ------------------------------------------------------------ */
+
+void bt_conn_cb_register(struct bt_conn_cb *cb) {
+  cb->_next = conn_cbs;
+  conn_cbs = cb;
+}
+
+struct bt_conn *bt_conn_ref(struct bt_conn *c) {
+  atomic_inc(&c->ref);
+  return c;
+}
+
+void bt_conn_unref(struct bt_conn *c) {
+  atomic_dec(&c->ref);
+}
+
+int bt_conn_disconnect(struct bt_conn *c, u8_t reason) {
+  (void) reason;
+
+  pthread_mutex_lock(&tx_mutex);
+  if (c->fd >= 0) shutdown(c->fd, SHUT_RDWR);
+  pthread_mutex_unlock(&tx_mutex);
+  return 0;
+}
+
+/* Writes from the central, a write refused for lack of resources is
+   retried after the next connection event */
+static void central_write(const u8_t *data, size_t len) {
+  size_t max = conn.mtu - 3;
+
+  while (len > 0 && uart_write_attr) {
+    u16_t n = len > max ? max : len;
+    ssize_t r = uart_write_attr->write(&conn, uart_write_attr, data, n, 0, 0);
+
+    if (r == BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES)) {
+      k_sleep(link_interval_ms > 0 ? link_interval_ms : 1);
+      continue;
+    }
+    if (r < 0) {
+      fprintf(stderr, "bt_shim: write refused (ATT error 0x%02x)\n", (unsigned)-r);
+    }
+    data += n;
+    len -= n;
+  }
+}
+
+static void run_connection(int fd) {
+  u8_t buf[1024];
+  ssize_t n;
+
+  pthread_mutex_lock(&tx_mutex);
+  conn.fd = fd;
+  conn.mtu = ATT_DEFAULT_MTU;
+  conn.exchange = NULL;
+  pthread_mutex_unlock(&tx_mutex);
+
+  for (struct bt_conn_cb *cb = conn_cbs; cb; cb = cb->_next) {
+    if (cb->connected) cb->connected(&conn, 0);
+  }
+
+  if (conn.exchange) {
+    struct bt_gatt_exchange_params *params = conn.exchange;
+    conn.exchange = NULL;
+    conn.mtu = link_mtu;
+    params->func(&conn, 0, params);
+  }
+
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    central_write(buf, n);
+  }
+
+  pthread_mutex_lock(&tx_mutex);
+  conn.fd = -1;
+  pthread_mutex_unlock(&tx_mutex);
+  complete_pending(MAX_PENDING);
+
+  for (struct bt_conn_cb *cb = conn_cbs; cb; cb = cb->_next) {
+    if (cb->disconnected) cb->disconnected(&conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+  }
+  close(fd);
+}
+
+static int open_pty(void) {
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if (fd < 0 || grantpt(fd) || unlockpt(fd)) {
+    perror("bt_shim: pty");
+    return -1;
+  }
+  fprintf(stderr, "bt_shim: BLE UART on %s\n", ptsname(fd));
+  return fd;
+}
+
+static int open_socket(void) {
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd < 0) {
+    perror("bt_shim: socket");
+    return -1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+  unlink(socket_path);
+
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 1)) {
+    perror("bt_shim: bind");
+    close(fd);
+    return -1;
+  }
+  fprintf(stderr, "bt_shim: BLE UART on %s\n", socket_path);
+  return fd;
+}
+
+static void *bt_thread(void *arg) {
+  (void) arg;
+
+  if (ready_cb) ready_cb(0);
+
+  if (!socket_path) {
+    /* a pty is connected for as long as the program runs */
+    int fd = open_pty();
+    if (fd >= 0) run_connection(fd);
+    return NULL;
+  }
+
+  int listen_fd = open_socket();
+  if (listen_fd < 0) return NULL;
+
+  while (true) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      perror("bt_shim: accept");
+      break;
+    }
+    run_connection(fd);
+  }
+  close(listen_fd);
+  return NULL;
+}
+
+static void *link_thread(void *arg) {
+  (void) arg;
+
+  while (true) {
+    k_sleep(link_interval_ms);
+    complete_pending(link_packets);
+  }
+  return NULL;
+}
+
+/* ------------------------------------------------------------
+   Host and advertising
+   ------------------------------------------------------------ */
+
+int bt_enable(bt_ready_cb_t cb) {
+  pthread_t tid;
+
+  signal(SIGPIPE, SIG_IGN);
+  ready_cb = cb;
+
+  if (link_interval_ms > 0 &&
+      pthread_create(&tid, NULL, link_thread, NULL)) {
+    return -ENOMEM;
+  }
+  if (pthread_create(&tid, NULL, bt_thread, NULL)) {
+    return -ENOMEM;
+  }
+  return 0;
+}
+
+int bt_set_name(const char *name) {
+  strncpy(device_name, name, sizeof(device_name) - 1);
+  return 0;
+}
+
+const char *bt_get_name(void) {
+  return device_name;
+}
+
+int bt_le_adv_start(const struct bt_le_adv_param *param,
+		    const struct bt_data *ad, size_t ad_len,
+		    const struct bt_data *sd, size_t sd_len) {
+  (void) param;
+  (void) ad;
+  (void) ad_len;
+  (void) sd;
+  (void) sd_len;
+  return 0;
+}
+
+int bt_le_adv_stop(void) {
+  return 0;
+}
+
+u8_t bt_gatt_bas_get_battery_level(void) {
+  return battery_level;
+}
+
+int bt_gatt_bas_set_battery_level(u8_t level) {
+  battery_level = level;
+  return 0;
+}
+
+int bt_gatt_hrs_notify(u16_t heartrate) {
+  (void) heartrate;
+  return 0;
+}
@@ -0,0 +1,288 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Uploads a program to ble_tool_host in framed mode (:frame), prints
+   its output and reports the transfer rate. Uses the same frame codec
+   as the firmware. */
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frame_codec.h"
+
+#define TIMEOUT_MS 1000
+#define MAX_RETRIES 10
+
+static int sock = -1;
+static frame_parser_t parser;
+
+static int window = 8;
+static int payload = 240;
+
+/* sequence numbers of the two directions */
+static uint8_t tx_seq;
+static uint8_t rx_expected;
+
+static double now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void send_bytes(const uint8_t *data, size_t len) {
+  if (write(sock, data, len) != (ssize_t)len) {
+    perror("write");
+    exit(1);
+  }
+}
+
+static void send_control(uint8_t type, uint8_t seq) {
+  uint8_t buf[FRAME_OVERHEAD + 1];
+  send_bytes(buf, frame_encode(buf, type, 0, &seq, 1));
+}
+
+typedef struct {
+  uint8_t *data;
+  size_t size;
+} encoded_t;
+
+/* State of one upload and the output coming back */
+typedef struct {
+  encoded_t *frames;
+  int num;
+  int base;
+  int next;
+  bool done;
+  int status;
+  size_t out_bytes;
+  FILE *out;
+} transfer_t;
+
+static void handle_frame(transfer_t *t, frame_t *f) {
+  if (f->type == FRAME_ACK || f->type == FRAME_NAK) {
+    if (f->len != 1) return;
+    uint8_t base_seq = (uint8_t)(tx_seq + t->base);
+    int d = frame_seq_diff(f->payload[0], base_seq);
+    if (d > 0 && t->base + d <= t->next) t->base += d;
+    if (f->type == FRAME_NAK) t->next = t->base;
+    return;
+  }
+  if (!frame_is_numbered(f->type)) return;
+
+  if (f->seq != rx_expected) {
+    send_control(frame_seq_diff(f->seq, rx_expected) < 0 ? FRAME_ACK : FRAME_NAK,
+		 rx_expected);
+    return;
+  }
+  rx_expected++;
+
+  if (f->type == FRAME_DATA) {
+    if (t->out) fwrite(f->payload, 1, f->len, t->out);
+    t->out_bytes += f->len;
+  } else if (f->type == FRAME_EVAL) {
+    t->status = f->len ? f->payload[0] : 0;
+    t->done = true;
+  }
+}
+
+/* Reads what is available, false on timeout */
+static bool service_input(transfer_t *t, int timeout_ms) {
+  uint8_t buf[1024];
+  struct pollfd pfd = { sock, POLLIN, 0 };
+  uint8_t before = rx_expected;
+
+  if (poll(&pfd, 1, timeout_ms) <= 0) return false;
+
+  ssize_t n = read(sock, buf, sizeof(buf));
+  if (n <= 0) {
+    fprintf(stderr, "Connection closed\n");
+    exit(1);
+  }
+  for (ssize_t i = 0; i < n; i++) {
+    int r = frame_parse(&parser, buf[i]);
+    if (r == FRAME_COMPLETE) {
+      handle_frame(t, &parser.frame);
+    } else if (r == FRAME_BAD) {
+      send_control(FRAME_NAK, rx_expected);
+    }
+  }
+  if (rx_expected != before) send_control(FRAME_ACK, rx_expected);
+  return true;
+}
+
+/* Sends the frames with at most window unacknowledged, and waits for
+   them to be acknowledged and, if wait_eval, for the result */
+static void run(transfer_t *t, bool wait_eval) {
+  int retries = 0;
+
+  while (t->base < t->num || (wait_eval && !t->done)) {
+    while (t->next < t->num && t->next - t->base < window) {
+      send_bytes(t->frames[t->next].data, t->frames[t->next].size);
+      t->next++;
+    }
+    int base = t->base;
+    if (service_input(t, TIMEOUT_MS)) {
+      if (t->base != base || t->done) retries = 0;
+      continue;
+    }
+    if (++retries > MAX_RETRIES) {
+      fprintf(stderr, "No answer from the device\n");
+      exit(1);
+    }
+    t->next = t->base;
+  }
+  tx_seq = (uint8_t)(tx_seq + t->num);
+}
+
+static encoded_t encode(uint8_t type, uint8_t seq, const uint8_t *data, uint16_t len) {
+  encoded_t e;
+  e.data = malloc(len + FRAME_OVERHEAD);
+  e.size = frame_encode(e.data, type, seq, data, len);
+  return e;
+}
+
+static void free_frames(transfer_t *t) {
+  for (int i = 0; i < t->num; i++) free(t->frames[i].data);
+  free(t->frames);
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+	  "Usage: %s [-s path] [-w window] [-p payload] [-n repeat] [-q] program.lisp\n"
+	  "  -s path     socket of ble_tool_host (default /tmp/ble_tool_nrf52_fw.sock)\n"
+	  "  -w window   frames in flight (default 8)\n"
+	  "  -p payload  bytes per frame (default 240)\n"
+	  "  -n repeat   upload and evaluate the program this many times (default 1)\n"
+	  "  -q          do not print the output\n", prog);
+}
+
+int main(int argc, char **argv) {
+  const char *path = "/tmp/ble_tool_nrf52_fw.sock";
+  int repeat = 1;
+  bool quiet = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:w:p:n:qh")) != -1) {
+    switch (opt) {
+    case 's': path = optarg; break;
+    case 'w': window = atoi(optarg); break;
+    case 'p': payload = atoi(optarg); break;
+    case 'n': repeat = atoi(optarg); break;
+    case 'q': quiet = true; break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (optind != argc - 1 || window < 1 || window > 127 ||
+      payload < 1 || payload > FRAME_MAX_PAYLOAD || repeat < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  FILE *f = fopen(argv[optind], "rb");
+  if (!f) {
+    perror(argv[optind]);
+    return 1;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  rewind(f);
+  uint8_t *program = malloc(size > 0 ? size : 1);
+  if (fread(program, 1, size, f) != (size_t)size) {
+    perror(argv[optind]);
+    return 1;
+  }
+  fclose(f);
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+  sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+    perror(path);
+    return 1;
+  }
+
+  /* the device answers :frame with an ACK frame, the echo before it is
+     skipped by the parser */
+  frame_parser_init(&parser);
+  send_bytes((const uint8_t *)":frame\r", 7);
+  while (true) {
+    uint8_t buf[256];
+    struct pollfd pfd = { sock, POLLIN, 0 };
+    if (poll(&pfd, 1, 5000) <= 0) {
+      fprintf(stderr, "Device did not enter framed mode\n");
+      return 1;
+    }
+    ssize_t n = read(sock, buf, sizeof(buf));
+    if (n <= 0) return 1;
+    ssize_t i;
+    for (i = 0; i < n; i++) {
+      if (frame_parse(&parser, buf[i]) == FRAME_COMPLETE &&
+	  parser.frame.type == FRAME_ACK) break;
+    }
+    if (i < n) break;
+  }
+
+  double total = 0;
+  for (int r = 0; r < repeat; r++) {
+    transfer_t t = { 0 };
+    t.num = (size + payload - 1) / payload + 1;
+    t.frames = malloc(sizeof(encoded_t) * t.num);
+    for (int i = 0; i < t.num - 1; i++) {
+      long at = (long)i * payload;
+      long len = size - at < payload ? size - at : payload;
+      t.frames[i] = encode(FRAME_DATA, (uint8_t)(tx_seq + i), program + at, len);
+    }
+    t.frames[t.num - 1] = encode(FRAME_EVAL, (uint8_t)(tx_seq + t.num - 1), NULL, 0);
+    t.out = (quiet || r > 0) ? NULL : stdout;
+
+    double t0 = now_s();
+    run(&t, true);
+    double elapsed = now_s() - t0;
+    total += elapsed;
+
+    if (t.out) printf("\n");
+    if (t.status) fprintf(stderr, "Evaluation failed\n");
+    free_frames(&t);
+  }
+
+  fprintf(stderr, "%ld bytes x %d in %.3f s, %.1f kB/s\n",
+	  size, repeat, total, size * (double)repeat / total / 1000.0);
+
+  transfer_t close_t = { 0 };
+  close_t.num = 1;
+  close_t.frames = malloc(sizeof(encoded_t));
+  close_t.frames[0] = encode(FRAME_CLOSE, tx_seq, NULL, 0);
+  run(&close_t, false);
+  free_frames(&close_t);
+
+  free(program);
+  close(sock);
+  return 0;
+}
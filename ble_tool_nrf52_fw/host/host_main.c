@@ -0,0 +1,85 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Host build of the firmware. The firmware main() is compiled as
+   fw_main and runs on the main thread once the shim threads are up. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <zephyr.h>
+
+#include "shim.h"
+
+extern void fw_main(void);
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+	  "Usage: %s [-s path | -p] [-m mtu] [-i interval_ms] [-n packets] [-f settings]\n"
+	  "  -s path         serve the BLE UART on a Unix socket (default /tmp/ble_tool_nrf52_fw.sock)\n"
+	  "  -p              serve the BLE UART on a pty\n"
+	  "  -m mtu          ATT MTU granted in the exchange (default 247)\n"
+	  "  -i interval_ms  connection interval, 0 completes notifications at once (default 0)\n"
+	  "  -n packets      notifications per connection event (default 6)\n"
+	  "  -f settings     file the settings are kept in, as flash on the target\n",
+	  prog);
+}
+
+int main(int argc, char **argv) {
+  int mtu = 247;
+  int interval = 0;
+  int packets = 6;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:pm:i:n:f:h")) != -1) {
+    switch (opt) {
+    case 's':
+      bt_shim_transport(optarg);
+      break;
+    case 'p':
+      bt_shim_transport(NULL);
+      break;
+    case 'm':
+      mtu = atoi(optarg);
+      break;
+    case 'i':
+      interval = atoi(optarg);
+      break;
+    case 'n':
+      packets = atoi(optarg);
+      break;
+    case 'f':
+      settings_shim_file(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (mtu < 23 || mtu > 517) {
+    fprintf(stderr, "MTU must be between 23 and 517\n");
+    return 1;
+  }
+  bt_shim_link(mtu, interval, packets);
+
+  k_shim_start();
+  fw_main();
+  return 0;
+}
@@ -0,0 +1,81 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BLUETOOTH_SHIM_H_
+#define BLUETOOTH_SHIM_H_
+
+#include <zephyr.h>
+
+#define BT_DATA_FLAGS         0x01
+#define BT_DATA_UUID16_SOME   0x02
+#define BT_DATA_UUID16_ALL    0x03
+#define BT_DATA_UUID128_SOME  0x06
+#define BT_DATA_UUID128_ALL   0x07
+#define BT_DATA_NAME_SHORTENED 0x08
+#define BT_DATA_NAME_COMPLETE 0x09
+
+#define BT_LE_AD_LIMITED  0x01
+#define BT_LE_AD_GENERAL  0x02
+#define BT_LE_AD_NO_BREDR 0x04
+
+struct bt_data {
+  u8_t type;
+  u8_t data_len;
+  const u8_t *data;
+};
+
+#define BT_DATA(_type, _data, _data_len)	\
+  {						\
+    .type = (_type),				\
+    .data_len = (_data_len),			\
+    .data = (const u8_t *)(_data),		\
+  }
+
+#define BT_DATA_BYTES(_type, _bytes...)			\
+  BT_DATA(_type, ((u8_t []) { _bytes }), sizeof((u8_t []) { _bytes }))
+
+struct bt_le_adv_param {
+  u8_t options;
+  u16_t interval_min;
+  u16_t interval_max;
+};
+
+#define BT_LE_ADV_OPT_CONNECTABLE 0x01
+#define BT_LE_ADV_OPT_USE_NAME    0x08
+
+#define BT_LE_ADV_PARAM(_options, _int_min, _int_max)			\
+  (&(struct bt_le_adv_param) {						\
+    .options = (_options), .interval_min = (_int_min), .interval_max = (_int_max) \
+  })
+
+#define BT_LE_ADV_CONN_NAME BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE | \
+					    BT_LE_ADV_OPT_USE_NAME, 0x00a0, 0x00f0)
+
+typedef void (*bt_ready_cb_t)(int err);
+
+/* bt_enable brings up the simulated link and calls cb from the
+   Bluetooth thread, like the real stack */
+extern int bt_enable(bt_ready_cb_t cb);
+extern int bt_set_name(const char *name);
+extern const char *bt_get_name(void);
+extern int bt_le_adv_start(const struct bt_le_adv_param *param,
+			   const struct bt_data *ad, size_t ad_len,
+			   const struct bt_data *sd, size_t sd_len);
+extern int bt_le_adv_stop(void);
+
+#endif
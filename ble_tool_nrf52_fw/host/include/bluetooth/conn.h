@@ -0,0 +1,38 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BLUETOOTH_CONN_SHIM_H_
+#define BLUETOOTH_CONN_SHIM_H_
+
+#include <bluetooth/bluetooth.h>
+
+/* One simulated connection per client of the transport socket */
+struct bt_conn;
+
+struct bt_conn_cb {
+  void (*connected)(struct bt_conn *conn, u8_t err);
+  void (*disconnected)(struct bt_conn *conn, u8_t reason);
+  struct bt_conn_cb *_next;
+};
+
+extern void bt_conn_cb_register(struct bt_conn_cb *cb);
+extern struct bt_conn *bt_conn_ref(struct bt_conn *conn);
+extern void bt_conn_unref(struct bt_conn *conn);
+extern int  bt_conn_disconnect(struct bt_conn *conn, u8_t reason);
+
+#endif
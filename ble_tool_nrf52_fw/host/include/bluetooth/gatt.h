@@ -0,0 +1,157 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* GATT server shim. Services register themselves when the program
+   starts. Data from the transport socket is written to the first
+   writable characteristic of the last registered service, and every
+   notification goes out on the socket. */
+
+#ifndef BLUETOOTH_GATT_SHIM_H_
+#define BLUETOOTH_GATT_SHIM_H_
+
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+
+#define BT_ATT_ERR_INVALID_HANDLE         0x01
+#define BT_ATT_ERR_INVALID_OFFSET         0x07
+#define BT_ATT_ERR_INVALID_ATTRIBUTE_LEN  0x0d
+#define BT_ATT_ERR_UNLIKELY               0x0e
+#define BT_ATT_ERR_INSUFFICIENT_RESOURCES 0x11
+
+#define BT_GATT_ERR(_att_err) (-(_att_err))
+
+#define BT_GATT_PERM_NONE  0
+#define BT_GATT_PERM_READ  BIT(0)
+#define BT_GATT_PERM_WRITE BIT(1)
+
+#define BT_GATT_CHRC_BROADCAST              0x01
+#define BT_GATT_CHRC_READ                   0x02
+#define BT_GATT_CHRC_WRITE_WITHOUT_RESP     0x04
+#define BT_GATT_CHRC_WRITE                  0x08
+#define BT_GATT_CHRC_NOTIFY                 0x10
+#define BT_GATT_CHRC_INDICATE               0x20
+
+#define BT_GATT_CCC_NOTIFY   0x0001
+#define BT_GATT_CCC_INDICATE 0x0002
+
+#define BT_GATT_WRITE_FLAG_PREPARE BIT(0)
+#define BT_GATT_WRITE_FLAG_CMD     BIT(1)
+
+struct bt_gatt_attr;
+
+typedef ssize_t (*bt_gatt_attr_read_func_t)(struct bt_conn *conn,
+					    const struct bt_gatt_attr *attr,
+					    void *buf, u16_t len, u16_t offset);
+
+typedef ssize_t (*bt_gatt_attr_write_func_t)(struct bt_conn *conn,
+					     const struct bt_gatt_attr *attr,
+					     const void *buf, u16_t len,
+					     u16_t offset, u8_t flags);
+
+struct bt_gatt_attr {
+  const struct bt_uuid *uuid;
+  bt_gatt_attr_read_func_t read;
+  bt_gatt_attr_write_func_t write;
+  void *user_data;
+  u16_t handle;
+  u8_t perm;
+};
+
+struct bt_gatt_service_static {
+  const struct bt_gatt_attr *attrs;
+  size_t attr_count;
+};
+
+struct bt_gatt_chrc {
+  const struct bt_uuid *uuid;
+  u16_t value_handle;
+  u8_t properties;
+};
+
+struct _bt_gatt_ccc {
+  u16_t value;
+  void (*cfg_changed)(const struct bt_gatt_attr *attr, u16_t value);
+};
+
+extern void bt_shim_register_service(const struct bt_gatt_service_static *svc);
+
+#define BT_GATT_SERVICE_DEFINE(_name, ...)				\
+  const struct bt_gatt_attr attr_##_name[] = { __VA_ARGS__ };		\
+  const struct bt_gatt_service_static _name = {				\
+    .attrs = attr_##_name, .attr_count = ARRAY_SIZE(attr_##_name),	\
+  };									\
+  __attribute__((constructor)) static void _bt_gatt_reg_##_name(void) {	\
+    bt_shim_register_service(&_name);					\
+  }
+
+#define BT_GATT_ATTRIBUTE(_uuid, _perm, _read, _write, _value)	\
+  {								\
+    .uuid = (_uuid), .read = (_read), .write = (_write),	\
+    .user_data = (void *)(_value), .handle = 0, .perm = (_perm),	\
+  }
+
+#define BT_GATT_PRIMARY_SERVICE(_service) \
+  BT_GATT_ATTRIBUTE(BT_UUID_GATT_PRIMARY, BT_GATT_PERM_READ, NULL, NULL, _service)
+
+#define BT_GATT_CHARACTERISTIC(_uuid, _props, _perm, _read, _write, _value) \
+  BT_GATT_ATTRIBUTE(BT_UUID_GATT_CHRC, BT_GATT_PERM_READ, NULL, NULL,	\
+		    (&(struct bt_gatt_chrc) { .uuid = (_uuid), .properties = (_props) })), \
+  BT_GATT_ATTRIBUTE(_uuid, _perm, _read, _write, _value)
+
+#define BT_GATT_CCC(_changed, _perm)					\
+  BT_GATT_ATTRIBUTE(BT_UUID_GATT_CCC, _perm, NULL, NULL,		\
+		    (&(struct _bt_gatt_ccc) { .cfg_changed = (_changed) }))
+
+extern ssize_t bt_gatt_attr_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+				 void *buf, u16_t buf_len, u16_t offset,
+				 const void *value, u16_t value_len);
+
+typedef void (*bt_gatt_complete_func_t)(struct bt_conn *conn);
+
+struct bt_gatt_notify_params {
+  const struct bt_uuid *uuid;
+  const struct bt_gatt_attr *attr;
+  const void *data;
+  u16_t len;
+  bt_gatt_complete_func_t func;
+};
+
+extern int bt_gatt_notify_cb(struct bt_conn *conn,
+			     struct bt_gatt_notify_params *params);
+
+static inline int bt_gatt_notify(struct bt_conn *conn,
+				 const struct bt_gatt_attr *attr,
+				 const void *data, u16_t len) {
+  struct bt_gatt_notify_params params = {
+    .attr = attr,
+    .data = data,
+    .len = len,
+  };
+  return bt_gatt_notify_cb(conn, &params);
+}
+
+struct bt_gatt_exchange_params {
+  void (*func)(struct bt_conn *conn, u8_t err,
+	       struct bt_gatt_exchange_params *params);
+};
+
+extern int   bt_gatt_exchange_mtu(struct bt_conn *conn,
+				  struct bt_gatt_exchange_params *params);
+extern u16_t bt_gatt_get_mtu(struct bt_conn *conn);
+
+#endif
@@ -0,0 +1,27 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BLUETOOTH_SERVICES_BAS_SHIM_H_
+#define BLUETOOTH_SERVICES_BAS_SHIM_H_
+
+#include <zephyr/types.h>
+
+extern u8_t bt_gatt_bas_get_battery_level(void);
+extern int  bt_gatt_bas_set_battery_level(u8_t level);
+
+#endif
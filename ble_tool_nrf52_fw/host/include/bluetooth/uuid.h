@@ -0,0 +1,63 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BLUETOOTH_UUID_SHIM_H_
+#define BLUETOOTH_UUID_SHIM_H_
+
+#include <zephyr/types.h>
+
+enum {
+  BT_UUID_TYPE_16,
+  BT_UUID_TYPE_32,
+  BT_UUID_TYPE_128,
+};
+
+struct bt_uuid {
+  u8_t type;
+};
+
+struct bt_uuid_16 {
+  struct bt_uuid uuid;
+  u16_t val;
+};
+
+struct bt_uuid_128 {
+  struct bt_uuid uuid;
+  u8_t val[16];
+};
+
+#define BT_UUID_INIT_16(value)			\
+  {						\
+    .uuid = { BT_UUID_TYPE_16 },		\
+    .val = (value),				\
+  }
+
+#define BT_UUID_INIT_128(value...)		\
+  {						\
+    .uuid = { BT_UUID_TYPE_128 },		\
+    .val = { value },				\
+  }
+
+#define BT_UUID_DECLARE_16(value) \
+  ((struct bt_uuid *) ((struct bt_uuid_16[]) {BT_UUID_INIT_16(value)}))
+
+#define BT_UUID_GATT_PRIMARY BT_UUID_DECLARE_16(0x2800)
+#define BT_UUID_GATT_CHRC    BT_UUID_DECLARE_16(0x2803)
+#define BT_UUID_GATT_CCC     BT_UUID_DECLARE_16(0x2902)
+
+#endif
@@ -0,0 +1,32 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DEVICE_SHIM_H_
+#define DEVICE_SHIM_H_
+
+#include <zephyr/types.h>
+
+struct device {
+  const char *name;
+};
+
+/* Every binding exists on the host, the UART driver shim decides what
+   the device does */
+extern struct device *device_get_binding(const char *name);
+
+#endif
@@ -0,0 +1,50 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* The USB CDC UART of the firmware. Output written through the interrupt
+   driven API goes to stderr, there is no input. */
+
+#ifndef DRIVERS_UART_SHIM_H_
+#define DRIVERS_UART_SHIM_H_
+
+#include <device.h>
+
+enum uart_line_ctrl {
+  LINE_CTRL_BAUD_RATE = 1,
+  LINE_CTRL_RTS = 2,
+  LINE_CTRL_DTR = 4,
+  LINE_CTRL_DCD = 8,
+  LINE_CTRL_DSR = 16,
+};
+
+typedef void (*uart_irq_callback_t)(struct device *dev);
+
+extern void uart_irq_callback_set(struct device *dev, uart_irq_callback_t cb);
+extern int  uart_irq_update(struct device *dev);
+extern int  uart_irq_is_pending(struct device *dev);
+extern int  uart_irq_rx_ready(struct device *dev);
+extern int  uart_irq_tx_ready(struct device *dev);
+extern void uart_irq_rx_enable(struct device *dev);
+extern void uart_irq_tx_enable(struct device *dev);
+extern void uart_irq_tx_disable(struct device *dev);
+extern int  uart_fifo_read(struct device *dev, u8_t *rx_data, const int size);
+extern int  uart_fifo_fill(struct device *dev, const u8_t *tx_data, int size);
+extern int  uart_line_ctrl_get(struct device *dev, u32_t ctrl, u32_t *val);
+extern int  uart_line_ctrl_set(struct device *dev, u32_t ctrl, u32_t val);
+
+#endif
@@ -0,0 +1,45 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Settings subsystem shim. Values are kept in memory and, when the host
+   build is given a settings file, written to it on every save and read
+   back by settings_load. */
+
+#ifndef SETTINGS_SHIM_H_
+#define SETTINGS_SHIM_H_
+
+#include <zephyr/types.h>
+
+typedef ssize_t (*settings_read_cb)(void *cb_arg, void *data, size_t len);
+
+struct settings_handler {
+  const char *name;
+  int (*h_get)(const char *key, char *val, int val_len_max);
+  int (*h_set)(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg);
+  int (*h_commit)(void);
+  int (*h_export)(int (*export_func)(const char *name, const void *val, size_t val_len));
+  struct settings_handler *_next;
+};
+
+extern int settings_subsys_init(void);
+extern int settings_register(struct settings_handler *cf);
+extern int settings_load(void);
+extern int settings_save_one(const char *name, const void *value, size_t val_len);
+extern int settings_delete(const char *name);
+
+#endif
@@ -0,0 +1,30 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SYS_BYTEORDER_SHIM_H_
+#define SYS_BYTEORDER_SHIM_H_
+
+#include <endian.h>
+#include <zephyr/types.h>
+
+#define sys_cpu_to_le16(val) htole16(val)
+#define sys_cpu_to_le32(val) htole32(val)
+#define sys_le16_to_cpu(val) le16toh(val)
+#define sys_le32_to_cpu(val) le32toh(val)
+
+#endif
@@ -0,0 +1,39 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SYS_RING_BUFFER_SHIM_H_
+#define SYS_RING_BUFFER_SHIM_H_
+
+#include <zephyr/types.h>
+
+/* Byte mode ring buffer, not thread safe, callers lock as on target */
+struct ring_buf {
+  u32_t head;
+  u32_t tail;
+  u32_t size;
+  u8_t *buf;
+};
+
+extern void  ring_buf_init(struct ring_buf *buf, u32_t size, u8_t *data);
+extern void  ring_buf_reset(struct ring_buf *buf);
+extern u32_t ring_buf_put(struct ring_buf *buf, const u8_t *data, u32_t size);
+extern u32_t ring_buf_get(struct ring_buf *buf, u8_t *data, u32_t size);
+extern u32_t ring_buf_space_get(struct ring_buf *buf);
+extern bool  ring_buf_is_empty(struct ring_buf *buf);
+
+#endif
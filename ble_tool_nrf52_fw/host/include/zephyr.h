@@ -0,0 +1,165 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Host shim of the parts of the Zephyr kernel API used by the firmware.
+   Threads, semaphores and mutexes map onto pthreads, irq_lock onto one
+   global recursive mutex. Priorities are not emulated, the firmware
+   code has to be correct under any interleaving anyway. */
+
+#ifndef ZEPHYR_SHIM_H_
+#define ZEPHYR_SHIM_H_
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <zephyr/types.h>
+#include <sys/util.h>
+
+#define K_FOREVER (-1)
+#define K_NO_WAIT 0
+#define K_MSEC(ms) (ms)
+#define K_SECONDS(s) ((s) * 1000)
+
+#define K_PRIO_COOP(x) (-((x) + 1))
+#define K_PRIO_PREEMPT(x) (x)
+
+/* Atomics */
+typedef long atomic_t;
+typedef long atomic_val_t;
+
+static inline atomic_val_t atomic_get(const atomic_t *target) {
+  return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_set(atomic_t *target, atomic_val_t value) {
+  return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_clear(atomic_t *target) {
+  return atomic_set(target, 0);
+}
+
+static inline atomic_val_t atomic_inc(atomic_t *target) {
+  return __atomic_fetch_add(target, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_dec(atomic_t *target) {
+  return __atomic_fetch_sub(target, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Mutexes, recursive like the Zephyr ones */
+struct k_mutex {
+  pthread_mutex_t m;
+};
+
+#define K_MUTEX_DEFINE(name) \
+  struct k_mutex name = { PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP }
+
+extern int  k_mutex_init(struct k_mutex *mutex);
+extern int  k_mutex_lock(struct k_mutex *mutex, s32_t timeout);
+extern void k_mutex_unlock(struct k_mutex *mutex);
+
+/* Semaphores */
+struct k_sem {
+  pthread_mutex_t m;
+  pthread_cond_t c;
+  unsigned int count;
+  unsigned int limit;
+};
+
+#define K_SEM_DEFINE(name, initial, max) \
+  struct k_sem name = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, \
+			(initial), (max) }
+
+extern void k_sem_init(struct k_sem *sem, unsigned int initial, unsigned int limit);
+extern int  k_sem_take(struct k_sem *sem, s32_t timeout);
+extern void k_sem_give(struct k_sem *sem);
+extern unsigned int k_sem_count_get(struct k_sem *sem);
+extern void k_sem_reset(struct k_sem *sem);
+
+/* Threads, K_THREAD_DEFINE registers the thread and k_shim_start runs
+   all of them. Threads run with asynchronous cancellation so that
+   k_thread_abort stops them wherever they are, the shim calls
+   themselves can not be interrupted. */
+typedef void (*k_thread_entry_t)(void *p1, void *p2, void *p3);
+
+struct k_thread {
+  const char *name;
+  k_thread_entry_t entry;
+  void *p1, *p2, *p3;
+  s32_t delay;
+  pthread_t tid;
+  struct k_thread *next;
+};
+
+typedef struct k_thread *k_tid_t;
+
+/* The pthread gets a stack of its own, these only keep the firmware
+   code compiling */
+typedef char k_thread_stack_t;
+#define K_THREAD_STACK_DEFINE(sym, size) k_thread_stack_t sym[size]
+#define K_THREAD_STACK_SIZEOF(sym) sizeof(sym)
+
+extern void k_shim_register_thread(struct k_thread *def);
+extern void k_shim_start(void);
+
+extern k_tid_t k_thread_create(struct k_thread *new_thread, k_thread_stack_t *stack,
+			       size_t stack_size, k_thread_entry_t entry,
+			       void *p1, void *p2, void *p3,
+			       int prio, u32_t options, s32_t delay);
+extern void k_thread_abort(k_tid_t thread);
+
+#define K_THREAD_DEFINE(name, stack_size, entry, p1, p2, p3, prio, options, delay) \
+  static struct k_thread _k_thread_def_##name = {			\
+    #name, (k_thread_entry_t)(entry), (void *)(p1), (void *)(p2), (void *)(p3), (delay) \
+  };									\
+  k_tid_t const name = &_k_thread_def_##name;				\
+  __attribute__((constructor)) static void _k_thread_reg_##name(void) {	\
+    k_shim_register_thread(&_k_thread_def_##name);			\
+  }
+
+/* Work items, run one at a time on the shim's system work queue
+   thread. A work item that is already pending is not queued again. */
+struct k_work;
+typedef void (*k_work_handler_t)(struct k_work *work);
+
+struct k_work {
+  k_work_handler_t handler;
+  int pending;
+  struct k_work *next;
+};
+
+#define K_WORK_DEFINE(name, work_handler) \
+  struct k_work name = { (work_handler), 0, NULL }
+
+extern void k_work_init(struct k_work *work, k_work_handler_t handler);
+extern void k_work_submit(struct k_work *work);
+
+/* Time */
+extern s64_t k_uptime_get(void);
+extern u32_t k_uptime_get_32(void);
+extern s32_t k_sleep(s32_t ms);
+extern void  k_busy_wait(u32_t usec);
+extern void  k_yield(void);
+
+/* Interrupt locking */
+extern unsigned int irq_lock(void);
+extern void irq_unlock(unsigned int key);
+
+extern void printk(const char *fmt, ...);
+
+#endif
@@ -0,0 +1,601 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <errno.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <zephyr.h>
+#include <device.h>
+#include <drivers/uart.h>
+#include <sys/ring_buffer.h>
+#include <settings/settings.h>
+
+#include "shim.h"
+
+static struct k_thread *threads;
+static struct timespec start_time;
+
+static pthread_mutex_t irq_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+/* Keeps k_thread_abort out of the shim's own critical sections */
+#define NO_CANCEL_BEGIN() \
+  int _cancel_state; pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &_cancel_state)
+#define NO_CANCEL_END() pthread_setcancelstate(_cancel_state, NULL)
+
+/* Blocking waits go in slices with a chance to be aborted in between,
+   never while holding a pthread mutex */
+#define CANCEL_SLICE_MS 10
+
+static void cancel_point(int state) {
+  pthread_setcancelstate(state, NULL);
+  pthread_testcancel();
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+}
+
+static void timeout_to_abs(s32_t ms, struct timespec *ts) {
+  clock_gettime(CLOCK_REALTIME, ts);
+  ts->tv_sec += ms / 1000;
+  ts->tv_nsec += (long)(ms % 1000) * 1000000;
+  if (ts->tv_nsec >= 1000000000) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000;
+  }
+}
+
+/* ------------------------------------------------------------
+   Mutexes and semaphores
+   ------------------------------------------------------------ */
+
+int k_mutex_init(struct k_mutex *mutex) {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&mutex->m, &attr);
+  pthread_mutexattr_destroy(&attr);
+  return 0;
+}
+
+int k_mutex_lock(struct k_mutex *mutex, s32_t timeout) {
+  struct timespec ts;
+  int r;
+
+  NO_CANCEL_BEGIN();
+  if (timeout == K_NO_WAIT) {
+    r = pthread_mutex_trylock(&mutex->m) ? -EBUSY : 0;
+  } else if (timeout == K_FOREVER) {
+    do {
+      cancel_point(_cancel_state);
+      timeout_to_abs(CANCEL_SLICE_MS, &ts);
+    } while (pthread_mutex_timedlock(&mutex->m, &ts) == ETIMEDOUT);
+    r = 0;
+  } else {
+    timeout_to_abs(timeout, &ts);
+    r = pthread_mutex_timedlock(&mutex->m, &ts) ? -EAGAIN : 0;
+  }
+  NO_CANCEL_END();
+  return r;
+}
+
+void k_mutex_unlock(struct k_mutex *mutex) {
+  NO_CANCEL_BEGIN();
+  pthread_mutex_unlock(&mutex->m);
+  NO_CANCEL_END();
+}
+
+void k_sem_init(struct k_sem *sem, unsigned int initial, unsigned int limit) {
+  pthread_mutex_init(&sem->m, NULL);
+  pthread_cond_init(&sem->c, NULL);
+  sem->count = initial;
+  sem->limit = limit;
+}
+
+int k_sem_take(struct k_sem *sem, s32_t timeout) {
+  struct timespec ts;
+  int r = 0;
+
+  if (timeout > 0) timeout_to_abs(timeout, &ts);
+
+  NO_CANCEL_BEGIN();
+  pthread_mutex_lock(&sem->m);
+  while (sem->count == 0) {
+    if (timeout == K_NO_WAIT) {
+      r = -EBUSY;
+      break;
+    }
+    if (timeout == K_FOREVER) {
+      struct timespec slice;
+      timeout_to_abs(CANCEL_SLICE_MS, &slice);
+      if (pthread_cond_timedwait(&sem->c, &sem->m, &slice) == ETIMEDOUT) {
+	pthread_mutex_unlock(&sem->m);
+	cancel_point(_cancel_state);
+	pthread_mutex_lock(&sem->m);
+      }
+    } else if (pthread_cond_timedwait(&sem->c, &sem->m, &ts) == ETIMEDOUT) {
+      r = -EAGAIN;
+      break;
+    }
+  }
+  if (r == 0) sem->count--;
+  pthread_mutex_unlock(&sem->m);
+  NO_CANCEL_END();
+  return r;
+}
+
+void k_sem_give(struct k_sem *sem) {
+  NO_CANCEL_BEGIN();
+  pthread_mutex_lock(&sem->m);
+  if (sem->count < sem->limit) sem->count++;
+  pthread_cond_signal(&sem->c);
+  pthread_mutex_unlock(&sem->m);
+  NO_CANCEL_END();
+}
+
+unsigned int k_sem_count_get(struct k_sem *sem) {
+  NO_CANCEL_BEGIN();
+  pthread_mutex_lock(&sem->m);
+  unsigned int n = sem->count;
+  pthread_mutex_unlock(&sem->m);
+  NO_CANCEL_END();
+  return n;
+}
+
+void k_sem_reset(struct k_sem *sem) {
+  NO_CANCEL_BEGIN();
+  pthread_mutex_lock(&sem->m);
+  sem->count = 0;
+  pthread_mutex_unlock(&sem->m);
+  NO_CANCEL_END();
+}
+
+/* ------------------------------------------------------------
+   Threads and time
+   ------------------------------------------------------------ */
+
+void k_shim_register_thread(struct k_thread *def) {
+  def->next = threads;
+  threads = def;
+}
+
+static void *thread_main(void *arg) {
+  struct k_thread *def = arg;
+
+  pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+  if (def->delay > 0) k_sleep(def->delay);
+  def->entry(def->p1, def->p2, def->p3);
+  return NULL;
+}
+
+void k_shim_start(void) {
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+  for (struct k_thread *def = threads; def; def = def->next) {
+    if (pthread_create(&def->tid, NULL, thread_main, def)) {
+      fprintf(stderr, "Error starting thread %s\n", def->name);
+    }
+  }
+}
+
+k_tid_t k_thread_create(struct k_thread *new_thread, k_thread_stack_t *stack,
+			size_t stack_size, k_thread_entry_t entry,
+			void *p1, void *p2, void *p3,
+			int prio, u32_t options, s32_t delay) {
+  (void) stack; (void) stack_size; (void) prio; (void) options;
+
+  new_thread->name = "k_thread_create";
+  new_thread->entry = entry;
+  new_thread->p1 = p1;
+  new_thread->p2 = p2;
+  new_thread->p3 = p3;
+  new_thread->delay = delay;
+  new_thread->next = NULL;
+  if (pthread_create(&new_thread->tid, NULL, thread_main, new_thread)) {
+    fprintf(stderr, "Error creating thread\n");
+    return NULL;
+  }
+  return new_thread;
+}
+
+void k_thread_abort(k_tid_t thread) {
+  pthread_cancel(thread->tid);
+  pthread_join(thread->tid, NULL);
+}
+
+/* ------------------------------------------------------------
+   System work queue
+   ------------------------------------------------------------ */
+
+static pthread_mutex_t work_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static struct k_work *work_first;
+static struct k_work *work_last;
+
+void k_work_init(struct k_work *work, k_work_handler_t handler) {
+  memset(work, 0, sizeof(struct k_work));
+  work->handler = handler;
+}
+
+void k_work_submit(struct k_work *work) {
+  NO_CANCEL_BEGIN();
+  pthread_mutex_lock(&work_mutex);
+  if (!work->pending) {
+    work->pending = 1;
+    work->next = NULL;
+    if (work_last) {
+      work_last->next = work;
+    } else {
+      work_first = work;
+    }
+    work_last = work;
+    pthread_cond_signal(&work_cond);
+  }
+  pthread_mutex_unlock(&work_mutex);
+  NO_CANCEL_END();
+}
+
+static void sysworkq_thread(void *p1, void *p2, void *p3) {
+  (void) p1; (void) p2; (void) p3;
+
+  while (1) {
+    pthread_mutex_lock(&work_mutex);
+    while (!work_first) pthread_cond_wait(&work_cond, &work_mutex);
+    struct k_work *work = work_first;
+    work_first = work->next;
+    if (!work_first) work_last = NULL;
+    work->pending = 0;
+    pthread_mutex_unlock(&work_mutex);
+
+    work->handler(work);
+  }
+}
+
+K_THREAD_DEFINE(sysworkq, 1024, sysworkq_thread, NULL, NULL, NULL,
+		K_PRIO_COOP(1), 0, K_NO_WAIT);
+
+s64_t k_uptime_get(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (s64_t)(now.tv_sec - start_time.tv_sec) * 1000 +
+    (now.tv_nsec - start_time.tv_nsec) / 1000000;
+}
+
+u32_t k_uptime_get_32(void) {
+  return (u32_t)k_uptime_get();
+}
+
+s32_t k_sleep(s32_t ms) {
+  struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000 };
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+  return 0;
+}
+
+void k_busy_wait(u32_t usec) {
+  usleep(usec);
+}
+
+void k_yield(void) {
+  sched_yield();
+}
+
+unsigned int irq_lock(void) {
+  pthread_mutex_lock(&irq_mutex);
+  return 0;
+}
+
+void irq_unlock(unsigned int key) {
+  (void) key;
+  pthread_mutex_unlock(&irq_mutex);
+}
+
+void printk(const char *fmt, ...) {
+  va_list arg;
+  NO_CANCEL_BEGIN();
+  va_start(arg, fmt);
+  vfprintf(stderr, fmt, arg);
+  va_end(arg);
+  NO_CANCEL_END();
+}
+
+/* ------------------------------------------------------------
+   Ring buffer
+   ------------------------------------------------------------ */
+
+void ring_buf_init(struct ring_buf *buf, u32_t size, u8_t *data) {
+  buf->head = 0;
+  buf->tail = 0;
+  buf->size = size;
+  buf->buf = data;
+}
+
+void ring_buf_reset(struct ring_buf *buf) {
+  buf->head = 0;
+  buf->tail = 0;
+}
+
+u32_t ring_buf_space_get(struct ring_buf *buf) {
+  return buf->size - (buf->head - buf->tail);
+}
+
+bool ring_buf_is_empty(struct ring_buf *buf) {
+  return buf->head == buf->tail;
+}
+
+u32_t ring_buf_put(struct ring_buf *buf, const u8_t *data, u32_t size) {
+  u32_t n = MIN(size, ring_buf_space_get(buf));
+
+  for (u32_t i = 0; i < n; i++) {
+    buf->buf[(buf->head + i) % buf->size] = data[i];
+  }
+  buf->head += n;
+  return n;
+}
+
+u32_t ring_buf_get(struct ring_buf *buf, u8_t *data, u32_t size) {
+  u32_t n = MIN(size, buf->head - buf->tail);
+
+  for (u32_t i = 0; i < n; i++) {
+    data[i] = buf->buf[(buf->tail + i) % buf->size];
+  }
+  buf->tail += n;
+  return n;
+}
+
+/* ------------------------------------------------------------
+   Devices, the USB CDC UART writes to stderr
+   ------------------------------------------------------------ */
+
+static struct device uart_dev = { "CDC_ACM_0" };
+static uart_irq_callback_t uart_cb;
+static bool uart_tx_enabled;
+static bool uart_in_isr;
+
+struct device *device_get_binding(const char *name) {
+  (void) name;
+  return &uart_dev;
+}
+
+void uart_irq_callback_set(struct device *dev, uart_irq_callback_t cb) {
+  (void) dev;
+  uart_cb = cb;
+}
+
+int uart_irq_update(struct device *dev) {
+  (void) dev;
+  return 1;
+}
+
+int uart_irq_is_pending(struct device *dev) {
+  (void) dev;
+  return uart_tx_enabled;
+}
+
+int uart_irq_rx_ready(struct device *dev) {
+  (void) dev;
+  return 0;
+}
+
+int uart_irq_tx_ready(struct device *dev) {
+  (void) dev;
+  return uart_tx_enabled;
+}
+
+void uart_irq_rx_enable(struct device *dev) {
+  (void) dev;
+}
+
+/* The "interrupt" runs at once in the calling thread, with interrupts
+   locked */
+void uart_irq_tx_enable(struct device *dev) {
+  unsigned int key = irq_lock();
+
+  uart_tx_enabled = true;
+  if (uart_cb && !uart_in_isr) {
+    uart_in_isr = true;
+    uart_cb(dev);
+    uart_in_isr = false;
+  }
+  irq_unlock(key);
+}
+
+void uart_irq_tx_disable(struct device *dev) {
+  (void) dev;
+  uart_tx_enabled = false;
+}
+
+int uart_fifo_read(struct device *dev, u8_t *rx_data, const int size) {
+  (void) dev;
+  (void) rx_data;
+  (void) size;
+  return 0;
+}
+
+int uart_fifo_fill(struct device *dev, const u8_t *tx_data, int size) {
+  (void) dev;
+  ssize_t n = write(STDERR_FILENO, tx_data, size);
+  return n < 0 ? size : (int)n;
+}
+
+int uart_line_ctrl_get(struct device *dev, u32_t ctrl, u32_t *val) {
+  (void) dev;
+  (void) ctrl;
+  *val = 1;
+  return 0;
+}
+
+int uart_line_ctrl_set(struct device *dev, u32_t ctrl, u32_t val) {
+  (void) dev;
+  (void) ctrl;
+  (void) val;
+  return 0;
+}
+
+/* ------------------------------------------------------------
+   Settings
+   ------------------------------------------------------------ */
+
+#define MAX_SETTINGS 32
+
+struct setting {
+  char *name;
+  u8_t *value;
+  size_t len;
+};
+
+static struct setting settings[MAX_SETTINGS];
+static int num_settings;
+static struct settings_handler *settings_handlers;
+static const char *settings_path;
+
+struct read_arg {
+  const u8_t *value;
+  size_t len;
+};
+
+void settings_shim_file(const char *path) {
+  settings_path = path;
+}
+
+static struct setting *settings_find(const char *name) {
+  for (int i = 0; i < num_settings; i++) {
+    if (strcmp(settings[i].name, name) == 0) return &settings[i];
+  }
+  return NULL;
+}
+
+static int settings_store(const char *name, const void *value, size_t len) {
+  struct setting *s = settings_find(name);
+
+  if (!s) {
+    if (num_settings == MAX_SETTINGS) return -ENOMEM;
+    s = &settings[num_settings++];
+    s->name = strdup(name);
+    s->value = NULL;
+  }
+  free(s->value);
+  s->value = malloc(len ? len : 1);
+  memcpy(s->value, value, len);
+  s->len = len;
+  return 0;
+}
+
+/* File format: repeated name_len (u16), name, value_len (u32), value,
+   in host byte order */
+static int settings_write_file(void) {
+  if (!settings_path) return 0;
+
+  FILE *f = fopen(settings_path, "wb");
+  if (!f) return -EIO;
+
+  for (int i = 0; i < num_settings; i++) {
+    u16_t name_len = strlen(settings[i].name);
+    u32_t len = settings[i].len;
+    fwrite(&name_len, sizeof(name_len), 1, f);
+    fwrite(settings[i].name, 1, name_len, f);
+    fwrite(&len, sizeof(len), 1, f);
+    fwrite(settings[i].value, 1, len, f);
+  }
+  return fclose(f) ? -EIO : 0;
+}
+
+static void settings_read_file(void) {
+  char name[256];
+  u16_t name_len;
+  u32_t len;
+
+  if (!settings_path) return;
+
+  FILE *f = fopen(settings_path, "rb");
+  if (!f) return;
+
+  while (fread(&name_len, sizeof(name_len), 1, f) == 1 &&
+	 name_len < sizeof(name) &&
+	 fread(name, 1, name_len, f) == name_len &&
+	 fread(&len, sizeof(len), 1, f) == 1) {
+    u8_t *value = malloc(len ? len : 1);
+    if (fread(value, 1, len, f) != len) {
+      free(value);
+      break;
+    }
+    name[name_len] = 0;
+    settings_store(name, value, len);
+    free(value);
+  }
+  fclose(f);
+}
+
+static ssize_t settings_read(void *cb_arg, void *data, size_t len) {
+  struct read_arg *arg = cb_arg;
+  size_t n = MIN(len, arg->len);
+
+  memcpy(data, arg->value, n);
+  return n;
+}
+
+int settings_subsys_init(void) {
+  return 0;
+}
+
+int settings_register(struct settings_handler *cf) {
+  cf->_next = settings_handlers;
+  settings_handlers = cf;
+  return 0;
+}
+
+int settings_load(void) {
+  settings_read_file();
+
+  for (int i = 0; i < num_settings; i++) {
+    for (struct settings_handler *h = settings_handlers; h; h = h->_next) {
+      size_t n = strlen(h->name);
+      if (strncmp(settings[i].name, h->name, n) == 0 &&
+	  settings[i].name[n] == '/' && h->h_set) {
+	struct read_arg arg = { settings[i].value, settings[i].len };
+	h->h_set(settings[i].name + n + 1, settings[i].len, settings_read, &arg);
+      }
+    }
+  }
+  for (struct settings_handler *h = settings_handlers; h; h = h->_next) {
+    if (h->h_commit) h->h_commit();
+  }
+  return 0;
+}
+
+int settings_save_one(const char *name, const void *value, size_t val_len) {
+  int r;
+
+  if (val_len == 0) return settings_delete(name);
+
+  r = settings_store(name, value, val_len);
+  return r ? r : settings_write_file();
+}
+
+int settings_delete(const char *name) {
+  struct setting *s = settings_find(name);
+
+  if (s) {
+    free(s->name);
+    free(s->value);
+    *s = settings[--num_settings];
+  }
+  return settings_write_file();
+}
@@ -0,0 +1,76 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Build time tool: evaluates the lispBM prelude and prints the
+   definitions it made as a lisp image (../src/lisp_image.h), formatted
+   like xxd -i output to be included in an array initializer. The
+   firmware restores them at boot instead of parsing the prelude. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "heap.h"
+#include "symrepr.h"
+#include "eval_cps.h"
+#include "prelude.h"
+
+#include "lisp_image.h"
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+	  "Usage: %s [-c cells]\n"
+	  "  -c cells  heap used to evaluate the prelude (default %d)\n",
+	  prog, CONFIG_LISP_HEAP_SIZE);
+}
+
+int main(int argc, char **argv) {
+  static uint8_t image[65536];
+  int cells = CONFIG_LISP_HEAP_SIZE;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "c:h")) != -1) {
+    switch (opt) {
+    case 'c': cells = atoi(optarg); break;
+    default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (!symrepr_init() || !heap_init(cells) || !eval_cps_init(false)) {
+    fprintf(stderr, "Error initializing lispBM\n");
+    return 1;
+  }
+
+  eval_cps_program(prelude_load());
+
+  int n = lisp_image_write(eval_cps_get_env(), enc_sym(symrepr_nil()),
+			   image, sizeof(image));
+  if (n < 0) {
+    fprintf(stderr, "Error writing the prelude image (%d)\n", n);
+    return 1;
+  }
+
+  for (int i = 0; i < n; i++) {
+    printf("%s0x%02x%s", i % 12 ? " " : "  ", image[i],
+	   i == n - 1 ? "\n" : (i % 12 == 11 ? ",\n" : ","));
+  }
+  fprintf(stderr, "Prelude image: %d bytes\n", n);
+  return 0;
+}
@@ -0,0 +1,38 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Configuration of the host shims, set by host_main before the firmware
+   starts */
+
+#ifndef SHIM_H_
+#define SHIM_H_
+
+#include <zephyr/types.h>
+
+/* Serve the BLE UART service on a Unix socket at path, or on a pty when
+   path is NULL */
+extern void bt_shim_transport(const char *path);
+
+/* ATT MTU granted in the exchange, connection interval in ms (0 for no
+   pacing) and notifications completed per connection event */
+extern void bt_shim_link(u16_t mtu, int interval_ms, int packets);
+
+/* Keep the settings in a file, in memory only when not called */
+extern void settings_shim_file(const char *path);
+
+#endif
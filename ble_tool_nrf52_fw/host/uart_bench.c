@@ -0,0 +1,169 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Latency and throughput of the BLE UART REPL, run against ble_tool_host:
+     keystroke echo latency, expression round trip and :info output rate. */
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TIMEOUT_MS 5000
+
+static int sock = -1;
+static unsigned long bytes_in;
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void send_str(const char *s) {
+  size_t len = strlen(s);
+  if (write(sock, s, len) != (ssize_t)len) {
+    perror("write");
+    exit(1);
+  }
+}
+
+/* Read until the received bytes end with pattern */
+static void read_until(const char *pattern) {
+  size_t plen = strlen(pattern);
+  char tail[16] = { 0 };
+  char buf[512];
+
+  while (true) {
+    struct pollfd pfd = { sock, POLLIN, 0 };
+    if (poll(&pfd, 1, TIMEOUT_MS) <= 0) {
+      fprintf(stderr, "Timeout waiting for \"%s\"\n", pattern);
+      exit(1);
+    }
+    ssize_t n = read(sock, buf, sizeof(buf));
+    if (n <= 0) {
+      fprintf(stderr, "Connection closed\n");
+      exit(1);
+    }
+    bytes_in += n;
+    for (ssize_t i = 0; i < n; i++) {
+      memmove(tail, tail + 1, plen - 1);
+      tail[plen - 1] = buf[i];
+      if (memcmp(tail, pattern, plen) == 0 && i == n - 1) return;
+    }
+  }
+}
+
+static void report(const char *what, double *us, int n) {
+  qsort(us, n, sizeof(double), cmp_double);
+  printf("%-16s n=%-5d min %8.1f us  median %8.1f us  p99 %8.1f us\n",
+	 what, n, us[0], us[n / 2], us[(n * 99) / 100]);
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [-s path] [-k keystrokes] [-e expressions] [-i infos]\n", prog);
+}
+
+int main(int argc, char **argv) {
+  const char *path = "/tmp/ble_tool_nrf52_fw.sock";
+  int keys = 200;
+  int exprs = 50;
+  int infos = 20;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:k:e:i:h")) != -1) {
+    switch (opt) {
+    case 's': path = optarg; break;
+    case 'k': keys = atoi(optarg); break;
+    case 'e': exprs = atoi(optarg); break;
+    case 'i': infos = atoi(optarg); break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (keys < 1 || exprs < 1 || infos < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+  sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+    perror(path);
+    return 1;
+  }
+
+  /* the prompt printed before the connection is lost, ask for a new one */
+  send_str("\r");
+  read_until("# ");
+
+  double *us = malloc(sizeof(double) * (keys * 2 > exprs ? keys * 2 : exprs));
+
+  for (int i = 0; i < keys; i++) {
+    double t0 = now_us();
+    send_str("x");
+    read_until("x");
+    us[2 * i] = now_us() - t0;
+
+    t0 = now_us();
+    send_str("\b");
+    read_until("\b");
+    us[2 * i + 1] = now_us() - t0;
+  }
+  send_str("\r");
+  read_until("# ");
+  report("keystroke echo", us, keys * 2);
+
+  for (int i = 0; i < exprs; i++) {
+    double t0 = now_us();
+    send_str("(+ 1 2)\r");
+    read_until("# ");
+    us[i] = now_us() - t0;
+  }
+  report("(+ 1 2)", us, exprs);
+
+  unsigned long start_bytes = bytes_in;
+  double t0 = now_us();
+  for (int i = 0; i < infos; i++) {
+    send_str(":info\r");
+    read_until("# ");
+  }
+  double elapsed = now_us() - t0;
+  printf("%-16s n=%-5d %lu bytes, %.1f kB/s, %.2f ms per :info\n", ":info output",
+	 infos, bytes_in - start_bytes,
+	 (bytes_in - start_bytes) / (elapsed / 1e6) / 1000.0, elapsed / infos / 1000.0);
+
+  free(us);
+  close(sock);
+  return 0;
+}
@@ -0,0 +1,598 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <zephyr.h>
+#include <sys/ring_buffer.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include "ble_uart.h"
+
+/* Receive ring, a power of two */
+#define RX_RING_SIZE 1024
+
+/* ATT notification header */
+#define ATT_NOTIFY_HDR 3
+
+/* ATT MTU before the exchange */
+#define ATT_DEFAULT_MTU 23
+
+/* Largest notification payload, ATT MTU is at most 517 */
+#define MAX_PAYLOAD (517 - ATT_NOTIFY_HDR)
+
+#define TX_STACK_SIZE 1024
+#define TX_PRIORITY   K_PRIO_COOP(7)
+
+/* Single producer, single consumer ring for received bytes. The GATT
+   write handler in the Bluetooth RX thread is the only writer of head,
+   the REPL thread the only writer of tail. The indices run freely and
+   are masked on access; the atomic store of an index publishes the
+   bytes copied before it. */
+typedef struct {
+  u8_t buf[RX_RING_SIZE];
+  atomic_t head;
+  atomic_t tail;
+} rx_ring_t;
+
+static rx_ring_t rx_ring;
+static struct ble_uart_stats rx_stats;
+
+static u8_t ble_out_ring_buffer[CONFIG_BLE_UART_TX_BUF_SIZE];
+static struct ring_buf ble_out_ringbuf;
+
+K_MUTEX_DEFINE(ble_uart_mutex);
+/* held through ble_write and ble_printf, which share print_buffer */
+K_MUTEX_DEFINE(ble_output_mutex);
+
+/* given by writers, the TX thread sleeps on it */
+K_SEM_DEFINE(tx_kick, 0, 1);
+/* given by the TX thread when it has made room in the ring buffer */
+K_SEM_DEFINE(tx_space, 0, 1);
+/* notifications the controller has not completed yet */
+K_SEM_DEFINE(tx_credits, CONFIG_BLE_UART_TX_CREDITS, CONFIG_BLE_UART_TX_CREDITS);
+/* given when the central has written data */
+K_SEM_DEFINE(rx_ready, 0, 1);
+
+/* received bytes taken out of the ring buffer, consumed by ble_get_char */
+static u8_t rx_chunk[64];
+static u32_t rx_pos;
+static u32_t rx_len;
+
+static atomic_t tx_flush;
+static ble_output_hook_t output_hook;
+static struct bt_conn *uart_conn;
+static u16_t uart_mtu = ATT_DEFAULT_MTU;
+
+static struct bt_gatt_exchange_params mtu_params;
+
+static struct bt_uuid_128 bt_uart_base_uuid =
+  BT_UUID_INIT_128(0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0,
+		   0x93, 0xF3, 0xA3, 0xB5, 0x01, 0x00, 0x40, 0x6E);
+
+
+static struct bt_uuid_128 bt_uart_tx_uuid =
+  BT_UUID_INIT_128(0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0,
+		   0x93, 0xF3, 0xA3, 0xB5, 0x02, 0x00, 0x40, 0x6E);
+
+static struct bt_uuid_128 bt_uart_rx_uuid =
+  BT_UUID_INIT_128(0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0,
+		   0x93, 0xF3, 0xA3, 0xB5, 0x03, 0x00, 0x40, 0x6E);
+
+static u8_t bt_uart_read_buf[20] = "apa";
+
+static u32_t rx_ring_space(rx_ring_t *r) {
+  return RX_RING_SIZE - (u32_t)(atomic_get(&r->head) - atomic_get(&r->tail));
+}
+
+/* Producer side, all or nothing */
+static bool rx_ring_put(rx_ring_t *r, const u8_t *data, u32_t len) {
+  u32_t head = atomic_get(&r->head);
+  u32_t used = head - (u32_t)atomic_get(&r->tail);
+
+  if (len > RX_RING_SIZE - used) return false;
+
+  u32_t at = head & (RX_RING_SIZE - 1);
+  u32_t first = MIN(len, RX_RING_SIZE - at);
+  memcpy(r->buf + at, data, first);
+  memcpy(r->buf, data + first, len - first);
+
+  atomic_set(&r->head, head + len);
+
+  if (used + len > rx_stats.rx_high_water) {
+    rx_stats.rx_high_water = used + len;
+  }
+  return true;
+}
+
+/* Consumer side */
+static u32_t rx_ring_get(rx_ring_t *r, u8_t *data, u32_t len) {
+  u32_t tail = atomic_get(&r->tail);
+  u32_t avail = (u32_t)atomic_get(&r->head) - tail;
+
+  len = MIN(len, avail);
+
+  u32_t at = tail & (RX_RING_SIZE - 1);
+  u32_t first = MIN(len, RX_RING_SIZE - at);
+  memcpy(data, r->buf + at, first);
+  memcpy(data + first, r->buf, len - first);
+
+  atomic_set(&r->tail, tail + len);
+  return len;
+}
+
+/* A write that does not fit in the receive ring is refused as a whole
+   with an ATT error, the central retries it once the REPL has caught
+   up. Nothing is ever accepted and then dropped. The central keeps one
+   write in flight, so a refused write can not be overtaken by the next
+   one. */
+static ssize_t bt_uart_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			     const void *buf, u16_t len, u16_t offset,
+			     u8_t flags) {
+
+  if (flags & BT_GATT_WRITE_FLAG_PREPARE) {
+    /* checked again with the data when the write is executed */
+    return 0;
+  }
+
+  if (len > RX_RING_SIZE) {
+    rx_stats.rx_refused++;
+    rx_stats.rx_refused_bytes += len;
+    return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+  }
+
+  if (!rx_ring_put(&rx_ring, buf, len)) {
+    rx_stats.rx_refused++;
+    rx_stats.rx_refused_bytes += len;
+    return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+  }
+
+  rx_stats.rx_bytes += len;
+  k_sem_give(&rx_ready);
+  return len;
+}
+
+static ssize_t bt_uart_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			    void *buf, u16_t len, u16_t offset)
+{
+	const char *value = attr->user_data;
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, value,
+				 strlen(value));
+}
+
+static void bt_uart_ccc_changed(const struct bt_gatt_attr *attr,
+				       u16_t value)
+{
+  (void) attr;
+
+  // bool notif_enabled = (value == BT_GATT_CCC_NOTIFY);
+}
+
+
+BT_GATT_SERVICE_DEFINE(bt_uart,
+		       BT_GATT_PRIMARY_SERVICE(&bt_uart_base_uuid),
+		       BT_GATT_CHARACTERISTIC(&bt_uart_tx_uuid.uuid, // TX from the point of view of the central
+					      BT_GATT_CHRC_WRITE,    // central is allowed to write to tx
+					      BT_GATT_PERM_WRITE,
+					      NULL, bt_uart_write, NULL),
+		       BT_GATT_CHARACTERISTIC(&bt_uart_rx_uuid.uuid, // RX from point of view of central
+					      BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+					      BT_GATT_PERM_READ,
+					      bt_uart_read, NULL, bt_uart_read_buf),
+		       BT_GATT_CCC(bt_uart_ccc_changed,
+				   BT_GATT_PERM_READ | BT_GATT_PERM_WRITE));
+
+
+static void mtu_exchanged(struct bt_conn *conn, u8_t err,
+			  struct bt_gatt_exchange_params *params) {
+  (void) params;
+
+  if (err) return;
+
+  k_mutex_lock(&ble_uart_mutex, K_FOREVER);
+  if (conn == uart_conn) {
+    uart_mtu = bt_gatt_get_mtu(conn);
+  }
+  k_mutex_unlock(&ble_uart_mutex);
+
+  /* output waiting for a full notification may now fit in one */
+  k_sem_give(&tx_kick);
+}
+
+/* Ask for the largest ATT MTU, link layer packets and, if configured,
+   the 2M PHY. Stacks without the user update APIs negotiate data length
+   and PHY on their own when the controller supports it. */
+static void link_upgrade(struct bt_conn *conn) {
+  mtu_params.func = mtu_exchanged;
+  bt_gatt_exchange_mtu(conn, &mtu_params);
+
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+  bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+#endif
+
+#if defined(CONFIG_BLE_UART_PHY_2M) && defined(CONFIG_BT_USER_PHY_UPDATE)
+  bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+#endif
+}
+
+/* The stack does not complete notifications that were in flight when
+   the link went down, their credits are handed back here. k_sem_give
+   stops at the limit, so this also covers completions that did come. */
+static void tx_credits_rearm(void) {
+  for (int i = 0; i < CONFIG_BLE_UART_TX_CREDITS; i++) {
+    k_sem_give(&tx_credits);
+  }
+}
+
+void ble_uart_connected(struct bt_conn *conn) {
+  bool first = false;
+
+  k_mutex_lock(&ble_uart_mutex, K_FOREVER);
+  if (!uart_conn) {
+    uart_conn = bt_conn_ref(conn);
+    uart_mtu = bt_gatt_get_mtu(conn);
+    first = true;
+  }
+  k_mutex_unlock(&ble_uart_mutex);
+
+  if (first) {
+    tx_credits_rearm();
+    link_upgrade(conn);
+  }
+}
+
+bool ble_uart_is_connected(void) {
+  return uart_conn != NULL;
+}
+
+u16_t ble_uart_mtu(void) {
+  return uart_mtu;
+}
+
+void ble_uart_get_stats(struct ble_uart_stats *stats) {
+  *stats = rx_stats;
+  stats->rx_pending = RX_RING_SIZE - rx_ring_space(&rx_ring);
+}
+
+void ble_uart_disconnected(struct bt_conn *conn) {
+  k_mutex_lock(&ble_uart_mutex, K_FOREVER);
+  if (uart_conn == conn) {
+    bt_conn_unref(uart_conn);
+    uart_conn = NULL;
+    uart_mtu = ATT_DEFAULT_MTU;
+    /* nobody to send the rest to */
+    ring_buf_reset(&ble_out_ringbuf);
+  }
+  k_mutex_unlock(&ble_uart_mutex);
+
+  tx_credits_rearm();
+  /* release writers waiting for space */
+  k_sem_give(&tx_space);
+}
+
+/* Bytes per notification on the current connection */
+static u16_t tx_payload(void) {
+  u16_t payload = uart_mtu - ATT_NOTIFY_HDR;
+  return payload > MAX_PAYLOAD ? MAX_PAYLOAD : payload;
+}
+
+static void tx_complete(struct bt_conn *conn) {
+  (void) conn;
+  k_sem_give(&tx_credits);
+}
+
+/* Sends everything in the ring buffer, one credit per notification */
+static void tx_drain(void) {
+  static u8_t chunk[MAX_PAYLOAD];
+
+  while (true) {
+    k_sem_take(&tx_credits, K_FOREVER);
+
+    k_mutex_lock(&ble_uart_mutex, K_FOREVER);
+    struct bt_conn *conn = uart_conn ? bt_conn_ref(uart_conn) : NULL;
+    u32_t n = conn ? ring_buf_get(&ble_out_ringbuf, chunk, tx_payload()) : 0;
+    k_mutex_unlock(&ble_uart_mutex);
+
+    if (n == 0) {
+      k_sem_give(&tx_credits);
+      if (conn) bt_conn_unref(conn);
+      return;
+    }
+    k_sem_give(&tx_space);
+
+    struct bt_gatt_notify_params params = {
+      .attr = &bt_uart.attrs[2],
+      .data = chunk,
+      .len = n,
+      .func = tx_complete
+    };
+
+    if (bt_gatt_notify_cb(conn, &params) < 0) {
+      /* not sent, so no completion either */
+      k_sem_give(&tx_credits);
+    }
+    bt_conn_unref(conn);
+  }
+}
+
+static u32_t tx_pending(void) {
+  k_mutex_lock(&ble_uart_mutex, K_FOREVER);
+  u32_t n = sizeof(ble_out_ring_buffer) - ring_buf_space_get(&ble_out_ringbuf);
+  u16_t payload = tx_payload();
+  k_mutex_unlock(&ble_uart_mutex);
+  return n >= payload ? payload : n;
+}
+
+static void tx_thread(void *p1, void *p2, void *p3) {
+  while (true) {
+    k_sem_take(&tx_kick, K_FOREVER);
+
+    /* Let a partial notification fill up for a moment unless a line
+       was completed, keystroke echo and short prints then share a
+       packet instead of taking one each. */
+    s64_t deadline = k_uptime_get() + CONFIG_BLE_UART_TX_FLUSH_MS;
+    while (!atomic_clear(&tx_flush)) {
+      u32_t pending = tx_pending();
+      s64_t left = deadline - k_uptime_get();
+
+      if (pending == 0 || left <= 0) break;
+      if (pending >= tx_payload()) break;
+      k_sem_take(&tx_kick, K_MSEC((s32_t)left));
+    }
+
+    tx_drain();
+  }
+}
+
+K_THREAD_DEFINE(ble_uart_tx_tid, TX_STACK_SIZE, tx_thread, NULL, NULL, NULL,
+		TX_PRIORITY, 0, K_NO_WAIT);
+
+void ble_write_raw(const u8_t *data, int len) {
+  int written = 0;
+  bool flush = memchr(data, '\n', len) != NULL;
+
+  while (written < len) {
+    k_mutex_lock(&ble_uart_mutex, K_FOREVER);
+    if (!uart_conn) {
+      k_mutex_unlock(&ble_uart_mutex);
+      return;
+    }
+    written += ring_buf_put(&ble_out_ringbuf, data + written, len - written);
+    k_mutex_unlock(&ble_uart_mutex);
+
+    if (written < len) {
+      /* full, have the TX thread send what is there and wait for room */
+      atomic_set(&tx_flush, 1);
+      k_sem_give(&tx_kick);
+      k_sem_take(&tx_space, K_FOREVER);
+    }
+  }
+
+  if (flush) atomic_set(&tx_flush, 1);
+  k_sem_give(&tx_kick);
+}
+
+void ble_write(const u8_t *data, int len) {
+  k_mutex_lock(&ble_output_mutex, K_FOREVER);
+  if (output_hook) {
+    output_hook(data, len);
+  } else {
+    ble_write_raw(data, len);
+  }
+  k_mutex_unlock(&ble_output_mutex);
+}
+
+void ble_output_lock(void) {
+  k_mutex_lock(&ble_output_mutex, K_FOREVER);
+}
+
+void ble_output_unlock(void) {
+  k_mutex_unlock(&ble_output_mutex);
+}
+
+void ble_set_output_hook(ble_output_hook_t hook) {
+  output_hook = hook;
+}
+
+void ble_flush(void) {
+  atomic_set(&tx_flush, 1);
+  k_sem_give(&tx_kick);
+}
+
+int ble_get_char(void) {
+
+  if (rx_pos == rx_len) {
+    rx_len = rx_ring_get(&rx_ring, rx_chunk, sizeof(rx_chunk));
+    rx_pos = 0;
+    if (rx_len == 0) return -1;
+  }
+  return rx_chunk[rx_pos++];
+}
+
+/* Makes sure rx_chunk has bytes, waiting at most timeout for them.
+   Returns false on timeout or when woken by ble_read_wake. */
+static bool rx_wait(s32_t timeout) {
+  bool waited = false;
+
+  while (true) {
+    if (rx_pos == rx_len) {
+      rx_len = rx_ring_get(&rx_ring, rx_chunk, sizeof(rx_chunk));
+      rx_pos = 0;
+    }
+    if (rx_len > 0) return true;
+    if (waited || k_sem_take(&rx_ready, timeout) != 0) return false;
+    waited = true;
+  }
+}
+
+int ble_read(u8_t *data, int size, s32_t timeout) {
+  if (!rx_wait(timeout)) return 0;
+
+  int n = MIN((u32_t)size, rx_len - rx_pos);
+  memcpy(data, rx_chunk + rx_pos, n);
+  rx_pos += n;
+  return n + rx_ring_get(&rx_ring, data + n, size - n);
+}
+
+void ble_read_wake(void) {
+  k_sem_give(&rx_ready);
+}
+
+int ble_wait_char(void) {
+  while (!rx_wait(K_FOREVER));
+  return rx_chunk[rx_pos++];
+}
+
+void ble_put_char(int i) {
+
+  u8_t c = (u8_t) i;
+
+  ble_write(&c, 1);
+}
+
+void ble_printf(char *format, ...) {
+
+  va_list arg;
+  va_start(arg, format);
+  int len;
+  static char print_buffer[4096];
+
+  k_mutex_lock(&ble_output_mutex, K_FOREVER);
+  len = vsnprintf(print_buffer, 4096,format, arg);
+  va_end(arg);
+
+  if (len > 4095) len = 4095;
+  if (len > 0) ble_write((u8_t *)print_buffer, len);
+  k_mutex_unlock(&ble_output_mutex);
+}
+
+void ble_line_init(ble_line_t *line, char *buffer, int size) {
+  line->buffer = buffer;
+  line->size = size;
+  line->n = 0;
+}
+
+/* Echo is collected per received chunk and sent in one write before the
+   thread goes back to sleep. */
+int ble_line_poll(ble_line_t *line, s32_t timeout) {
+  u8_t echo[sizeof(rx_chunk)];
+  int echo_len = 0;
+  char *buffer = line->buffer;
+  int r;
+
+  while (line->n < line->size - 1) {
+    if (rx_pos == rx_len) {
+      /* about to wait for the user, who should see the prompt and the
+	 echo first */
+      if (echo_len > 0) ble_write(echo, echo_len);
+      ble_flush();
+      echo_len = 0;
+      if (!rx_wait(timeout)) return BLE_LINE_MORE;
+    }
+
+    int c = rx_chunk[rx_pos++];
+    switch (c) {
+    case 3: /* ctrl-c, the line is thrown away */
+      line->n = 0;
+      buffer[0] = 0;
+      if (echo_len > 0) ble_write(echo, echo_len);
+      return BLE_LINE_INTERRUPT;
+    case 127: /* fall through to below */
+    case '\b': /* backspace character received */
+      if (line->n > 0)
+        line->n--;
+      buffer[line->n] = 0;
+      echo[echo_len++] = '\b'; /* output backspace character */
+      break;
+    case '\n': /* fall through to \r */
+    case '\r':
+      buffer[line->n] = 0;
+      if (echo_len > 0) ble_write(echo, echo_len);
+      r = line->n;
+      line->n = 0;
+      return r;
+    default:
+      echo[echo_len++] = c;
+      buffer[line->n++] = c;
+      break;
+    }
+
+    if (echo_len == sizeof(echo)) {
+      ble_write(echo, echo_len);
+      echo_len = 0;
+    }
+  }
+  if (echo_len > 0) ble_write(echo, echo_len);
+  buffer[line->size - 1] = 0;
+  line->n = 0;
+  return 0; // Filled up buffer without reading a linebreak
+}
+
+/* Drops the unread input up to and including the first ctrl-c, returns
+   false when there is none */
+static bool rx_take_interrupt(void) {
+  for (u32_t i = rx_pos; i < rx_len; i++) {
+    if (rx_chunk[i] == 3) {
+      rx_pos = i + 1;
+      return true;
+    }
+  }
+
+  u32_t head = atomic_get(&rx_ring.head);
+  for (u32_t t = atomic_get(&rx_ring.tail); t != head; t++) {
+    if (rx_ring.buf[t & (RX_RING_SIZE - 1)] == 3) {
+      rx_pos = rx_len;
+      atomic_set(&rx_ring.tail, t + 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+int ble_line_hold(ble_line_t *line, s32_t timeout) {
+  ble_flush();
+  k_sem_take(&rx_ready, timeout);
+
+  if (!rx_take_interrupt()) return BLE_LINE_MORE;
+
+  line->n = 0;
+  line->buffer[0] = 0;
+  return BLE_LINE_INTERRUPT;
+}
+
+int ble_inputline(char *buffer, int size) {
+  ble_line_t line;
+  int r;
+
+  ble_line_init(&line, buffer, size);
+  do {
+    r = ble_line_poll(&line, K_FOREVER);
+  } while (r == BLE_LINE_MORE);
+
+  return r == BLE_LINE_INTERRUPT ? 0 : r;
+}
+
+void ble_uart_init(void) {
+  ring_buf_init(&ble_out_ringbuf, sizeof(ble_out_ring_buffer), ble_out_ring_buffer);
+}
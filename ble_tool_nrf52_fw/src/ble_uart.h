@@ -0,0 +1,106 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BLE_UART_H_
+#define BLE_UART_H_
+
+#include <zephyr/types.h>
+#include <bluetooth/conn.h>
+
+/* UART over a BLE GATT service, compatible with the Nordic UART service.
+ *
+ * Output is collected in a ring buffer and sent by a TX thread in
+ * notifications as large as the connection allows. On connect the
+ * largest ATT MTU is requested and the notification size follows the
+ * result of the exchange. A partial notification
+ * goes out at the end of a line or after CONFIG_BLE_UART_TX_FLUSH_MS.
+ * Writers block while the ring buffer is full and a central is connected,
+ * without a connection output is dropped.
+ */
+
+/* Receive side counters. A write that does not fit in the receive ring
+   is refused with an ATT error and counted, the central has to repeat
+   it. */
+struct ble_uart_stats {
+  u32_t rx_bytes;
+  u32_t rx_refused;
+  u32_t rx_refused_bytes;
+  u32_t rx_high_water;
+  u32_t rx_pending;
+};
+
+extern void ble_uart_init(void);
+
+/* Called from the connection callbacks */
+extern void ble_uart_connected(struct bt_conn *conn);
+extern void ble_uart_disconnected(struct bt_conn *conn);
+
+/* ATT MTU of the current connection, notifications carry MTU - 3 bytes */
+extern bool  ble_uart_is_connected(void);
+extern u16_t ble_uart_mtu(void);
+extern void  ble_uart_get_stats(struct ble_uart_stats *stats);
+
+/* ble_get_char returns -1 when nothing has been received, ble_wait_char
+   and ble_inputline sleep until the central writes */
+extern int  ble_get_char(void);
+extern int  ble_wait_char(void);
+/* Take up to size received bytes, waits at most timeout for the first.
+   Returns 0 on timeout or when woken by ble_read_wake. */
+extern int  ble_read(u8_t *data, int size, s32_t timeout);
+/* Wakes a thread waiting for input in ble_read or ble_line_poll */
+extern void ble_read_wake(void);
+extern void ble_put_char(int c);
+
+/* Output of ble_put_char, ble_printf and ble_write goes to the hook when
+   one is set, ble_write_raw always goes to the central. */
+typedef void (*ble_output_hook_t)(const u8_t *data, int len);
+
+extern void ble_set_output_hook(ble_output_hook_t hook);
+extern void ble_write(const u8_t *data, int len);
+extern void ble_write_raw(const u8_t *data, int len);
+/* Send buffered output now instead of waiting for more */
+extern void ble_flush(void);
+extern void ble_printf(char *format, ...);
+/* Held while output is written, a thread that holds it knows no other
+   thread is in the middle of ble_write or ble_printf */
+extern void ble_output_lock(void);
+extern void ble_output_unlock(void);
+
+/* Line editing that can be left and resumed. ble_line_poll returns the
+   length of a completed line, BLE_LINE_MORE when timeout passed or the
+   thread was woken first, the partial line is kept, and
+   BLE_LINE_INTERRUPT when ctrl-c was typed. */
+#define BLE_LINE_INTERRUPT -1
+#define BLE_LINE_MORE      -2
+
+typedef struct {
+  char *buffer;
+  int size;
+  int n;
+} ble_line_t;
+
+extern void ble_line_init(ble_line_t *line, char *buffer, int size);
+extern int  ble_line_poll(ble_line_t *line, s32_t timeout);
+/* Waits like ble_line_poll but leaves the input unread, except that a
+   ctrl-c is taken together with everything typed before it. Used when
+   the input can not be acted on yet. */
+extern int  ble_line_hold(ble_line_t *line, s32_t timeout);
+/* Waits for a whole line, ctrl-c gives an empty one */
+extern int  ble_inputline(char *buffer, int size);
+
+#endif
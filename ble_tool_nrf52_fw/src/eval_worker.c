@@ -0,0 +1,192 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <errno.h>
+#include <zephyr.h>
+
+#include "ble_uart.h"
+#include "eval_worker.h"
+
+/* Below the REPL thread, which has to get the CPU to notice an
+   interrupt while an evaluation spins */
+#define EVAL_PRIORITY K_PRIO_PREEMPT(12)
+#define QUEUE_DEPTH   CONFIG_LISP_EVAL_QUEUE_DEPTH
+
+typedef struct {
+  eval_prepare_fn prepare;
+  eval_job_fn job;
+  char *program;
+} eval_job_t;
+
+/* Queued jobs, the first one is with the worker while running is set */
+static eval_job_t queue[QUEUE_DEPTH];
+static int q_first;
+static int q_num;
+static bool running;
+static s64_t started;
+static int status;
+static u32_t budget = CONFIG_LISP_EVAL_TIMEOUT_MS;
+
+static eval_reset_fn reset_fn;
+static eval_done_fn done_fn;
+
+K_MUTEX_DEFINE(eval_mutex);
+/* given by eval_worker_dispatch when the first job is prepared */
+K_SEM_DEFINE(eval_jobs, 0, 1);
+/* given when a job has finished */
+K_SEM_DEFINE(eval_done, 0, 1);
+
+K_THREAD_STACK_DEFINE(eval_stack, CONFIG_LISP_EVAL_STACK_SIZE);
+static struct k_thread eval_thread_data;
+static k_tid_t eval_tid;
+
+static void eval_thread(void *p1, void *p2, void *p3) {
+  (void) p1; (void) p2; (void) p3;
+
+  while (true) {
+    k_sem_take(&eval_jobs, K_FOREVER);
+
+    k_mutex_lock(&eval_mutex, K_FOREVER);
+    eval_job_t j = queue[q_first];
+    k_mutex_unlock(&eval_mutex);
+
+    int r = j.job(j.program);
+
+    k_mutex_lock(&eval_mutex, K_FOREVER);
+    status = r;
+    running = false;
+    q_first = (q_first + 1) % QUEUE_DEPTH;
+    q_num--;
+    k_mutex_unlock(&eval_mutex);
+
+    k_sem_give(&eval_done);
+    if (done_fn) done_fn();
+  }
+}
+
+static void start_worker(void) {
+  eval_tid = k_thread_create(&eval_thread_data, eval_stack,
+			     K_THREAD_STACK_SIZEOF(eval_stack),
+			     eval_thread, NULL, NULL, NULL,
+			     EVAL_PRIORITY, 0, K_NO_WAIT);
+}
+
+void eval_worker_init(eval_reset_fn reset, eval_done_fn done) {
+  reset_fn = reset;
+  done_fn = done;
+  start_worker();
+}
+
+int eval_worker_submit(eval_prepare_fn prepare, eval_job_fn job, char *program) {
+  k_mutex_lock(&eval_mutex, K_FOREVER);
+  if (q_num == QUEUE_DEPTH) {
+    k_mutex_unlock(&eval_mutex);
+    return -EBUSY;
+  }
+  queue[(q_first + q_num) % QUEUE_DEPTH].prepare = prepare;
+  queue[(q_first + q_num) % QUEUE_DEPTH].job = job;
+  queue[(q_first + q_num) % QUEUE_DEPTH].program = program;
+  q_num++;
+  k_mutex_unlock(&eval_mutex);
+  return 0;
+}
+
+void eval_worker_dispatch(void) {
+  k_mutex_lock(&eval_mutex, K_FOREVER);
+  if (running || q_num == 0) {
+    k_mutex_unlock(&eval_mutex);
+    return;
+  }
+  eval_job_t j = queue[q_first];
+  k_mutex_unlock(&eval_mutex);
+
+  /* the worker is idle, only this thread touches the interpreter */
+  if (j.prepare) j.prepare(j.program);
+
+  k_mutex_lock(&eval_mutex, K_FOREVER);
+  running = true;
+  started = k_uptime_get();
+  k_mutex_unlock(&eval_mutex);
+
+  k_sem_give(&eval_jobs);
+}
+
+bool eval_worker_busy(void) {
+  k_mutex_lock(&eval_mutex, K_FOREVER);
+  bool busy = q_num > 0;
+  k_mutex_unlock(&eval_mutex);
+  return busy;
+}
+
+bool eval_worker_full(void) {
+  k_mutex_lock(&eval_mutex, K_FOREVER);
+  bool full = q_num == QUEUE_DEPTH;
+  k_mutex_unlock(&eval_mutex);
+  return full;
+}
+
+int eval_worker_wait(s32_t timeout) {
+  while (true) {
+    eval_worker_dispatch();
+    if (!eval_worker_busy()) return 0;
+    if (k_sem_take(&eval_done, timeout) != 0) return -EAGAIN;
+  }
+}
+
+int eval_worker_status(void) {
+  return status;
+}
+
+void eval_worker_set_budget(u32_t ms) {
+  budget = ms;
+}
+
+u32_t eval_worker_budget(void) {
+  return budget;
+}
+
+s32_t eval_worker_time_left(void) {
+  s32_t left = K_FOREVER;
+
+  k_mutex_lock(&eval_mutex, K_FOREVER);
+  if (budget > 0 && q_num > 0) {
+    s64_t used = running ? k_uptime_get() - started : 0;
+    left = used >= budget ? 0 : (s32_t)(budget - used);
+  }
+  k_mutex_unlock(&eval_mutex);
+  return left;
+}
+
+void eval_worker_abort(void) {
+  /* The worker must not die holding a lock someone else needs. It does
+     not parse or call into the Bluetooth stack (see eval_worker.h), so with both locks taken here it is either
+     evaluating or waiting for one of them. */
+  ble_output_lock();
+  k_mutex_lock(&eval_mutex, K_FOREVER);
+  k_thread_abort(eval_tid);
+  q_first = 0;
+  q_num = 0;
+  running = false;
+  k_sem_reset(&eval_jobs);
+  k_mutex_unlock(&eval_mutex);
+  ble_output_unlock();
+
+  if (reset_fn) reset_fn();
+  start_worker();
+  k_sem_give(&eval_done);
+}
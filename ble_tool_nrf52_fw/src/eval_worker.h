@@ -0,0 +1,85 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef EVAL_WORKER_H_
+#define EVAL_WORKER_H_
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+
+/* Evaluation of lisp programs on a thread of its own.
+ *
+ * The REPL thread queues programs for the worker and keeps reading
+ * input while they run, so an evaluation that does not end can still
+ * be interrupted. lispBM cannot be stopped from the outside, aborting
+ * kills the worker thread, starts a new one and has the reset function
+ * build a fresh interpreter. The heap may have been left in the middle
+ * of a collection and is not used again.
+ *
+ * A thread killed while it owns a lock leaves that lock taken for good,
+ * so the worker only evaluates. A job's prepare step, the parser which
+ * interns symbols with malloc, runs on the REPL thread in
+ * eval_worker_dispatch while the worker is idle, which also keeps the
+ * heap to one thread at a time. Output is written under
+ * ble_output_lock, which abort takes first, and extensions that call
+ * into the Bluetooth stack hand that to the system work queue.
+ */
+
+/* Runs on the thread calling eval_worker_dispatch, right before the
+   worker gets the job. Parses program for the job to evaluate. */
+typedef void (*eval_prepare_fn)(char *program);
+/* Evaluates and prints what prepare parsed, runs on the worker thread.
+   The return value is kept as the status of the job. */
+typedef int (*eval_job_fn)(char *program);
+/* Called on the aborting thread once the worker is gone */
+typedef void (*eval_reset_fn)(void);
+/* Called on the worker thread each time a job has finished */
+typedef void (*eval_done_fn)(void);
+
+extern void eval_worker_init(eval_reset_fn reset, eval_done_fn done);
+
+/* Queues program for prepare and job. The buffer must stay valid until
+   the job has run. Returns -EBUSY when the queue is full. */
+extern int  eval_worker_submit(eval_prepare_fn prepare, eval_job_fn job,
+			       char *program);
+/* Hands the next queued job to the worker if it is idle. Called by the
+   submitting thread whenever it is woken, eval_worker_wait does it too. */
+extern void eval_worker_dispatch(void);
+/* True while jobs are queued or running */
+extern bool eval_worker_busy(void);
+/* True while no more jobs can be queued */
+extern bool eval_worker_full(void);
+/* Dispatches and waits at most timeout for the queue to run empty,
+   returns -EAGAIN on timeout */
+extern int  eval_worker_wait(s32_t timeout);
+/* Status of the last job that finished */
+extern int  eval_worker_status(void);
+
+/* Time an evaluation may run before the REPL aborts it, 0 for no
+   limit. Enforced by whoever waits for the worker. */
+extern void  eval_worker_set_budget(u32_t ms);
+extern u32_t eval_worker_budget(void);
+/* Milliseconds the running job has left, K_FOREVER when idle or
+   without a budget */
+extern s32_t eval_worker_time_left(void);
+
+/* Stops the running job, drops the queued ones and calls the reset
+   function */
+extern void eval_worker_abort(void);
+
+#endif
@@ -0,0 +1,278 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr.h>
+
+#include "ble_uart.h"
+#include "frame_codec.h"
+#include "frame.h"
+
+#define WINDOW CONFIG_BLE_FRAME_WINDOW
+
+/* Largest payload sent, the central may send up to FRAME_MAX_PAYLOAD */
+#define TX_PAYLOAD 240
+
+#define RETRANSMIT_MS 500
+#define MAX_RETRIES   10
+
+/* Frames sent and not yet acknowledged, kept encoded for resending */
+static u8_t tx_frames[WINDOW][TX_PAYLOAD + FRAME_OVERHEAD];
+static u16_t tx_sizes[WINDOW];
+static u8_t tx_base;
+static u8_t tx_next;
+
+/* Output collected for the next DATA frame */
+static u8_t out_buf[TX_PAYLOAD];
+static int out_len;
+
+static frame_parser_t parser;
+static u8_t rx_expected;
+static int rx_unacked;
+static bool nak_sent;
+
+static char *script;
+static int script_len;
+static bool script_overflow;
+
+static bool closed;
+static bool failed;
+static bool evaluating;
+static frame_eval_fn eval_fn;
+
+static void frame_output_end(u8_t status);
+
+static void send_control(u8_t type, u8_t seq) {
+  u8_t buf[FRAME_OVERHEAD + 1];
+  size_t n = frame_encode(buf, type, 0, &seq, 1);
+  ble_write_raw(buf, n);
+}
+
+static void send_ack(void) {
+  send_control(FRAME_ACK, rx_expected);
+  rx_unacked = 0;
+  nak_sent = false;
+}
+
+static void retransmit(void) {
+  for (u8_t seq = tx_base; seq != tx_next; seq++) {
+    ble_write_raw(tx_frames[seq % WINDOW], tx_sizes[seq % WINDOW]);
+  }
+  ble_flush();
+}
+
+/* Acknowledges everything before seq, if seq is in the window */
+static void acknowledge(u8_t seq) {
+  if (frame_seq_diff(seq, tx_base) > 0 &&
+      frame_seq_diff(seq, tx_next) <= 0) {
+    tx_base = seq;
+  }
+}
+
+static void handle_frame(frame_t *f) {
+
+  if (f->type == FRAME_ACK || f->type == FRAME_NAK) {
+    if (f->len != 1) return;
+    acknowledge(f->payload[0]);
+    if (f->type == FRAME_NAK) retransmit();
+    return;
+  }
+
+  if (!frame_is_numbered(f->type)) return;
+
+  /* Only ACKs are taken while a program runs and waits for the window,
+     the central resends anything else once it has the result */
+  if (evaluating) return;
+
+  if (f->seq != rx_expected) {
+    if (frame_seq_diff(f->seq, rx_expected) < 0) {
+      /* a resent frame we already have, the ACK was lost */
+      send_ack();
+    } else if (!nak_sent) {
+      send_control(FRAME_NAK, rx_expected);
+      nak_sent = true;
+    }
+    return;
+  }
+
+  rx_expected++;
+  rx_unacked++;
+  nak_sent = false;
+
+  switch (f->type) {
+  case FRAME_DATA:
+    if (script_len + f->len >= CONFIG_BLE_FRAME_SCRIPT_SIZE) {
+      script_overflow = true;
+    } else {
+      memcpy(script + script_len, f->payload, f->len);
+      script_len += f->len;
+    }
+    break;
+  case FRAME_EVAL:
+    send_ack();
+    script[script_len] = 0;
+    {
+      u8_t status = 1;
+      if (script_overflow) {
+	ble_printf("Program larger than %d bytes\n", CONFIG_BLE_FRAME_SCRIPT_SIZE);
+      } else {
+	evaluating = true;
+	status = eval_fn(script, script_len) ? 1 : 0;
+	evaluating = false;
+      }
+      frame_output_end(status);
+    }
+    script_len = 0;
+    script_overflow = false;
+    break;
+  case FRAME_CLOSE:
+    send_ack();
+    closed = true;
+    break;
+  }
+}
+
+/* Takes received bytes through the parser, waiting at most timeout for
+   them. Returns false on timeout. */
+static bool service_input(s32_t timeout) {
+  u8_t buf[64];
+  int n;
+
+  if (rx_unacked > 0) {
+    send_ack();
+    ble_flush();
+  }
+
+  n = ble_read(buf, sizeof(buf), timeout);
+  if (n == 0) return false;
+
+  do {
+    for (int i = 0; i < n && !closed; i++) {
+      int r = frame_parse(&parser, buf[i]);
+      if (r == FRAME_COMPLETE) {
+	handle_frame(&parser.frame);
+      } else if (r == FRAME_BAD && !nak_sent) {
+	send_control(FRAME_NAK, rx_expected);
+	nak_sent = true;
+      }
+    }
+    if (rx_unacked >= WINDOW / 2) send_ack();
+    n = closed ? 0 : ble_read(buf, sizeof(buf), K_NO_WAIT);
+  } while (n > 0);
+
+  return true;
+}
+
+/* Queues a numbered frame, waiting for the central to acknowledge
+   earlier ones while the window is full */
+static void send_frame(u8_t type, const u8_t *payload, u16_t len) {
+  int retries = 0;
+
+  while (!failed && frame_seq_diff(tx_next, tx_base) >= WINDOW) {
+    if (!ble_uart_is_connected() || closed) {
+      failed = true;
+    } else if (!service_input(RETRANSMIT_MS)) {
+      if (++retries > MAX_RETRIES) {
+	failed = true;
+      } else {
+	retransmit();
+      }
+    }
+  }
+  if (failed) return;
+
+  u8_t slot = tx_next % WINDOW;
+  tx_sizes[slot] = frame_encode(tx_frames[slot], type, tx_next, payload, len);
+  ble_write_raw(tx_frames[slot], tx_sizes[slot]);
+  tx_next++;
+}
+
+/* Output hook while in framed mode */
+static void frame_output(const u8_t *data, int len) {
+  while (len > 0 && !failed) {
+    int n = MIN(len, TX_PAYLOAD - out_len);
+    memcpy(out_buf + out_len, data, n);
+    out_len += n;
+    data += n;
+    len -= n;
+    if (out_len == TX_PAYLOAD) {
+      send_frame(FRAME_DATA, out_buf, out_len);
+      out_len = 0;
+    }
+  }
+}
+
+static void frame_output_end(u8_t status) {
+  if (out_len > 0) {
+    send_frame(FRAME_DATA, out_buf, out_len);
+    out_len = 0;
+  }
+  send_frame(FRAME_EVAL, &status, 1);
+  ble_flush();
+}
+
+int frame_session(frame_eval_fn eval) {
+  int retries = 0;
+
+  script = malloc(CONFIG_BLE_FRAME_SCRIPT_SIZE);
+  if (!script) {
+    ble_printf("Error allocating framed mode buffer\n\r");
+    return -1;
+  }
+
+  frame_parser_init(&parser);
+  tx_base = tx_next = 0;
+  rx_expected = 0;
+  rx_unacked = 0;
+  nak_sent = false;
+  script_len = 0;
+  script_overflow = false;
+  out_len = 0;
+  closed = false;
+  failed = false;
+  evaluating = false;
+  eval_fn = eval;
+
+  /* an ACK of nothing tells the central that framed mode is on */
+  send_ack();
+  ble_flush();
+
+  ble_set_output_hook(frame_output);
+
+  while (!closed && !failed) {
+    if (!ble_uart_is_connected()) {
+      failed = true;
+    } else if (service_input(RETRANSMIT_MS)) {
+      retries = 0;
+    } else if (tx_base != tx_next) {
+      if (++retries > MAX_RETRIES) {
+	failed = true;
+      } else {
+	retransmit();
+      }
+    }
+  }
+
+  ble_set_output_hook(NULL);
+  ble_flush();
+  free(script);
+  script = NULL;
+
+  return closed ? 0 : -1;
+}
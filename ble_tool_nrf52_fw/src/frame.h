@@ -0,0 +1,40 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Framed mode of the BLE UART, entered from the REPL with :frame.
+
+   The central uploads a program in DATA frames and asks for it to be
+   evaluated with an EVAL frame. Everything the program prints, and the
+   printed result, comes back in DATA frames followed by an EVAL frame
+   with the status. A CLOSE frame returns to the text REPL. Frames are
+   described in frame_codec.h. */
+
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include <zephyr/types.h>
+
+/* Evaluate a NUL terminated program, output through ble_printf.
+   Returns 0 on success. */
+typedef int (*frame_eval_fn)(char *program, int len);
+
+/* Runs framed mode until the central closes it, goes silent or
+   disconnects. Returns 0 after a CLOSE frame, -1 otherwise. */
+extern int frame_session(frame_eval_fn eval);
+
+#endif
@@ -0,0 +1,92 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Frames of the binary BLE UART protocol. Also used by host side tools,
+   so only the C library is used here.
+
+   A frame is
+
+     0xA5 type seq len_lo len_hi payload[len] crc_lo crc_hi
+
+   with a CRC-16/CCITT (0xFFFF start) over type, seq, len and payload.
+   DATA, EVAL and CLOSE frames are numbered per direction and acknowledged
+   with cumulative ACK frames carrying the next expected sequence number.
+   A NAK carries the sequence number the receiver wants resent from.
+*/
+
+#ifndef FRAME_CODEC_H_
+#define FRAME_CODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAME_SYNC        0xA5
+#define FRAME_OVERHEAD    7
+#define FRAME_MAX_PAYLOAD 512
+
+typedef enum {
+  FRAME_DATA  = 0x01, /* bytes of a program or of output */
+  FRAME_ACK   = 0x02, /* payload: next expected sequence number */
+  FRAME_NAK   = 0x03, /* payload: sequence number to resend from */
+  FRAME_EVAL  = 0x04, /* to the device: evaluate what was sent, from the
+			 device: end of output, payload: 0 ok, 1 error */
+  FRAME_CLOSE = 0x05  /* back to the text REPL */
+} frame_type_t;
+
+typedef struct {
+  uint8_t  type;
+  uint8_t  seq;
+  uint16_t len;
+  uint8_t  payload[FRAME_MAX_PAYLOAD];
+} frame_t;
+
+typedef struct {
+  int      state;
+  uint16_t pos;
+  uint16_t crc;
+  frame_t  frame;
+} frame_parser_t;
+
+/* frame_parse results */
+#define FRAME_MORE     0
+#define FRAME_COMPLETE 1
+#define FRAME_BAD      -1
+
+extern uint16_t frame_crc16(uint16_t crc, const uint8_t *data, size_t len);
+
+extern void frame_parser_init(frame_parser_t *p);
+
+/* Feed one received byte. FRAME_COMPLETE leaves the frame in p->frame,
+   FRAME_BAD means a frame with a bad CRC or length was thrown away. */
+extern int frame_parse(frame_parser_t *p, uint8_t c);
+
+/* Encode a frame into out, which has room for len + FRAME_OVERHEAD
+   bytes. Returns the frame size. */
+extern size_t frame_encode(uint8_t *out, uint8_t type, uint8_t seq,
+			   const uint8_t *payload, uint16_t len);
+
+/* Sequence numbers wrap, compare them through the signed distance */
+static inline int frame_seq_diff(uint8_t a, uint8_t b) {
+  return (int8_t)(uint8_t)(a - b);
+}
+
+static inline int frame_is_numbered(uint8_t type) {
+  return type == FRAME_DATA || type == FRAME_EVAL || type == FRAME_CLOSE;
+}
+
+#endif
@@ -0,0 +1,125 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <string.h>
+#include <zephyr.h>
+#include <sys/byteorder.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include "heap.h"
+
+#include "gc_stats.h"
+
+#define STATS_STACK_SIZE 1024
+#define STATS_PRIORITY   K_PRIO_PREEMPT(10)
+
+static struct bt_uuid_128 gc_stats_service_uuid =
+  BT_UUID_INIT_128(0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0,
+		   0x93, 0xF3, 0xA3, 0xB5, 0x10, 0x00, 0x40, 0x6E);
+
+static struct bt_uuid_128 gc_stats_uuid =
+  BT_UUID_INIT_128(0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0,
+		   0x93, 0xF3, 0xA3, 0xB5, 0x11, 0x00, 0x40, 0x6E);
+
+static struct gc_stats_packet stats;
+static u32_t stats_heap_size;
+static u32_t stats_min_free = 0xFFFFFFFF;
+static bool notify_enabled;
+static bool started;
+
+K_MUTEX_DEFINE(gc_stats_mutex);
+K_SEM_DEFINE(gc_stats_start_sem, 0, 1);
+
+/* The counters are read while the REPL thread may be collecting, a
+   sample can be one collection behind */
+static void sample(void) {
+  heap_state_t state;
+  u32_t free = heap_num_free();
+
+  heap_get_state(&state);
+  if (free < stats_min_free) stats_min_free = free;
+
+  k_mutex_lock(&gc_stats_mutex, K_FOREVER);
+  stats.version = GC_STATS_VERSION;
+  stats.flags = 0;
+  stats.heap_size = sys_cpu_to_le16(stats_heap_size);
+  stats.free = sys_cpu_to_le16(free);
+  stats.min_free = sys_cpu_to_le16(stats_min_free);
+  stats.gc_num = sys_cpu_to_le32(state.gc_num);
+  stats.gc_recovered = sys_cpu_to_le32(state.gc_recovered);
+  stats.gc_marked = sys_cpu_to_le32(state.gc_marked);
+  k_mutex_unlock(&gc_stats_mutex);
+}
+
+static ssize_t gc_stats_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			     void *buf, u16_t len, u16_t offset) {
+  struct gc_stats_packet p;
+
+  if (started) sample();
+
+  k_mutex_lock(&gc_stats_mutex, K_FOREVER);
+  p = stats;
+  k_mutex_unlock(&gc_stats_mutex);
+
+  return bt_gatt_attr_read(conn, attr, buf, len, offset, &p, sizeof(p));
+}
+
+static void gc_stats_ccc_changed(const struct bt_gatt_attr *attr, u16_t value) {
+  (void) attr;
+  notify_enabled = (value == BT_GATT_CCC_NOTIFY);
+}
+
+BT_GATT_SERVICE_DEFINE(gc_stats_svc,
+		       BT_GATT_PRIMARY_SERVICE(&gc_stats_service_uuid),
+		       BT_GATT_CHARACTERISTIC(&gc_stats_uuid.uuid,
+					      BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+					      BT_GATT_PERM_READ,
+					      gc_stats_read, NULL, NULL),
+		       BT_GATT_CCC(gc_stats_ccc_changed,
+				   BT_GATT_PERM_READ | BT_GATT_PERM_WRITE));
+
+static void gc_stats_thread(void *p1, void *p2, void *p3) {
+  struct gc_stats_packet p;
+
+  k_sem_take(&gc_stats_start_sem, K_FOREVER);
+
+  while (true) {
+    sample();
+
+    if (notify_enabled) {
+      k_mutex_lock(&gc_stats_mutex, K_FOREVER);
+      p = stats;
+      k_mutex_unlock(&gc_stats_mutex);
+      bt_gatt_notify(NULL, &gc_stats_svc.attrs[2], &p, sizeof(p));
+    }
+    k_sleep(CONFIG_LISP_GC_STATS_PERIOD_MS);
+  }
+}
+
+K_THREAD_DEFINE(gc_stats_tid, STATS_STACK_SIZE, gc_stats_thread, NULL, NULL, NULL,
+		STATS_PRIORITY, 0, K_NO_WAIT);
+
+void gc_stats_start(u32_t heap_size) {
+  stats_heap_size = heap_size;
+  started = true;
+  k_sem_give(&gc_stats_start_sem);
+}
@@ -0,0 +1,46 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Heap and garbage collector statistics as a GATT service. The
+   characteristic can be read at any time and is notified every
+   CONFIG_LISP_GC_STATS_PERIOD_MS to subscribed centrals. All fields
+   are little endian, the packet fits a notification at the default
+   ATT MTU. */
+
+#ifndef GC_STATS_H_
+#define GC_STATS_H_
+
+#include <zephyr/types.h>
+
+#define GC_STATS_VERSION 1
+
+struct gc_stats_packet {
+  u8_t  version;
+  u8_t  flags;        /* reserved */
+  u16_t heap_size;    /* cons cells */
+  u16_t free;         /* free cons cells */
+  u16_t min_free;     /* fewest free cons cells seen */
+  u32_t gc_num;
+  u32_t gc_recovered;
+  u32_t gc_marked;
+} __attribute__((packed));
+
+/* Start sampling once the heap is initialized */
+extern void gc_stats_start(u32_t heap_size);
+
+#endif
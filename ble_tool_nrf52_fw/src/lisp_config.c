@@ -0,0 +1,146 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr.h>
+#include <settings/settings.h>
+
+#include "lisp_config.h"
+
+#define HEAP_SIZE_MIN 256
+#define HEAP_SIZE_MAX 65535
+
+/* lispBM allocates its cons cells, 8 bytes each on 32 bit, with malloc.
+   The arena also holds the symbol table, the REPL buffers and the saved
+   definitions, ARENA_RESERVE is kept free for those. */
+#define HEAP_CELL_BYTES 8
+#define ARENA_RESERVE (16 * 1024)
+
+static bool heap_size_ok(u32_t cells) {
+  if (cells < HEAP_SIZE_MIN || cells > HEAP_SIZE_MAX) return false;
+#if defined(CONFIG_MINIMAL_LIBC_MALLOC_ARENA_SIZE)
+  if (cells * HEAP_CELL_BYTES >
+      CONFIG_MINIMAL_LIBC_MALLOC_ARENA_SIZE - ARENA_RESERVE) return false;
+#endif
+  return true;
+}
+
+static u32_t heap_size = CONFIG_LISP_HEAP_SIZE;
+
+/* a copy of the saved definitions, they are restored again after an
+   aborted evaluation */
+static u8_t *defs;
+static int defs_len;
+
+static void defs_free(void) {
+  free(defs);
+  defs = NULL;
+  defs_len = 0;
+}
+
+static int lisp_config_set(const char *key, size_t len,
+			   settings_read_cb read_cb, void *cb_arg) {
+  if (strcmp(key, "heap") == 0) {
+    u32_t cells;
+
+    if (len != sizeof(cells)) return -EINVAL;
+    if (read_cb(cb_arg, &cells, sizeof(cells)) != sizeof(cells)) return -EIO;
+    if (heap_size_ok(cells)) {
+      heap_size = cells;
+    }
+    return 0;
+  }
+  if (strcmp(key, "defs") == 0) {
+    defs_free();
+    /* deleted */
+    if (len == 0) return 0;
+    if (len > CONFIG_LISP_SAVE_SIZE) return -EINVAL;
+
+    defs = malloc(len);
+    if (!defs) return -ENOMEM;
+    if (read_cb(cb_arg, defs, len) != len) {
+      defs_free();
+      return -EIO;
+    }
+    defs_len = len;
+    return 0;
+  }
+  return -ENOENT;
+}
+
+static struct settings_handler lisp_config_handler = {
+  .name = "lisp",
+  .h_set = lisp_config_set,
+};
+
+int lisp_config_init(void) {
+  if (!IS_ENABLED(CONFIG_SETTINGS)) return 0;
+  return settings_register(&lisp_config_handler);
+}
+
+u32_t lisp_config_heap_size(void) {
+  return heap_size;
+}
+
+int lisp_config_set_heap_size(u32_t cells) {
+  if (!heap_size_ok(cells)) return -EINVAL;
+  if (!IS_ENABLED(CONFIG_SETTINGS)) return -ENOTSUP;
+  return settings_save_one("lisp/heap", &cells, sizeof(cells));
+}
+
+int lisp_config_reset_heap_size(void) {
+  heap_size = CONFIG_LISP_HEAP_SIZE;
+  if (!IS_ENABLED(CONFIG_SETTINGS)) return 0;
+  return settings_delete("lisp/heap");
+}
+
+const u8_t *lisp_config_defs(int *len) {
+  *len = defs_len;
+  return defs;
+}
+
+int lisp_config_save_defs(const u8_t *image, int len) {
+  int err;
+
+  if (len <= 0 || len > CONFIG_LISP_SAVE_SIZE) return -EINVAL;
+  if (!IS_ENABLED(CONFIG_SETTINGS)) return -ENOTSUP;
+
+  u8_t *copy = malloc(len);
+  if (!copy) return -ENOMEM;
+
+  err = settings_save_one("lisp/defs", image, len);
+  if (err) {
+    free(copy);
+    return err;
+  }
+
+  memcpy(copy, image, len);
+  defs_free();
+  defs = copy;
+  defs_len = len;
+  return 0;
+}
+
+int lisp_config_delete_defs(void) {
+  defs_free();
+  if (!IS_ENABLED(CONFIG_SETTINGS)) return -ENOTSUP;
+  return settings_delete("lisp/defs");
+}
@@ -0,0 +1,49 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Persisted lispBM configuration, stored with the settings subsystem
+   under "lisp/". Values are read by settings_load, so the handler is
+   registered before it runs. */
+
+#ifndef LISP_CONFIG_H_
+#define LISP_CONFIG_H_
+
+#include <zephyr/types.h>
+
+extern int lisp_config_init(void);
+
+/* Cons cells to allocate, the saved value or CONFIG_LISP_HEAP_SIZE */
+extern u32_t lisp_config_heap_size(void);
+
+/* Save a heap size, used from the next reset. Returns 0 on success,
+   -EINVAL when outside what the heap can be configured to or larger
+   than the malloc arena can hold. */
+extern int lisp_config_set_heap_size(u32_t cells);
+/* Forget the saved heap size, back to CONFIG_LISP_HEAP_SIZE */
+extern int lisp_config_reset_heap_size(void);
+
+/* Definitions saved with :save as a lisp image (lisp_image.h), NULL
+   when there are none */
+extern const u8_t *lisp_config_defs(int *len);
+
+/* Store an image of definitions to restore after reset. Returns -EINVAL
+   when it is larger than CONFIG_LISP_SAVE_SIZE. */
+extern int lisp_config_save_defs(const u8_t *image, int len);
+extern int lisp_config_delete_defs(void);
+
+#endif
@@ -0,0 +1,325 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <string.h>
+
+#include "heap.h"
+#include "symrepr.h"
+
+#include "lisp_image.h"
+
+#define IMAGE_HEADER 8
+
+/* Conses nest this deep through their car at most, cdr chains are
+   followed in a loop and may be of any length */
+#define IMAGE_MAX_DEPTH 64
+
+typedef enum {
+  IMAGE_SYM  = 0x00,
+  IMAGE_I28  = 0x01,
+  IMAGE_U28  = 0x02,
+  IMAGE_CHAR = 0x03,
+  IMAGE_CONS = 0x04
+} image_tag_t;
+
+typedef struct {
+  uint8_t *buf;
+  int size;
+  int pos;
+  int err;
+  UINT syms[LISP_IMAGE_MAX_SYMBOLS];
+  int num_syms;
+} image_writer_t;
+
+typedef struct {
+  const uint8_t *buf;
+  int end;
+  int pos;
+  int err;
+  UINT syms[LISP_IMAGE_MAX_SYMBOLS];
+  int num_syms;
+} image_reader_t;
+
+/* ------------------------------------------------------------
+   Writing
+   ------------------------------------------------------------ */
+
+static void put_byte(image_writer_t *w, uint8_t b) {
+  if (w->pos < w->size) {
+    w->buf[w->pos++] = b;
+  } else {
+    w->err = -1;
+  }
+}
+
+static void put_varint(image_writer_t *w, uint32_t v) {
+  while (v >= 0x80) {
+    put_byte(w, (v & 0x7F) | 0x80);
+    v >>= 7;
+  }
+  put_byte(w, v);
+}
+
+static void put_symbol(image_writer_t *w, UINT id) {
+  int i;
+
+  for (i = 0; i < w->num_syms && w->syms[i] != id; i++);
+  if (i == w->num_syms) {
+    if (i == LISP_IMAGE_MAX_SYMBOLS) {
+      w->err = -1;
+      return;
+    }
+    w->syms[w->num_syms++] = id;
+  }
+  put_varint(w, i);
+}
+
+static void put_value(image_writer_t *w, VALUE v, int depth) {
+  if (depth > IMAGE_MAX_DEPTH) {
+    w->err = -2;
+    return;
+  }
+
+  while (!w->err) {
+    switch (type_of(v)) {
+    case VAL_TYPE_SYMBOL:
+      put_byte(w, IMAGE_SYM);
+      put_symbol(w, dec_sym(v));
+      return;
+    case VAL_TYPE_I28: {
+      int32_t i = dec_i(v);
+      put_byte(w, IMAGE_I28);
+      put_varint(w, ((uint32_t)i << 1) ^ (uint32_t)(i >> 31));
+      return;
+    }
+    case VAL_TYPE_U28:
+      put_byte(w, IMAGE_U28);
+      put_varint(w, dec_u(v));
+      return;
+    case VAL_TYPE_CHAR:
+      put_byte(w, IMAGE_CHAR);
+      put_byte(w, dec_char(v));
+      return;
+    case PTR_TYPE_CONS:
+      put_byte(w, IMAGE_CONS);
+      put_value(w, car(v), depth + 1);
+      v = cdr(v);
+      break;
+    default:
+      w->err = -2;
+      return;
+    }
+  }
+}
+
+int lisp_image_write(VALUE env, VALUE end, uint8_t *buf, int size) {
+  image_writer_t w;
+  int bindings = 0;
+
+  if (size < IMAGE_HEADER) return -1;
+
+  memset(&w, 0, sizeof(w));
+  w.buf = buf;
+  w.size = size;
+  w.pos = IMAGE_HEADER;
+
+  for (VALUE e = env; e != end && type_of(e) == PTR_TYPE_CONS && !w.err; e = cdr(e)) {
+    VALUE binding = car(e);
+    if (type_of(binding) != PTR_TYPE_CONS ||
+	type_of(car(binding)) != VAL_TYPE_SYMBOL) {
+      return -2;
+    }
+    put_symbol(&w, dec_sym(car(binding)));
+    put_value(&w, cdr(binding), 0);
+    bindings++;
+  }
+
+  int symtab = w.pos;
+  for (int i = 0; i < w.num_syms && !w.err; i++) {
+    const char *name = symrepr_lookup_name(w.syms[i]);
+    if (!name) return -2;
+    do {
+      put_byte(&w, *name);
+    } while (*name++);
+  }
+
+  if (w.err) return w.err;
+  if (symtab > 0xFFFF) return -1;
+
+  buf[0] = 'L';
+  buf[1] = 'B';
+  buf[2] = 'I';
+  buf[3] = LISP_IMAGE_VERSION;
+  buf[4] = bindings & 0xFF;
+  buf[5] = bindings >> 8;
+  buf[6] = symtab & 0xFF;
+  buf[7] = symtab >> 8;
+  return w.pos;
+}
+
+/* ------------------------------------------------------------
+   Reading
+   ------------------------------------------------------------ */
+
+static uint8_t get_byte(image_reader_t *r) {
+  if (r->pos < r->end) return r->buf[r->pos++];
+  r->err = -1;
+  return 0;
+}
+
+static uint32_t get_varint(image_reader_t *r) {
+  uint32_t v = 0;
+
+  for (int shift = 0; shift < 32; shift += 7) {
+    uint8_t b = get_byte(r);
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return v;
+  }
+  r->err = -1;
+  return 0;
+}
+
+static VALUE get_symbol(image_reader_t *r) {
+  uint32_t i = get_varint(r);
+
+  if (i >= (uint32_t)r->num_syms) {
+    r->err = -1;
+    return enc_sym(symrepr_nil());
+  }
+  return enc_sym(r->syms[i]);
+}
+
+/* cons does not collect garbage, it gives the memory error symbol when
+   the heap is full. Nothing built here is reachable for the collector
+   until it is evaluated. */
+static VALUE checked_cons(image_reader_t *r, VALUE a, VALUE b) {
+  VALUE c = cons(a, b);
+
+  if (type_of(c) == VAL_TYPE_SYMBOL && dec_sym(c) == symrepr_merror()) {
+    r->err = -2;
+  }
+  return c;
+}
+
+static VALUE get_value(image_reader_t *r, int depth) {
+  VALUE nil = enc_sym(symrepr_nil());
+  VALUE first = nil;
+  VALUE last = nil;
+  VALUE v;
+
+  if (depth > IMAGE_MAX_DEPTH) {
+    r->err = -1;
+    return nil;
+  }
+
+  while (!r->err) {
+    switch (get_byte(r)) {
+    case IMAGE_SYM:
+      v = get_symbol(r);
+      break;
+    case IMAGE_I28: {
+      uint32_t z = get_varint(r);
+      v = enc_i((INT)(z >> 1) ^ -(INT)(z & 1));
+      break;
+    }
+    case IMAGE_U28:
+      v = enc_u(get_varint(r));
+      break;
+    case IMAGE_CHAR:
+      v = enc_char(get_byte(r));
+      break;
+    case IMAGE_CONS: {
+      VALUE cell = checked_cons(r, get_value(r, depth + 1), nil);
+      if (r->err) return nil;
+      if (last == nil) {
+	first = cell;
+      } else {
+	set_cdr(last, cell);
+      }
+      last = cell;
+      continue;
+    }
+    default:
+      r->err = -1;
+      return nil;
+    }
+
+    if (last == nil) return v;
+    set_cdr(last, v);
+    return first;
+  }
+  return nil;
+}
+
+int lisp_image_read(const uint8_t *image, int size, VALUE *program) {
+  image_reader_t r;
+  UINT define;
+  UINT quote;
+
+  if (size < IMAGE_HEADER ||
+      image[0] != 'L' || image[1] != 'B' || image[2] != 'I' ||
+      image[3] != LISP_IMAGE_VERSION) {
+    return -1;
+  }
+  int bindings = image[4] | (image[5] << 8);
+  int symtab = image[6] | (image[7] << 8);
+  if (symtab < IMAGE_HEADER || symtab > size) return -1;
+
+  memset(&r, 0, sizeof(r));
+  r.buf = image;
+  r.pos = IMAGE_HEADER;
+  r.end = symtab;
+
+  for (int pos = symtab; pos < size; ) {
+    const char *name = (const char *)image + pos;
+    int len = strnlen(name, size - pos);
+    UINT id;
+
+    if (pos + len == size || r.num_syms == LISP_IMAGE_MAX_SYMBOLS) return -1;
+    if (!symrepr_lookup((char *)name, &id) &&
+	!symrepr_addsym((char *)name, &id)) {
+      return -2;
+    }
+    r.syms[r.num_syms++] = id;
+    pos += len + 1;
+  }
+
+  if (!symrepr_lookup("define", &define) ||
+      !symrepr_lookup("quote", &quote)) {
+    return -1;
+  }
+
+  /* consed in reverse, the last binding of the environment is defined
+     first like it was originally */
+  VALUE nil = enc_sym(symrepr_nil());
+  VALUE prg = nil;
+  for (int i = 0; i < bindings && !r.err; i++) {
+    VALUE name = get_symbol(&r);
+    VALUE value = get_value(&r, 0);
+    VALUE quoted = checked_cons(&r, value, nil);
+    quoted = checked_cons(&r, enc_sym(quote), quoted);
+    VALUE form = checked_cons(&r, quoted, nil);
+    form = checked_cons(&r, name, form);
+    form = checked_cons(&r, enc_sym(define), form);
+    prg = checked_cons(&r, form, prg);
+  }
+  if (r.err) return r.err;
+
+  *program = prg;
+  return 0;
+}
@@ -0,0 +1,63 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/* Images of lisp environment bindings. Also used by the host side
+   prelude_image tool, so only the C library and lispBM are used here.
+
+   An image does not depend on the heap layout or on symbol numbers,
+   symbols are stored by name and values as trees:
+
+     'L' 'B' 'I' version  u16 bindings  u16 symtab_offset
+     bindings: symbol value, ...
+     symtab:   name\0 name\0 ...
+
+   where a symbol is a varint index into symtab and a value is a tag
+   followed by
+
+     IMAGE_SYM   symbol
+     IMAGE_I28   zigzag varint
+     IMAGE_U28   varint
+     IMAGE_CHAR  byte
+     IMAGE_CONS  car value, cdr value
+
+   Reading gives a program of (define name (quote value)) forms, so
+   restoring bindings is an ordinary evaluation without any parsing.
+   Only symbols, numbers, characters and conses are stored, which is
+   what definitions and closures are made of.
+*/
+
+#ifndef LISP_IMAGE_H_
+#define LISP_IMAGE_H_
+
+#include <stdint.h>
+
+#include "heap.h"
+
+#define LISP_IMAGE_VERSION     1
+#define LISP_IMAGE_MAX_SYMBOLS 256
+
+/* Writes the bindings of env, an association list, up to the tail end
+   to buf. Returns the image size, -1 when it does not fit in size bytes
+   or there are too many symbols and -2 when a value can not be stored. */
+extern int lisp_image_write(VALUE env, VALUE end, uint8_t *buf, int size);
+
+/* Builds the program that restores the bindings of image. Returns 0,
+   -1 for a broken image and -2 when the heap ran out. */
+extern int lisp_image_read(const uint8_t *image, int size, VALUE *program);
+
+#endif
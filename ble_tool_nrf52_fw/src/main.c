@@ -15,6 +15,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -41,20 +42,27 @@
 #include "tokpar.h"
 #include "prelude.h"
 
+#include "ble_uart.h"
+#include "frame.h"
+#include "gc_stats.h"
+#include "lisp_config.h"
+#include "eval_worker.h"
+#include "lisp_image.h"
+#include "prelude_image.h"
+
 #define RING_BUF_SIZE 1024
 u8_t in_ring_buffer[RING_BUF_SIZE];
 u8_t out_ring_buffer[RING_BUF_SIZE];
 
-u8_t ble_in_ring_buffer[RING_BUF_SIZE];
-
 K_MUTEX_DEFINE(uart_io_mutex);
-K_MUTEX_DEFINE(ble_uart_mutex);
 
 struct device *dev;
 
 struct ring_buf in_ringbuf;
 struct ring_buf out_ringbuf;
-struct ring_buf ble_in_ringbuf; 
+
+/* given when bt_ready has run, settings are loaded by then */
+K_SEM_DEFINE(bt_ready_sem, 0, 1);
 
 static void interrupt_handler(struct device *dev)
 {
@@ -192,163 +200,20 @@ static const struct bt_data ad[] = {
 		0x93, 0xF3, 0xA3, 0xB5, 0x01, 0x00, 0x40, 0x6E)
 };
 
-static struct bt_uuid_128 bt_uart_base_uuid =
-  BT_UUID_INIT_128(0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0,
-		   0x93, 0xF3, 0xA3, 0xB5, 0x01, 0x00, 0x40, 0x6E);
-
-
-static struct bt_uuid_128 bt_uart_tx_uuid =
-  BT_UUID_INIT_128(0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0,
-		   0x93, 0xF3, 0xA3, 0xB5, 0x02, 0x00, 0x40, 0x6E);
-
-static struct bt_uuid_128 bt_uart_rx_uuid =
-  BT_UUID_INIT_128(0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0,
-		   0x93, 0xF3, 0xA3, 0xB5, 0x03, 0x00, 0x40, 0x6E);
-
-static u8_t bt_uart_read_buf[20] = "apa";
-
-static ssize_t bt_uart_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
-			     const void *buf, u16_t len, u16_t offset,
-			     u8_t flags) {
-  //u8_t *value = attr->user_data;
-
-  //if (len > sizeof(bt_uart_write_buf)) {
-    //return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
-  //  return 0;
-  //}
-
-  //memcpy(value + offset, buf, len);
-
-  int n = ring_buf_put(&ble_in_ringbuf,buf, len);
-  //usb_printf("%s\n\r", buf);
-  
-  //usb_printf("%d \n\r", n);
-  //bt_gatt_notify(NULL, attr, buf, len);
-
-  return n;
-}
-
-static ssize_t bt_uart_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
-			    void *buf, u16_t len, u16_t offset)
-{
-	const char *value = attr->user_data;
-
-	return bt_gatt_attr_read(conn, attr, buf, len, offset, value,
-				 strlen(value));
-}
-
-static void bt_uart_ccc_changed(const struct bt_gatt_attr *attr,
-				       u16_t value)
-{
-  (void) attr;
-
-  // bool notif_enabled = (value == BT_GATT_CCC_NOTIFY);
-}
-
-
-BT_GATT_SERVICE_DEFINE(bt_uart,
-		       BT_GATT_PRIMARY_SERVICE(&bt_uart_base_uuid),
-		       BT_GATT_CHARACTERISTIC(&bt_uart_tx_uuid.uuid, // TX from the point of view of the central
-					      BT_GATT_CHRC_WRITE,    // central is allowed to write to tx
-					      BT_GATT_PERM_WRITE,
-					      NULL, bt_uart_write, NULL),
-		       BT_GATT_CHARACTERISTIC(&bt_uart_rx_uuid.uuid, // RX from point of view of central
-					      BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
-					      BT_GATT_PERM_READ,
-					      bt_uart_read, NULL, bt_uart_read_buf),
-		       BT_GATT_CCC(bt_uart_ccc_changed,
-				   BT_GATT_PERM_READ | BT_GATT_PERM_WRITE));
-
-
-int ble_get_char(void) {
-
-  //k_mutex_lock(&ble_uart_mutex, K_FOREVER);
-  int n;
-  u8_t c;
-  
-  n = ring_buf_get(&ble_in_ringbuf, &c, 1);
-  
-  //k_mutex_unlock(&ble_uart_mutex);
-  if (n == 1) {
-    return c;
-  }
-  return -1;
- 
-}
-
-void ble_put_char(int i) {
-
-  u8_t c = (u8_t) i;
-
-  bt_gatt_notify(NULL, &bt_uart.attrs[2], &c, 1);
-}
-
-void ble_printf(char *format, ...) {
-
-  va_list arg;
-  va_start(arg, format);
-  int len;
-  static char print_buffer[4096];
-
-  len = vsnprintf(print_buffer, 4096,format, arg);
-  va_end(arg);
-
-  int offset = 0;
-  int bytes_left = len;
-  while (bytes_left > 0) {
-    int chunk_size = (bytes_left > 20 ? 20 : bytes_left);
-    bt_gatt_notify(NULL,&bt_uart.attrs[2], print_buffer+offset, chunk_size);
-    bytes_left -= chunk_size;
-    offset += chunk_size;
-  }
-}
-
-int ble_inputline(char *buffer, int size) {
-  int n = 0;
-  int c;
-  for (n = 0; n < size - 1; n++) {
-
-    c = ble_get_char();
-    switch (c) {
-    case 127: /* fall through to below */
-    case '\b': /* backspace character received */
-      if (n > 0)
-        n--;
-      buffer[n] = 0;
-      ble_put_char('\b'); /* output backspace character */
-      n--; /* set up next iteration to deal with preceding char location */
-      break;
-    case '\n': /* fall through to \r */
-    case '\r':
-      buffer[n] = 0;
-      return n;
-    default:
-      if (c != -1 && c < 256) {
-	ble_put_char(c);
-	buffer[n] = c;
-      } else {
-	n --;
-      }
-
-      break;
-    }
-  }
-  buffer[size - 1] = 0;
-  return 0; // Filled up buffer without reading a linebreak
-}
-
 static void connected(struct bt_conn *conn, u8_t err)
 {
 	if (err) {
 		usb_printf("Connection failed (err 0x%02x)\n\r", err);
 	} else {
 		usb_printf("Connected\n\r");
+		ble_uart_connected(conn);
 	}
 }
 
 static void disconnected(struct bt_conn *conn, u8_t reason)
 {
 	usb_printf("Disconnected (reason 0x%02x)\n\r", reason);
+	ble_uart_disconnected(conn);
 }
 
 static struct bt_conn_cb conn_callbacks = {
@@ -361,6 +226,7 @@ static void bt_ready(int err)
 {
 	if (err) {
            usb_printf("Bluetooth init failed (err %d)\n", err);
+	   k_sem_give(&bt_ready_sem);
 	   return;
 	}
 
@@ -369,6 +235,7 @@ static void bt_ready(int err)
 	if (IS_ENABLED(CONFIG_SETTINGS)) {
 		settings_load();
 	}
+	k_sem_give(&bt_ready_sem);
 
 	err = bt_le_adv_start(BT_LE_ADV_CONN_NAME, ad, ARRAY_SIZE(ad), NULL, 0);
 	if (err) {
@@ -392,13 +259,26 @@ static void bas_notify(void)
 	bt_gatt_bas_set_battery_level(battery_level);
 }
 
+/* Extensions run on the eval worker, which may be aborted at any point.
+   The Bluetooth stack is entered from the system work queue instead,
+   so that an abort can not leave its locks taken. */
+static atomic_t bas_level;
+
+static void bas_level_work_fn(struct k_work *work) {
+  (void) work;
+  bt_gatt_bas_set_battery_level((u8_t)atomic_get(&bas_level));
+}
+
+K_WORK_DEFINE(bas_level_work, bas_level_work_fn);
+
 static VALUE bas_set_level(VALUE *args, int argn) {
   if (argn != 1) {
     return enc_sym(symrepr_nil());
   }
   int bat_lvl = dec_i(args[0]);
 
-  bt_gatt_bas_set_battery_level((u8_t)bat_lvl);
+  atomic_set(&bas_level, (u8_t)bat_lvl);
+  k_work_submit(&bas_level_work);
   return enc_sym(symrepr_true());
 }
 
@@ -412,6 +292,117 @@ static VALUE hello_world(VALUE *args, int argn) {
   return enc_sym(symrepr_true());
 }
 
+static u32_t heap_size;
+/* The environment after the prelude, :save stores what is defined in
+   front of it */
+static VALUE prelude_env;
+
+/* Jobs for the eval worker. The program is parsed on the REPL thread
+   into parsed, eval_result is only used on the worker thread. */
+static VALUE parsed;
+static char eval_result[1024];
+
+static void eval_parse(char *program) {
+  parsed = tokpar_parse(program);
+}
+
+static int repl_eval(char *program) {
+  VALUE t;
+
+  (void) program;
+  t = eval_cps_program(parsed);
+
+  if (dec_sym(t) == symrepr_eerror()) {
+    ble_printf("Error\n");
+    return 1;
+  }
+  simple_snprint(eval_result, sizeof(eval_result) - 1, t);
+  ble_printf("> %s \n\r", eval_result);
+  return 0;
+}
+
+static int frame_job(char *program) {
+  VALUE t;
+
+  (void) program;
+  t = eval_cps_program(parsed);
+
+  if (dec_sym(t) == symrepr_eerror()) {
+    ble_printf("Error\n");
+    return 1;
+  }
+  simple_snprint(eval_result, sizeof(eval_result) - 1, t);
+  ble_printf("%s", eval_result);
+  return 0;
+}
+
+/* The prelude definitions come from the build time image when there is
+   one, the source is only parsed when the image can not be used.
+   Returns true if the image was used. */
+static bool prelude_eval(void) {
+#if defined(CONFIG_LISP_PRELUDE_IMAGE)
+  VALUE program;
+
+  if (lisp_image_read(prelude_image, prelude_image_size, &program) == 0) {
+    eval_cps_program(program);
+    return true;
+  }
+#endif
+  eval_cps_program(prelude_load());
+  return false;
+}
+
+/* Definitions saved with :save, evaluated after the prelude. Returns 0
+   also when there are none. */
+static int defs_load(void) {
+  const u8_t *image;
+  VALUE program;
+  int len;
+  int r;
+
+  image = lisp_config_defs(&len);
+  if (!image) return 0;
+
+  r = lisp_image_read(image, len, &program);
+  if (r == 0) eval_cps_program(program);
+  return r;
+}
+
+/* After an abort the heap may be half way through a collection, the
+   interpreter starts over with the prelude and the saved definitions.
+   Symbols and extensions live outside the heap and are kept. */
+static void lisp_reset(void) {
+  heap_del();
+  if (!heap_init(heap_size) || !eval_cps_init(false)) {
+    ble_printf("Error restarting the evaluator!\n\r");
+    return;
+  }
+  prelude_eval();
+  prelude_env = eval_cps_get_env();
+  if (defs_load()) {
+    ble_printf("Error restoring saved definitions\n\r");
+  }
+}
+
+/* Framed mode waits for its program here, it has no interrupt of its
+   own but the time budget applies */
+static int frame_eval(char *program, int len) {
+  (void) len;
+
+  if (eval_worker_submit(eval_parse, frame_job, program)) {
+    ble_printf("Evaluator busy\n");
+    return 1;
+  }
+  while (eval_worker_wait(eval_worker_time_left()) != 0) {
+    if (eval_worker_time_left() == 0) {
+      eval_worker_abort();
+      ble_printf("Evaluation timed out, evaluator restarted\n");
+      return 1;
+    }
+  }
+  return eval_worker_status();
+}
+
 void main(void)
 {
 
@@ -426,7 +417,7 @@ void main(void)
 
   ring_buf_init(&in_ringbuf, sizeof(in_ring_buffer), in_ring_buffer);
   ring_buf_init(&out_ringbuf, sizeof(out_ring_buffer), out_ring_buffer);
-  ring_buf_init(&ble_in_ringbuf, sizeof(ble_in_ring_buffer), ble_in_ring_buffer);
+  ble_uart_init();
   /*
   while (true) {
     uart_line_ctrl_get(dev, LINE_CTRL_DTR, &dtr);
@@ -456,16 +447,21 @@ void main(void)
   } else {
     //LOG_INF("Baudrate detected: %d", baudrate);
   }
+  */
 
   uart_irq_callback_set(dev, interrupt_handler);
   
   uart_irq_rx_enable(dev);
-  */
+
+  lisp_config_init();
 
   err = bt_enable(bt_ready);
 
   if (err) {
     ble_printf("Error enabling BLE\n");
+  } else {
+    /* the heap size may come from the settings */
+    k_sem_take(&bt_ready_sem, K_SECONDS(5));
   }
 
   bt_set_name("BLE_TOOL_NRF52_FW");
@@ -473,12 +469,17 @@ void main(void)
   //bt_conn_auth_cb_register(&auth_cb_display);
 
   ble_printf("Allocating input/output buffers\n\r");
-  size_t len = 1024;
-  char *str = malloc(1024);
+  /* one line for each queued program and the one being typed */
+  static char lines[CONFIG_LISP_EVAL_QUEUE_DEPTH + 1][1024];
+  int line_ix = 0;
+  ble_line_t line;
+  bool prompt = true;
+  char *str;
   char *outbuf = malloc(4096);
   int res = 0;
 
   heap_state_t heap_state;
+  struct ble_uart_stats uart_stats;
 
   res = symrepr_init();
   if (res)
@@ -487,14 +488,24 @@ void main(void)
     ble_printf("Error initializing symrepr!\n\r");
     return;
   }
-  int heap_size = 2048;
+  heap_size = lisp_config_heap_size();
   res = heap_init(heap_size);
+  if (!res && heap_size != CONFIG_LISP_HEAP_SIZE) {
+    /* a saved size that does not fit would otherwise stop the REPL
+       at every boot, with no way to change it back */
+    ble_printf("Error initializing heap of %u cons cells, using %u\n\r",
+	       heap_size, CONFIG_LISP_HEAP_SIZE);
+    lisp_config_reset_heap_size();
+    heap_size = CONFIG_LISP_HEAP_SIZE;
+    res = heap_init(heap_size);
+  }
   if (res)
     ble_printf("Heap initialized. Free cons cells: %u\n\r", heap_num_free());
   else {
     ble_printf("Error initializing heap!\n\r");
     return;
   }
+  gc_stats_start(heap_size);
 
   res = eval_cps_init(false);
   if (res)
@@ -515,46 +526,152 @@ void main(void)
     ble_printf("hello-world extension failed!\n\r");
   }
 	
-  VALUE prelude = prelude_load();
-  eval_cps_program(prelude);
+  s64_t prelude_start = k_uptime_get();
+  bool from_image = prelude_eval();
+  ble_printf("Prelude loaded from %s in %u ms.\n\r",
+	     from_image ? "image" : "source",
+	     (u32_t)(k_uptime_get() - prelude_start));
+  prelude_env = eval_cps_get_env();
+
+  res = defs_load();
+  if (res) {
+    ble_printf("Error restoring saved definitions (%d)\n\r", res);
+  }
+
+  eval_worker_init(lisp_reset, ble_read_wake);
+  ble_line_init(&line, lines[line_ix], sizeof(lines[line_ix]));
 
   ble_printf("Lisp REPL started (BLE_TOOL_NRF52_FW)!\n\r");
 	
+  /* Evaluation happens on the eval worker, this thread parses each
+     program as the worker gets it and keeps reading input to catch
+     ctrl-c and to enforce the time budget */
   while (1) {
-    k_sleep(100);
-    ble_printf("# ");
-    memset(str,0,len);
-    memset(outbuf,0, 1024);
-    ble_inputline(str, len);
+    eval_worker_dispatch();
+    bool busy = eval_worker_busy();
+
+    if (prompt && !busy) {
+      ble_printf("# ");
+      prompt = false;
+    }
+
+    if (eval_worker_full()) {
+      /* typed ahead lines wait in the receive buffer, and the central
+	 behind it, until the worker is done with a job */
+      res = ble_line_hold(&line, eval_worker_time_left());
+    } else {
+      res = ble_line_poll(&line, busy ? eval_worker_time_left() : K_FOREVER);
+    }
+
+    if (res == BLE_LINE_MORE) {
+      /* woken by the worker or out of time */
+      if (busy && eval_worker_time_left() == 0) {
+	eval_worker_abort();
+	ble_printf("\n\rEvaluation timed out after %u ms, evaluator restarted\n\r",
+		   eval_worker_budget());
+      }
+      continue;
+    }
+
+    prompt = true;
+    if (res == BLE_LINE_INTERRUPT) {
+      if (eval_worker_busy()) {
+	eval_worker_abort();
+	ble_printf("^C\n\rEvaluation aborted, evaluator restarted\n\r");
+      } else {
+	ble_printf("^C\n\r");
+      }
+      continue;
+    }
+
+    str = line.buffer;
     ble_printf("\n\r");
+    busy = eval_worker_busy();
 
     if (strncmp(str, ":info", 5) == 0) {
       ble_printf("##(BLE_TOOL_NRF52_FW)#######################################\n\r");
+      ble_printf("Heap size: %u cons cells\n\r", heap_size);
       ble_printf("Used cons cells: %lu \n\r", heap_size - heap_num_free());
-      ble_printf("ENV: "); simple_snprint(outbuf,4095, eval_cps_get_env()); ble_printf("%s \n\r", outbuf);
+      if (busy) {
+	ble_printf("ENV: (evaluating)\n\r");
+      } else {
+	ble_printf("ENV: "); simple_snprint(outbuf,4095, eval_cps_get_env()); ble_printf("%s \n\r", outbuf);
+      }
       heap_get_state(&heap_state);
       ble_printf("GC counter: %lu\n\r", heap_state.gc_num);
       ble_printf("Recovered: %lu\n\r", heap_state.gc_recovered);
       ble_printf("Marked: %lu\n\r", heap_state.gc_marked);
       ble_printf("Free cons cells: %lu\n\r", heap_num_free());
+      ble_printf("Eval budget: %u ms\n\r", eval_worker_budget());
+      lisp_config_defs(&res);
+      ble_printf("Saved definitions: %d bytes\n\r", res);
+      ble_printf("BLE MTU: %u\n\r", ble_uart_mtu());
+      ble_uart_get_stats(&uart_stats);
+      ble_printf("BLE RX: %u bytes, %u refused (%u bytes), high water %u\n\r",
+		 uart_stats.rx_bytes, uart_stats.rx_refused,
+		 uart_stats.rx_refused_bytes, uart_stats.rx_high_water);
       ble_printf("############################################################\n\r");
       memset(outbuf,0, 4096);
+    } else if (strncmp(str, ":heap", 5) == 0) {
+      u32_t cells = strtoul(str + 5, NULL, 10);
+      err = lisp_config_set_heap_size(cells);
+      if (err) {
+	ble_printf("Error saving heap size %u (err %d)\n\r", cells, err);
+	if (err == -EINVAL) {
+	  ble_printf("The heap must be 256 cons cells or more and fit in memory\n\r");
+	}
+      } else {
+	ble_printf("Heap size %u cons cells after reset\n\r", cells);
+      }
+    } else if (strncmp(str, ":budget", 7) == 0) {
+      eval_worker_set_budget(strtoul(str + 7, NULL, 10));
+      ble_printf("Eval budget %u ms\n\r", eval_worker_budget());
+    } else if (busy && (strncmp(str, ":quit", 5) == 0 ||
+			strncmp(str, ":frame", 6) == 0 ||
+			strncmp(str, ":save", 5) == 0)) {
+      ble_printf("Evaluator busy, ctrl-c aborts\n\r");
+    } else if (strncmp(str, ":save", 5) == 0) {
+      u8_t *image = malloc(CONFIG_LISP_SAVE_SIZE);
+      if (eval_cps_get_env() == prelude_env) {
+	res = 0;
+	ble_printf("No definitions to save\n\r");
+      } else {
+	res = image ? lisp_image_write(eval_cps_get_env(), prelude_env,
+				       image, CONFIG_LISP_SAVE_SIZE) : -ENOMEM;
+      }
+      if (res == -1) {
+	ble_printf("Definitions do not fit in %u bytes\n\r", CONFIG_LISP_SAVE_SIZE);
+      } else if (res < 0) {
+	ble_printf("Definitions can not be saved (%d)\n\r", res);
+      } else if (res > 0) {
+	err = lisp_config_save_defs(image, res);
+	if (err) {
+	  ble_printf("Error saving definitions (err %d)\n\r", err);
+	} else {
+	  ble_printf("Saved definitions, %d bytes\n\r", res);
+	}
+      }
+      free(image);
+    } else if (strncmp(str, ":forget", 7) == 0) {
+      err = lisp_config_delete_defs();
+      if (err) {
+	ble_printf("Error deleting saved definitions (err %d)\n\r", err);
+      } else {
+	ble_printf("Saved definitions deleted\n\r");
+      }
     } else if (strncmp(str, ":quit", 5) == 0) {
       break;
     } else if (strncmp(str, ":notify", 7) == 0) {
       bas_notify();
-    } else {
-
-      VALUE t;
-      t = tokpar_parse(str);
-
-      t = eval_cps_program(t);
-
-      if (dec_sym(t) == symrepr_eerror()) {
-	ble_printf("Error\n");
-      } else {
-	ble_printf("> "); simple_snprint(outbuf, 1023, t); ble_printf("%s \n\r", outbuf);
+    } else if (strncmp(str, ":frame", 6) == 0) {
+      if (frame_session(frame_eval) < 0) {
+	ble_printf("Framed mode ended without CLOSE\n\r");
       }
+    } else {
+      /* there is room, no line is read while the queue is full */
+      eval_worker_submit(eval_parse, repl_eval, str);
+      line_ix = (line_ix + 1) % ARRAY_SIZE(lines);
+      ble_line_init(&line, lines[line_ix], sizeof(lines[line_ix]));
     }
   }
 
@@ -0,0 +1,31 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PRELUDE_IMAGE_H_
+#define PRELUDE_IMAGE_H_
+
+#include <stdint.h>
+
+/* The definitions of the prelude, evaluated at build time by
+   host/make_prelude_image. See lisp_image.h for the format. */
+#if defined(CONFIG_LISP_PRELUDE_IMAGE)
+extern const uint8_t prelude_image[];
+extern const int prelude_image_size;
+#endif
+
+#endif
@@ -0,0 +1,210 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "blelinkmanager.h"
+
+#include <QRandomGenerator>
+#include <QDebug>
+
+#define RECONNECT_BASE_MS     500
+#define RECONNECT_MAX_MS      30000
+
+#define TRAFFIC_TICK_MS       1000
+#define BULK_BYTES_PER_TICK   2048 // above this the link is doing bulk transfer
+#define BULK_HOLD_TICKS       3    // stay in bulk this long after traffic drops
+#define IDLE_TICKS            30   // quiet this long before going low power
+
+BleLinkManager::BleLinkManager(QObject *parent)
+    : QObject(parent)
+{
+    mReconnectTimer.setSingleShot(true);
+    connect(&mReconnectTimer, &QTimer::timeout, this, &BleLinkManager::reconnect);
+
+    mTrafficTimer.setInterval(TRAFFIC_TICK_MS);
+    connect(&mTrafficTimer, &QTimer::timeout, this, &BleLinkManager::trafficTick);
+}
+
+void BleLinkManager::attach(QLowEnergyController *controller)
+{
+    if (mController) {
+        disconnect(mController, nullptr, this, nullptr);
+    }
+
+    mController = controller;
+    mReconnectTimer.stop();
+    mTrafficTimer.stop();
+    mUserDisconnect = false;
+    mWasConnected = false;
+    mAttempt = 0;
+
+    if (!controller) return;
+
+    connect(controller, &QLowEnergyController::stateChanged,
+            this, &BleLinkManager::stateChanged);
+}
+
+void BleLinkManager::setAutoReconnect(bool on)
+{
+    mAutoReconnect = on;
+    if (!on) mReconnectTimer.stop();
+}
+
+void BleLinkManager::setProfile(Profile profile)
+{
+    mProfile = profile;
+
+    if (!mController || mController->state() < QLowEnergyController::ConnectedState) return;
+
+    if (profile == ProfileAuto) {
+        mQuietTicks = 0;
+        mBulkTicks = 0;
+        apply(ProfileLowLatency);
+    } else {
+        apply(profile);
+    }
+}
+
+void BleLinkManager::userDisconnect()
+{
+    mUserDisconnect = true;
+    mReconnectTimer.stop();
+}
+
+void BleLinkManager::noteTraffic(int bytes)
+{
+    mBytes += bytes;
+}
+
+QLowEnergyConnectionParameters BleLinkManager::parameters(Profile profile)
+{
+    QLowEnergyConnectionParameters p;
+
+    switch (profile) {
+    case ProfileBulk:
+        p.setIntervalRange(15, 30);
+        p.setLatency(0);
+        p.setSupervisionTimeout(4000);
+        break;
+    case ProfileLowPower:
+        p.setIntervalRange(100, 200);
+        p.setLatency(4);
+        p.setSupervisionTimeout(6000);
+        break;
+    case ProfileAuto:
+    case ProfileLowLatency:
+    default:
+        p.setIntervalRange(7.5, 15);
+        p.setLatency(0);
+        p.setSupervisionTimeout(2000);
+        break;
+    }
+    return p;
+}
+
+void BleLinkManager::apply(Profile profile)
+{
+    if (!mController) return;
+
+    mApplied = profile;
+    // Needs CAP_NET_ADMIN with BlueZ, without it the request is ignored.
+    mController->requestConnectionUpdate(parameters(profile));
+    emit profileApplied(profile);
+}
+
+int BleLinkManager::backoffDelay() const
+{
+    int shift = qMin(mAttempt, 16);
+    qint64 delay = qMin((qint64)RECONNECT_BASE_MS << shift, (qint64)RECONNECT_MAX_MS);
+
+    // "Equal jitter", half fixed and half random, so that several tools
+    // reconnecting to the same device do not retry in lock step.
+    int half = (int)(delay / 2);
+    return half + (int)QRandomGenerator::global()->bounded(half + 1);
+}
+
+void BleLinkManager::stateChanged(QLowEnergyController::ControllerState state)
+{
+    switch (state) {
+    case QLowEnergyController::ConnectedState:
+        if (mAttempt > 0) emit reconnected();
+        mWasConnected = true;
+        mAttempt = 0;
+        mBytes = 0;
+        mQuietTicks = 0;
+        mBulkTicks = 0;
+        apply(mProfile == ProfileAuto ? ProfileLowLatency : mProfile);
+        mTrafficTimer.start();
+        break;
+    case QLowEnergyController::UnconnectedState:
+        mTrafficTimer.stop();
+        // A failed connection attempt also ends up here.
+        if (mAutoReconnect && !mUserDisconnect && mWasConnected) {
+            int delay = backoffDelay();
+            mAttempt ++;
+            qDebug() << "BLE link lost, reconnect attempt" << mAttempt << "in" << delay << "ms";
+            emit reconnecting(mAttempt, delay);
+            mReconnectTimer.start(delay);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void BleLinkManager::reconnect()
+{
+    if (!mController || mUserDisconnect) return;
+
+    if (mController->state() == QLowEnergyController::UnconnectedState) {
+        mController->connectToDevice();
+    }
+}
+
+void BleLinkManager::trafficTick()
+{
+    qint64 bytes = mBytes;
+    mBytes = 0;
+
+    if (mProfile != ProfileAuto) return;
+
+    Profile next = mApplied;
+
+    if (bytes >= BULK_BYTES_PER_TICK) {
+        mBulkTicks = BULK_HOLD_TICKS;
+        mQuietTicks = 0;
+        next = ProfileBulk;
+    } else if (bytes > 0) {
+        mQuietTicks = 0;
+        if (mBulkTicks > 0) mBulkTicks --;
+        next = mBulkTicks > 0 ? ProfileBulk : ProfileLowLatency;
+    } else {
+        if (mBulkTicks > 0) mBulkTicks --;
+        mQuietTicks ++;
+        if (mBulkTicks > 0) {
+            next = ProfileBulk;
+        } else if (mQuietTicks >= IDLE_TICKS) {
+            next = ProfileLowPower;
+        } else if (mApplied == ProfileBulk) {
+            next = ProfileLowLatency;
+        }
+    }
+
+    if (next != mApplied) {
+        qDebug() << "BLE link profile" << mApplied << "->" << next;
+        apply(next);
+    }
+}
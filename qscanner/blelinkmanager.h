@@ -0,0 +1,93 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BLELINKMANAGER_H
+#define BLELINKMANAGER_H
+
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+
+#include <qlowenergycontroller.h>
+#include <qlowenergyconnectionparameters.h>
+
+// Keeps a BLE link up and tuned.
+//
+// When the link drops without the user asking for it, reconnection is
+// retried with exponential backoff and jitter. Once connected the
+// connection parameters of the selected profile are requested, in the
+// ProfileAuto mode the profile follows the traffic reported through
+// noteTraffic().
+class BleLinkManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Order matches the entries of the profile combo box.
+    enum Profile {
+        ProfileAuto = 0,
+        ProfileLowLatency,
+        ProfileBulk,
+        ProfileLowPower
+    };
+
+    explicit BleLinkManager(QObject *parent = nullptr);
+
+    void attach(QLowEnergyController *controller);
+    void setAutoReconnect(bool on);
+    void setProfile(Profile profile);
+
+    // Call before a disconnect that should not be undone.
+    void userDisconnect();
+
+    // Bytes sent or received over the link, drives ProfileAuto.
+    void noteTraffic(int bytes);
+
+    static QLowEnergyConnectionParameters parameters(Profile profile);
+
+signals:
+    void reconnecting(int attempt, int delayMs);
+    void reconnected();
+    void profileApplied(BleLinkManager::Profile profile);
+
+private slots:
+    void stateChanged(QLowEnergyController::ControllerState state);
+    void reconnect();
+    void trafficTick();
+
+private:
+    void apply(Profile profile);
+    int backoffDelay() const;
+
+    QPointer<QLowEnergyController> mController;
+    QTimer mReconnectTimer;
+    QTimer mTrafficTimer;
+
+    bool mAutoReconnect = true;
+    bool mUserDisconnect = false;
+    bool mWasConnected = false;
+    int mAttempt = 0;
+
+    Profile mProfile = ProfileAuto;
+    Profile mApplied = ProfileAuto;
+
+    qint64 mBytes = 0;
+    int mQuietTicks = 0;
+    int mBulkTicks = 0;
+};
+
+#endif // BLELINKMANAGER_H
@@ -0,0 +1,231 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "blewriteengine.h"
+
+#include <QTimer>
+#include <QDebug>
+
+// Number of write commands handed to QtBluetooth before yielding to the
+// event loop, keeps the GUI responsive while a large blob is streamed.
+#define COMMAND_BURST 16
+
+// Refused writes are sent again after RETRY_BASE_MS, doubling up to
+// RETRY_MAX_MS, until they have been tried MAX_WRITE_ATTEMPTS times.
+#define MAX_WRITE_ATTEMPTS 10
+#define RETRY_BASE_MS 20
+#define RETRY_MAX_MS 1000
+
+BleWriteEngine::BleWriteEngine(QObject *parent)
+    : QObject(parent)
+{
+    mRetryTimer.setSingleShot(true);
+    connect(&mRetryTimer, &QTimer::timeout, this, &BleWriteEngine::pump);
+}
+
+void BleWriteEngine::setController(QLowEnergyController *controller)
+{
+    mController = controller;
+}
+
+void BleWriteEngine::setMaxInFlight(int n)
+{
+    mMaxInFlight = n > 0 ? n : 1;
+}
+
+int BleWriteEngine::maxPayload() const
+{
+    int mtu = 23; // ATT default
+    if (mController && mController->mtu() > 0) {
+        mtu = mController->mtu();
+    }
+    return mtu - 3;
+}
+
+int BleWriteEngine::enqueue(QLowEnergyService *service, const QLowEnergyCharacteristic &ch,
+                            const QByteArray &value, WriteMode mode, bool retryRefused)
+{
+    if (!service || !ch.isValid()) return -1;
+
+    QLowEnergyCharacteristic::PropertyTypes props = ch.properties();
+
+    if (mode == WriteCommand) {
+        if (!(props & QLowEnergyCharacteristic::WriteNoResponse)) return -1;
+    } else {
+        if (!(props & QLowEnergyCharacteristic::Write)) return -1;
+        if (mode == WriteRequest && value.size() > maxPayload()) {
+            // Does not fit in one request, let it go out as a long write.
+            mode = WriteLong;
+        }
+    }
+
+    watchService(service);
+
+    Write w;
+    w.id = mNextId++;
+    w.service = service;
+    w.ch = ch;
+    w.value = value;
+    w.size = value.size();
+    w.mode = mode;
+    w.retry = retryRefused && mode != WriteCommand;
+    w.attempts = 0;
+    w.timer.start();
+    mQueue.enqueue(w);
+
+    pump();
+    return w.id;
+}
+
+int BleWriteEngine::pending() const
+{
+    return mQueue.size() + mInFlight.size();
+}
+
+void BleWriteEngine::clear()
+{
+    mQueue.clear();
+    mInFlight.clear();
+    mRetryTimer.stop();
+}
+
+void BleWriteEngine::watchService(QLowEnergyService *service)
+{
+    if (mWatched.contains(service)) return;
+    mWatched.insert(service);
+
+    connect(service, &QLowEnergyService::characteristicWritten,
+            this, &BleWriteEngine::characteristicWritten);
+    connect(service, QOverload<QLowEnergyService::ServiceError>::of(&QLowEnergyService::error),
+            this, &BleWriteEngine::serviceError);
+    connect(service, &QObject::destroyed, this, [this, service]() {
+        mWatched.remove(service);
+    });
+}
+
+void BleWriteEngine::pump()
+{
+    int commands = 0;
+
+    // A refused write is back at the head of the queue, waiting out its
+    // delay.
+    if (mRetryTimer.isActive()) return;
+
+    while (!mQueue.isEmpty()) {
+        Write &w = mQueue.head();
+
+        if (!w.service) {
+            Write dead = mQueue.dequeue();
+            emit writeFailed(dead.id, dead.ch, QLowEnergyService::OperationError);
+            continue;
+        }
+
+        if (w.mode == WriteCommand) {
+            if (commands >= COMMAND_BURST) break;
+
+            int chunk = maxPayload();
+            w.service->writeCharacteristic(w.ch, w.value.left(chunk),
+                                           QLowEnergyService::WriteWithoutResponse);
+            w.value.remove(0, chunk);
+            commands ++;
+
+            if (w.value.isEmpty()) {
+                Write done = mQueue.dequeue();
+                emit writeDone(done.id, done.ch, done.size, done.timer.elapsed());
+            }
+            continue;
+        }
+
+        // Requests and long writes alike, QtBluetooth picks the ATT
+        // procedure from the value size.
+        if (mInFlight.size() >= mMaxInFlight || mustWait(w)) break;
+
+        Write req = mQueue.dequeue();
+        req.service->writeCharacteristic(req.ch, req.value,
+                                         QLowEnergyService::WriteWithResponse);
+        mInFlight.append(req);
+    }
+
+    if (!mQueue.isEmpty() && mQueue.head().mode == WriteCommand && !mPumpScheduled) {
+        mPumpScheduled = true;
+        QTimer::singleShot(0, this, [this]() {
+            mPumpScheduled = false;
+            pump();
+        });
+    }
+
+    if (mQueue.isEmpty() && mInFlight.isEmpty()) {
+        emit idle();
+    }
+}
+
+// A write that may be refused and sent again must not share the
+// characteristic with another write in flight, in either order.
+bool BleWriteEngine::mustWait(const Write &w) const
+{
+    for (const Write &f : mInFlight) {
+        if ((w.retry || f.retry) && f.service == w.service &&
+            f.ch.handle() == w.ch.handle()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BleWriteEngine::finish(int index)
+{
+    Write w = mInFlight.takeAt(index);
+    emit writeDone(w.id, w.ch, w.size, w.timer.elapsed());
+    pump();
+}
+
+void BleWriteEngine::characteristicWritten(const QLowEnergyCharacteristic &ch, const QByteArray &value)
+{
+    (void) value;
+
+    // ATT responses arrive in request order, the oldest matching request
+    // is the one being acknowledged.
+    for (int i = 0; i < mInFlight.size(); i ++) {
+        if (mInFlight[i].ch.handle() == ch.handle() &&
+            mInFlight[i].service == sender()) {
+            finish(i);
+            return;
+        }
+    }
+}
+
+void BleWriteEngine::serviceError(QLowEnergyService::ServiceError error)
+{
+    if (error != QLowEnergyService::CharacteristicWriteError) return;
+
+    for (int i = 0; i < mInFlight.size(); i ++) {
+        if (mInFlight[i].service == sender()) {
+            Write w = mInFlight.takeAt(i);
+
+            if (w.retry && ++ w.attempts < MAX_WRITE_ATTEMPTS) {
+                mQueue.prepend(w);
+                mRetryTimer.start(qMin(RETRY_BASE_MS << (w.attempts - 1), RETRY_MAX_MS));
+                return;
+            }
+
+            qDebug() << "Characteristic write failed:" << w.ch.uuid().toString();
+            emit writeFailed(w.id, w.ch, error);
+            pump();
+            return;
+        }
+    }
+}
@@ -0,0 +1,118 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BLEWRITEENGINE_H
+#define BLEWRITEENGINE_H
+
+#include <QObject>
+#include <QPointer>
+#include <QQueue>
+#include <QList>
+#include <QSet>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include <qlowenergycontroller.h>
+#include <qlowenergyservice.h>
+#include <qlowenergycharacteristic.h>
+
+// Queue of characteristic writes against one or more services.
+//
+// Write requests are handed to QtBluetooth up to maxInFlight at a time so
+// the ATT layer always has the next request ready when a response comes
+// back. ATT allows one outstanding request, so this pipelining relies on
+// QtBluetooth queueing the requests internally and sending each as soon
+// as the previous one is answered; the engine only keeps that queue fed.
+// Write commands have no response and are split into ATT_MTU - 3 sized
+// pieces. Long writes go out as a single write request, QtBluetooth turns
+// values larger than ATT_MTU - 3 into a prepare/execute (reliable) write
+// sequence.
+//
+// A write enqueued with retryRefused is one a peripheral may refuse for
+// now and accept later, like the BLE UART answering Insufficient
+// Resources while its receive ring is full. Such a write is sent again
+// after a growing delay, up to MAX_WRITE_ATTEMPTS times before
+// writeFailed, and nothing queued behind it goes out meanwhile. So that
+// nothing can overtake a refused write, it is only handed to QtBluetooth
+// when no other write to its characteristic is in flight, which gives up
+// the pipelining for that characteristic. Other writes fail on the
+// first error.
+class BleWriteEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum WriteMode {
+        WriteRequest = 0,
+        WriteCommand,
+        WriteLong
+    };
+
+    explicit BleWriteEngine(QObject *parent = nullptr);
+
+    void setController(QLowEnergyController *controller);
+    void setMaxInFlight(int n);
+
+    // ATT payload available to a single write request or command.
+    int maxPayload() const;
+
+    // Returns an id that is passed to writeDone/writeFailed, -1 if the
+    // characteristic does not support the requested kind of write.
+    int enqueue(QLowEnergyService *service, const QLowEnergyCharacteristic &ch,
+                const QByteArray &value, WriteMode mode, bool retryRefused = false);
+
+    int pending() const;
+    void clear();
+
+signals:
+    void writeDone(int id, const QLowEnergyCharacteristic &ch, int bytes, qint64 elapsedMs);
+    void writeFailed(int id, const QLowEnergyCharacteristic &ch, QLowEnergyService::ServiceError error);
+    void idle();
+
+private slots:
+    void pump();
+    void characteristicWritten(const QLowEnergyCharacteristic &ch, const QByteArray &value);
+    void serviceError(QLowEnergyService::ServiceError error);
+
+private:
+    struct Write {
+        int id;
+        QPointer<QLowEnergyService> service;
+        QLowEnergyCharacteristic ch;
+        QByteArray value;
+        int size;
+        WriteMode mode;
+        bool retry;
+        int attempts;
+        QElapsedTimer timer;
+    };
+
+    void watchService(QLowEnergyService *service);
+    void finish(int index);
+    bool mustWait(const Write &w) const;
+
+    QPointer<QLowEnergyController> mController;
+    QSet<QLowEnergyService *> mWatched;
+    QQueue<Write> mQueue;
+    QList<Write> mInFlight;
+    QTimer mRetryTimer;       // a refused write waits at the queue head
+    int mMaxInFlight = 4;
+    int mNextId = 0;
+    bool mPumpScheduled = false;
+};
+
+#endif // BLEWRITEENGINE_H
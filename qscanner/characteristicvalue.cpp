@@ -0,0 +1,131 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "characteristicvalue.h"
+
+#include <QRegularExpression>
+#include <QStringList>
+
+static int typeSize(int type)
+{
+    switch(type) {
+    case CH_INT8:
+    case CH_UINT8:
+        return 1;
+    case CH_INT16:
+    case CH_UINT16:
+        return 2;
+    case CH_INT32:
+    case CH_UINT32:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static bool isSigned(int type)
+{
+    return type == CH_INT8 || type == CH_INT16 || type == CH_INT32;
+}
+
+QString decodeCharacteristicValue(int type, const QByteArray &value)
+{
+    QString str;
+
+    switch(type) {
+    case CH_STRING:
+        str = QString(value);
+        break;
+    case CH_HEX:
+        for (auto c: value)  {
+            if (!str.isEmpty()) str.append(" ");
+            str.append(QString("0x%1").arg((quint8)c, 2, 16, QChar('0')));
+        }
+        break;
+    default: {
+        int size = typeSize(type);
+        if (size == 0) break;
+
+        for (int i = 0; i + size <= value.size(); i += size) {
+            quint32 u = 0;
+            for (int b = 0; b < size; b ++) {
+                u |= (quint32)(quint8)value.at(i + b) << (8 * b);
+            }
+            if (!str.isEmpty()) str.append(" ");
+            if (isSigned(type)) {
+                // sign extend from size bytes
+                qint32 s = (qint32)(u << (32 - 8 * size)) >> (32 - 8 * size);
+                str.append(QString::number(s));
+            } else {
+                str.append(QString::number(u));
+            }
+        }
+    } break;
+    }
+    return str;
+}
+
+QByteArray encodeCharacteristicValue(int type, const QString &text, bool *ok)
+{
+    QByteArray value;
+    *ok = true;
+
+    switch(type) {
+    case CH_STRING:
+        return text.toUtf8();
+    case CH_HEX: {
+        QString hex = text;
+        hex.remove(QRegularExpression("0[xX]"));
+        hex.remove(QRegularExpression("[\\s,:]"));
+        if (hex.size() % 2 != 0 ||
+            hex.contains(QRegularExpression("[^0-9a-fA-F]"))) {
+            *ok = false;
+            return QByteArray();
+        }
+        return QByteArray::fromHex(hex.toLatin1());
+    }
+    default: {
+        int size = typeSize(type);
+        if (size == 0) {
+            *ok = false;
+            return value;
+        }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        QStringList words = text.split(QRegularExpression("[\\s,]+"), Qt::SkipEmptyParts);
+#else
+        QStringList words = text.split(QRegularExpression("[\\s,]+"), QString::SkipEmptyParts);
+#endif
+        for (const QString &w : words) {
+            bool conv;
+            qint64 v = w.toLongLong(&conv, 0);
+            qint64 min = isSigned(type) ? -(1LL << (8 * size - 1)) : 0;
+            qint64 max = isSigned(type) ? (1LL << (8 * size - 1)) - 1 : (1LL << (8 * size)) - 1;
+
+            if (!conv || v < min || v > max) {
+                *ok = false;
+                return QByteArray();
+            }
+            for (int b = 0; b < size; b ++) {
+                value.append((char)((quint64)v >> (8 * b)));
+            }
+        }
+        if (value.isEmpty()) *ok = false;
+    } break;
+    }
+    return value;
+}
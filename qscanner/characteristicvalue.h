@@ -0,0 +1,41 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHARACTERISTICVALUE_H
+#define CHARACTERISTICVALUE_H
+
+#include <QByteArray>
+#include <QString>
+
+// Order matches the entries of the characteristic type combo box.
+typedef enum {
+    CH_STRING = 0,
+    CH_INT8,
+    CH_INT16,
+    CH_INT32,
+    CH_UINT8,
+    CH_UINT16,
+    CH_UINT32,
+    CH_HEX
+} ch_type;
+
+// Integer types are little endian as on the wire. A value may hold
+// several integers, they are separated by spaces or commas in the text.
+QString decodeCharacteristicValue(int type, const QByteArray &value);
+QByteArray encodeCharacteristicValue(int type, const QString &text, bool *ok);
+
+#endif // CHARACTERISTICVALUE_H
@@ -0,0 +1,381 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "devicetablemodel.h"
+#include "ad_decoder.h"
+
+#include <algorithm>
+
+DeviceTableModel::DeviceTableModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+    mClock.start();
+}
+
+DeviceTableModel::~DeviceTableModel()
+{
+    qDeleteAll(mRows);
+}
+
+int DeviceTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : mVisible;
+}
+
+int DeviceTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColCount;
+}
+
+static QString coreConfString(const QBluetoothDeviceInfo &info)
+{
+    QBluetoothDeviceInfo::CoreConfigurations cconf = info.coreConfigurations();
+
+    QString str = "";
+
+    if (cconf.testFlag(QBluetoothDeviceInfo::LowEnergyCoreConfiguration)) {
+        str.append(" LowEnergy");
+    }
+    if (cconf.testFlag(QBluetoothDeviceInfo::UnknownCoreConfiguration  )) {
+        str.append(" Unknown");
+    }
+    if (cconf.testFlag(QBluetoothDeviceInfo::BaseRateCoreConfiguration  )) {
+        str.append(" BaseRate");
+    }
+    if (cconf.testFlag(QBluetoothDeviceInfo::BaseRateAndLowEnergyCoreConfiguration  )) {
+        str.append(" BaseRate_&_LowEnergy");
+    }
+    return str;
+}
+
+static void appendField(QByteArray &ad, quint8 type, const QByteArray &value)
+{
+    if (value.size() > 254) return;
+    ad.append(char(value.size() + 1));
+    ad.append(char(type));
+    ad.append(value);
+}
+
+static void appendLe(QByteArray &out, quint32 v, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        out.append(char((v >> (8 * i)) & 0xff));
+    }
+}
+
+// Qt hands out the advertisement already taken apart, it is put back
+// together as AD structures so the Qt tool and the command line scanner
+// share one decoder and print the fields the same way.
+static QString advertisingString(const QBluetoothDeviceInfo &info)
+{
+    QByteArray ad;
+    QByteArray uuid16, uuid32, uuid128;
+
+    for (const QBluetoothUuid &uuid : info.serviceUuids()) {
+        switch (uuid.minimumSize()) {
+        case 2:
+            appendLe(uuid16, uuid.toUInt16(), 2);
+            break;
+        case 4:
+            appendLe(uuid32, uuid.toUInt32(), 4);
+            break;
+        default: {
+            quint128 u = uuid.toUInt128();
+            for (int i = 15; i >= 0; i--) uuid128.append(char(u.data[i]));
+            break;
+        }
+        }
+    }
+    if (!uuid16.isEmpty()) appendField(ad, AD_UUID16_SOME, uuid16);
+    if (!uuid32.isEmpty()) appendField(ad, AD_UUID32_SOME, uuid32);
+    if (!uuid128.isEmpty()) appendField(ad, AD_UUID128_SOME, uuid128);
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    const QHash<quint16, QByteArray> mfg = info.manufacturerData();
+    for (auto it = mfg.constBegin(); it != mfg.constEnd(); ++it) {
+        QByteArray value;
+        appendLe(value, it.key(), 2);
+        value.append(it.value());
+        appendField(ad, AD_MANUFACTURER_DATA, value);
+    }
+#endif
+
+    ad_info_t decoded;
+    char buf[512];
+    ad_decode(reinterpret_cast<const uint8_t *>(ad.constData()), size_t(ad.size()), &decoded);
+    ad_format(&decoded, buf, sizeof(buf));
+    return QString::fromLatin1(buf);
+}
+
+QVariant DeviceTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= mVisible) return QVariant();
+
+    const Entry *e = mRows[index.row()];
+
+    if (role == Qt::UserRole && index.column() == ColAddress) {
+        return QVariant::fromValue(e->info);
+    }
+
+    if (role != Qt::DisplayRole) return QVariant();
+
+    switch (index.column()) {
+    case ColAddress:
+        return e->info.address().toString();
+    case ColName:
+        return e->info.name();
+    case ColCoreConf:
+        return coreConfString(e->info);
+    case ColRssi:
+        return QString::number(e->info.rssi(), 10);
+    case ColLastSeen:
+        return e->seenAt.toString("hh:mm:ss");
+    case ColAdvertising:
+        return e->advertising;
+    default:
+        return QVariant();
+    }
+}
+
+QVariant DeviceTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole || orientation != Qt::Horizontal) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+
+    switch (section) {
+    case ColAddress:  return "Address";
+    case ColName:     return "Name";
+    case ColCoreConf: return "CoreConf";
+    case ColRssi:     return "Signal";
+    case ColLastSeen: return "Last Seen";
+    case ColAdvertising: return "Advertising";
+    default:          return QVariant();
+    }
+}
+
+bool DeviceTableModel::before(const Entry *a, const Entry *b)
+{
+    if (a->key != b->key) return a->key < b->key;
+    return a->seq < b->seq;
+}
+
+qint64 DeviceTableModel::keyFor(const Entry *e) const
+{
+    switch (mSortKey) {
+    case SortAddress:
+        return (qint64)e->info.address().toUInt64();
+    case SortRssi:
+        return -(qint64)e->info.rssi();  // strongest first
+    case SortLastSeen:
+        return -e->lastSeen;             // most recent first
+    case SortDiscovery:
+    default:
+        return 0;
+    }
+}
+
+int DeviceTableModel::lowerBound(const Entry *e, int first, int last) const
+{
+    return std::lower_bound(mRows.constBegin() + first, mRows.constBegin() + last, e, before)
+            - mRows.constBegin();
+}
+
+int DeviceTableModel::findRow(const Entry *e) const
+{
+    // (key, seq) is unique so the lower bound is the entry itself.
+    return lowerBound(e, 0, mRows.size());
+}
+
+int DeviceTableModel::visibleFor(int size) const
+{
+    return (mRowLimit > 0 && size > mRowLimit) ? mRowLimit : size;
+}
+
+void DeviceTableModel::insertEntry(Entry *e)
+{
+    int pos = lowerBound(e, 0, mRows.size());
+
+    if (visibleFor(mRows.size() + 1) > mVisible) {
+        beginInsertRows(QModelIndex(), pos, pos);
+        mRows.insert(pos, e);
+        mVisible ++;
+        endInsertRows();
+    } else if (pos < mVisible) {
+        // Pushes the last visible row out of the view.
+        beginRemoveRows(QModelIndex(), mVisible - 1, mVisible - 1);
+        mVisible --;
+        endRemoveRows();
+        beginInsertRows(QModelIndex(), pos, pos);
+        mRows.insert(pos, e);
+        mVisible ++;
+        endInsertRows();
+    } else {
+        mRows.insert(pos, e);
+    }
+}
+
+void DeviceTableModel::moveEntry(Entry *e, qint64 key)
+{
+    int from = findRow(e);
+
+    // Find the final position among the other rows, the ranges on each
+    // side of the entry are sorted.
+    Entry probe = *e;
+    probe.key = key;
+
+    int to;
+    if (before(&probe, e)) {
+        to = lowerBound(&probe, 0, from);
+    } else {
+        to = lowerBound(&probe, from + 1, mRows.size()) - 1;
+    }
+
+    auto mutate = [this, e, key, from, to]() {
+        e->key = key;
+        mRows.remove(from);
+        mRows.insert(to, e);
+    };
+
+    if (from == to) {
+        e->key = key;
+    } else if (from < mVisible && to < mVisible) {
+        beginMoveRows(QModelIndex(), from, from, QModelIndex(), to > from ? to + 1 : to);
+        mutate();
+        endMoveRows();
+    } else if (from < mVisible) {
+        // Leaves the view, the first hidden row takes the last visible slot.
+        beginRemoveRows(QModelIndex(), from, from);
+        mVisible --;
+        mutate();
+        endRemoveRows();
+        beginInsertRows(QModelIndex(), mVisible, mVisible);
+        mVisible ++;
+        endInsertRows();
+    } else if (to < mVisible) {
+        beginRemoveRows(QModelIndex(), mVisible - 1, mVisible - 1);
+        mVisible --;
+        endRemoveRows();
+        beginInsertRows(QModelIndex(), to, to);
+        mutate();
+        mVisible ++;
+        endInsertRows();
+    } else {
+        mutate();
+    }
+}
+
+void DeviceTableModel::update(const QBluetoothDeviceInfo &info)
+{
+    quint64 addr = info.address().toUInt64();
+    Entry *e = mByAddress.value(addr, nullptr);
+
+    if (!e) {
+        e = new Entry;
+        e->info = info;
+        e->lastSeen = mClock.elapsed();
+        e->seenAt = QTime::currentTime();
+        e->advertising = advertisingString(info);
+        e->seq = mSeq++;
+        e->key = keyFor(e);
+        mByAddress.insert(addr, e);
+        insertEntry(e);
+        return;
+    }
+
+    if (info.name().isEmpty() && !e->info.name().isEmpty()) {
+        // Keep the name from an earlier advertisement or scan response.
+        e->info.setRssi(info.rssi());
+    } else {
+        e->info = info;
+    }
+    e->advertising = advertisingString(e->info);
+    e->lastSeen = mClock.elapsed();
+    e->seenAt = QTime::currentTime();
+
+    qint64 key = keyFor(e);
+    qint64 delta = qAbs(key - e->key);
+
+    if ((mSortKey == SortRssi && delta <= mRssiHysteresis) ||
+        (mSortKey == SortLastSeen && delta <= mLastSeenHysteresis)) {
+        key = e->key;
+    }
+
+    if (key != e->key) moveEntry(e, key);
+
+    int row = findRow(e);
+    if (row < mVisible) {
+        emit dataChanged(index(row, 0), index(row, ColCount - 1));
+    }
+}
+
+QBluetoothDeviceInfo DeviceTableModel::device(int row) const
+{
+    if (row < 0 || row >= mVisible) return QBluetoothDeviceInfo();
+    return mRows[row]->info;
+}
+
+void DeviceTableModel::setSortKey(SortKey key)
+{
+    if (key == mSortKey) return;
+
+    emit layoutAboutToBeChanged();
+
+    QModelIndexList oldIndexes = persistentIndexList();
+    QVector<Entry *> oldEntries;
+    for (const QModelIndex &i : oldIndexes) {
+        oldEntries.append(mRows[i.row()]);
+    }
+
+    mSortKey = key;
+    for (Entry *e : mRows) {
+        e->key = keyFor(e);
+    }
+    std::sort(mRows.begin(), mRows.end(), before);
+
+    QModelIndexList newIndexes;
+    for (int i = 0; i < oldIndexes.size(); i ++) {
+        int row = findRow(oldEntries[i]);
+        newIndexes.append(row < mVisible ? index(row, oldIndexes[i].column()) : QModelIndex());
+    }
+    changePersistentIndexList(oldIndexes, newIndexes);
+
+    emit layoutChanged();
+}
+
+void DeviceTableModel::setHysteresis(int rssiDb, int lastSeenMs)
+{
+    mRssiHysteresis = rssiDb;
+    mLastSeenHysteresis = lastSeenMs;
+}
+
+void DeviceTableModel::setRowLimit(int n)
+{
+    mRowLimit = n > 0 ? n : 0;
+
+    int visible = visibleFor(mRows.size());
+
+    if (visible > mVisible) {
+        beginInsertRows(QModelIndex(), mVisible, visible - 1);
+        mVisible = visible;
+        endInsertRows();
+    } else if (visible < mVisible) {
+        beginRemoveRows(QModelIndex(), visible, mVisible - 1);
+        mVisible = visible;
+        endRemoveRows();
+    }
+}
@@ -0,0 +1,109 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DEVICETABLEMODEL_H
+#define DEVICETABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QVector>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QTime>
+
+#include <qbluetoothdeviceinfo.h>
+
+// Live table of discovered devices, kept sorted at all times.
+//
+// An update moves only the changed row: its old position is found by
+// binary search on the key it was sorted with and its new position by
+// binary search on the new key. The sort key of a row only follows the
+// device once it has moved more than the hysteresis (RSSI in dB, last
+// seen in ms) so rows do not flap between neighbours. Rows are moved with
+// beginMoveRows so selection and current index follow the device.
+//
+// With a row limit only the first N rows (the strongest N when sorting
+// on signal) are exposed to views.
+class DeviceTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        ColAddress = 0,
+        ColName,
+        ColCoreConf,
+        ColRssi,
+        ColLastSeen,
+        ColAdvertising,
+        ColCount
+    };
+
+    // Order matches the entries of the sort combo box.
+    enum SortKey {
+        SortDiscovery = 0,
+        SortAddress,
+        SortRssi,
+        SortLastSeen
+    };
+
+    explicit DeviceTableModel(QObject *parent = nullptr);
+    ~DeviceTableModel() override;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    void setSortKey(SortKey key);
+    void setHysteresis(int rssiDb, int lastSeenMs);
+    void setRowLimit(int n); // 0 shows all rows
+
+    void update(const QBluetoothDeviceInfo &info);
+    QBluetoothDeviceInfo device(int row) const;
+
+private:
+    struct Entry {
+        QBluetoothDeviceInfo info;
+        qint64 lastSeen;
+        QTime seenAt;
+        QString advertising; // decoded advertising fields
+        qint64 key;   // value the entry is currently sorted on
+        quint64 seq;  // discovery order, breaks ties
+    };
+
+    static bool before(const Entry *a, const Entry *b);
+    qint64 keyFor(const Entry *e) const;
+    int findRow(const Entry *e) const;
+    int lowerBound(const Entry *e, int first, int last) const;
+    int visibleFor(int size) const;
+    void insertEntry(Entry *e);
+    void moveEntry(Entry *e, qint64 key);
+
+    QVector<Entry *> mRows;
+    QHash<quint64, Entry *> mByAddress;
+    quint64 mSeq = 0;
+    int mVisible = 0;
+
+    SortKey mSortKey = SortDiscovery;
+    int mRssiHysteresis = 4;
+    int mLastSeenHysteresis = 2000;
+    int mRowLimit = 0;
+
+    QElapsedTimer mClock;
+};
+
+#endif // DEVICETABLEMODEL_H
@@ -17,61 +17,35 @@
 
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "characteristicvalue.h"
 
 #include <QDebug>
-typedef enum {
-    CH_STRING = 0,
-    CH_INT8,
-    CH_INT16,
-    CH_INT32,
-    CH_UINT8,
-    CH_UINT16,
-    CH_UINT32,
-    CH_HEX
-} ch_type;
-
-typedef enum {
-    DEVICE_ADDRESS = 0,
-    DEVICE_NAME,
-    DEVICE_CORE_CONF,
-    DEVICE_RSSI
-} table_column;
+#include <QDirIterator>
+#include <QtConcurrent>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
 {
+    mStartupTimer.start();
+
     ui->setupUi(this);
     this->setWindowTitle("BLE-TOOL");
 
-   //QBluetoothLocalDevice localDevice;
-   //QBluetoothAddress adapterAddress = localDevice.address();
-
-    mDiscoveryAgent = new QBluetoothDeviceDiscoveryAgent();
-
-    connect(mDiscoveryAgent, SIGNAL(deviceDiscovered(QBluetoothDeviceInfo)),
-            this, SLOT(addDevice(QBluetoothDeviceInfo)));
-    connect(mDiscoveryAgent, SIGNAL(deviceUpdated(const QBluetoothDeviceInfo, QBluetoothDeviceInfo::Fields)),
-            this, SLOT(deviceUpdated(const QBluetoothDeviceInfo, QBluetoothDeviceInfo::Fields)));
-    connect(mDiscoveryAgent, SIGNAL(finished()),
-            this, SLOT(deviceDiscoveryFinished()));
-    connect(mDiscoveryAgent, SIGNAL(error(QBluetoothDeviceDiscoveryAgent::Error)),
-            this, SLOT(deviceDiscoveryError(QBluetoothDeviceDiscoveryAgent::Error)));
-    connect(mDiscoveryAgent, SIGNAL(canceled()),
-            this, SLOT(deviceDiscoveryCanceled()));
+    mDeviceModel = new DeviceTableModel(this);
+    ui->devicesTableView->setModel(mDeviceModel);
+    ui->devicesTableView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    ui->devicesTableView->setSelectionMode(QAbstractItemView::SingleSelection);
 
+    ui->devicesTableView->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    ui->devicesTableView->resizeColumnsToContents();
 
-    ui->devicesTableWidget->setColumnCount(4);
-    //ui->devicesTableWidget->setRowCount(1);
-    QStringList headerLabels;
-    headerLabels << "Address" << "Name" << "CoreConf" << "Signal" ;
-    ui->devicesTableWidget->setHorizontalHeaderLabels(headerLabels);
+    connect(ui->deviceSortComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, [this](int index) { mDeviceModel->setSortKey((DeviceTableModel::SortKey)index); });
+    connect(ui->deviceLimitSpinBox, QOverload<int>::of(&QSpinBox::valueChanged),
+            mDeviceModel, &DeviceTableModel::setRowLimit);
 
-    ui->devicesTableWidget->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
-    ui->devicesTableWidget->resizeColumnsToContents();
-
-    mDiscoveryAgent->start();
-    ui->scanningIndicatorLabel->setText("Scanning");
+    ui->scanningIndicatorLabel->setText("Starting");
 
     ui->consoleOutputTextEdit->setReadOnly(true);
     ui->consoleOutputTextEdit->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
@@ -79,140 +53,218 @@ MainWindow::MainWindow(QWidget *parent)
     ui->bleUartOutputPlainTextEdit->setReadOnly(true);
     ui->bleUartOutputPlainTextEdit->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
 
-    mNRF52SerialPort = new QSerialPort(this);
-
-    connect(mNRF52SerialPort, &QSerialPort::readyRead,
-            this, &MainWindow::on_NRF52SerialReadyRead);
-
     connect(ui->consoleInputLineEdit, &QLineEdit::returnPressed,
             this, &MainWindow::on_consoleSendPushButton_clicked);
 
     connect(ui->bleUartInputLineEdit, &QLineEdit::returnPressed,
             this, &MainWindow::on_bleUartSendPushButton_clicked);
 
+    connect(ui->bleCharacteristicWriteLineEdit, &QLineEdit::returnPressed,
+            this, &MainWindow::on_bleCharacteristicWritePushButton_clicked);
+
+    ui->bleServicesTreeWidget->setSelectionMode(QAbstractItemView::ExtendedSelection);
+
+    mWriteEngine = new BleWriteEngine(this);
+    connect(mWriteEngine, &BleWriteEngine::writeDone, this,
+            [this](int id, const QLowEnergyCharacteristic &ch, int bytes, qint64 ms) {
+        mLinkManager->noteTraffic(bytes);
+        // UART writes are frequent and not interesting to log.
+        if (mUartWrites.remove(id)) return;
+        ui->outputPlainTextEdit->appendPlainText(
+                    QString("Wrote %1 bytes to %2 (%3 ms)")
+                    .arg(bytes).arg(ch.name().isEmpty() ? ch.uuid().toString() : ch.name()).arg(ms));
+    });
+    connect(mWriteEngine, &BleWriteEngine::writeFailed, this,
+            [this](int id, const QLowEnergyCharacteristic &ch, QLowEnergyService::ServiceError error) {
+        mUartWrites.remove(id);
+        ui->outputPlainTextEdit->appendPlainText(
+                    QString("Write to %1 failed (%2)").arg(ch.uuid().toString()).arg(error));
+    });
+
+    mLinkManager = new BleLinkManager(this);
+    mLinkManager->setAutoReconnect(ui->bleAutoReconnectCheckBox->isChecked());
+    connect(ui->bleAutoReconnectCheckBox, &QCheckBox::toggled,
+            mLinkManager, &BleLinkManager::setAutoReconnect);
+    connect(ui->bleConnectionProfileComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, [this](int index) { mLinkManager->setProfile((BleLinkManager::Profile)index); });
+    connect(mLinkManager, &BleLinkManager::reconnecting, this, [this](int attempt, int delayMs) {
+        ui->outputPlainTextEdit->appendPlainText(
+                    QString("Link lost, reconnect attempt %1 in %2 ms").arg(attempt).arg(delayMs));
+    });
+    connect(mLinkManager, &BleLinkManager::profileApplied, this, [this](BleLinkManager::Profile profile) {
+        statusBar()->showMessage(QString("Connection profile: %1")
+                                 .arg(ui->bleConnectionProfileComboBox->itemText(profile)), 5000);
+    });
+
+    mSdpPool = new SdpDiscoveryPool(this);
+    connect(mSdpPool, &SdpDiscoveryPool::serviceDiscovered, this,
+            [this](const QBluetoothAddress &address, const QBluetoothServiceInfo &info) {
+        if (address == mServicesAddress) addService(info);
+    });
+    connect(mSdpPool, &SdpDiscoveryPool::finished, this,
+            [this](const QBluetoothAddress &address, bool cached) {
+        if (cached) qDebug() << "services of" << address.toString() << "from cache";
+        if (address == mServicesAddress) addServiceDone();
+    });
+    connect(mSdpPool, &SdpDiscoveryPool::error, this,
+            [this](const QBluetoothAddress &address, QBluetoothServiceDiscoveryAgent::Error error) {
+        if (address == mServicesAddress) addServiceError(error);
+    });
+
+    connect(ui->scriptDirLineEdit, &QLineEdit::editingFinished,
+            this, [this]() { indexScriptDir(false); });
+
+    // Bluetooth, the serial port and the script index are brought up
+    // after the window has been painted (see paintEvent) or when used.
+    startupTrace("window constructed");
 }
 
 MainWindow::~MainWindow()
 {
-    delete(mDiscoveryAgent);
+    if (mBluetoothThread) {
+        mBluetoothThread->quit();
+        mBluetoothThread->wait();
+    }
     delete ui;
 }
 
-void MainWindow::addDevice(QBluetoothDeviceInfo info)
+void MainWindow::paintEvent(QPaintEvent *event)
 {
-    QString name = info.name();
-    QString addr = info.address().toString();
-/*
-    if (!(info.name() == QString("NRF52-0101") ||
-          info.name() == QString("NRF52-2121"))) {
-        name = QString("[Hidden]");
-        addr = QString("[Hidden]");
+    QMainWindow::paintEvent(event);
+
+    if (!mFirstPaintDone) {
+        mFirstPaintDone = true;
+        startupTrace("first paint");
+        QTimer::singleShot(0, this, &MainWindow::initBluetooth);
     }
-    */
+}
 
-    QString str0 = addr;
-    QString str1 = name;
+void MainWindow::startupTrace(const QString &what)
+{
+    qDebug() << "startup:" << what << "after" << mStartupTimer.elapsed() << "ms";
+}
 
-    QBluetoothDeviceInfo::CoreConfigurations cconf = info.coreConfigurations();
+void MainWindow::initBluetooth()
+{
+    if (mBluetoothThread) return;
 
-    QString str2 = "";
+    // Queued connections from the agent thread need these registered.
+    qRegisterMetaType<QBluetoothDeviceInfo>("QBluetoothDeviceInfo");
+    qRegisterMetaType<QBluetoothDeviceInfo::Fields>("QBluetoothDeviceInfo::Fields");
+    qRegisterMetaType<QBluetoothDeviceDiscoveryAgent::Error>("QBluetoothDeviceDiscoveryAgent::Error");
 
-    if (cconf.testFlag(QBluetoothDeviceInfo::LowEnergyCoreConfiguration)) {
-        str2.append(" LowEnergy");
-    }
-    if (cconf.testFlag(QBluetoothDeviceInfo::UnknownCoreConfiguration  )) {
-        str2.append(" Unknown");
-    }
-    if (cconf.testFlag(QBluetoothDeviceInfo::BaseRateCoreConfiguration  )) {
-        str2.append(" BaseRate");
-    }
-    if (cconf.testFlag(QBluetoothDeviceInfo::BaseRateAndLowEnergyCoreConfiguration  )) {
-        str2.append(" BaseRate_&_LowEnergy");
-    }
+    mBluetoothThread = new QThread(this);
+    mBluetoothThread->setObjectName("bluetooth");
 
-    QString str3 = QString::number(info.rssi(), 10);
+    QObject *context = new QObject();
+    context->moveToThread(mBluetoothThread);
+    connect(mBluetoothThread, &QThread::finished, context, &QObject::deleteLater);
 
-    //QListWidgetItem *it = new QListWidgetItem();
-    //it->setData(Qt::UserRole, QVariant::fromValue(info));
-    //it->setText(str);
+    mBluetoothThread->start();
 
-    //ui->devicesListWidget->addItem(it);
-    QTableWidgetItem *it0 = new QTableWidgetItem();
-    it0->setData(Qt::UserRole,QVariant::fromValue(info));
-    it0->setText(str0);
+    // Creating the agent is what stalls on BlueZ, so do it in the thread.
+    QTimer::singleShot(0, context, [this]() {
+        //QBluetoothLocalDevice localDevice;
+        //QBluetoothAddress adapterAddress = localDevice.address();
 
-    QTableWidgetItem *it1 = new QTableWidgetItem();
-    it1->setText(str1);
+        QBluetoothDeviceDiscoveryAgent *agent = new QBluetoothDeviceDiscoveryAgent();
 
-    QTableWidgetItem *it2 = new QTableWidgetItem();
-    it2->setText(str2);
+        connect(mBluetoothThread, &QThread::finished, agent, &QObject::deleteLater);
 
-    QTableWidgetItem *it3 = new QTableWidgetItem();
-    it3->setText(str3);
+        connect(agent, SIGNAL(deviceDiscovered(QBluetoothDeviceInfo)),
+                this, SLOT(addDevice(QBluetoothDeviceInfo)));
+        connect(agent, SIGNAL(deviceUpdated(const QBluetoothDeviceInfo, QBluetoothDeviceInfo::Fields)),
+                this, SLOT(deviceUpdated(const QBluetoothDeviceInfo, QBluetoothDeviceInfo::Fields)));
+        connect(agent, SIGNAL(finished()),
+                this, SLOT(deviceDiscoveryFinished()));
+        connect(agent, SIGNAL(error(QBluetoothDeviceDiscoveryAgent::Error)),
+                this, SLOT(deviceDiscoveryError(QBluetoothDeviceDiscoveryAgent::Error)));
+        connect(agent, SIGNAL(canceled()),
+                this, SLOT(deviceDiscoveryCanceled()));
 
+        QMetaObject::invokeMethod(this, [this, agent]() { bluetoothReady(agent); },
+                                  Qt::QueuedConnection);
+    });
+}
 
-    int row = 0;
-    bool found = false;
+void MainWindow::bluetoothReady(QBluetoothDeviceDiscoveryAgent *agent)
+{
+    mDiscoveryAgent = agent;
+    startupTrace("bluetooth ready");
+    startDiscovery(0);
+}
 
-    for (row = 0; row < ui->devicesTableWidget->rowCount(); row ++) {
-        if (ui->devicesTableWidget->item(row,0)->text() == str0) {
-            found = true;
-            break;
-        }
+void MainWindow::startDiscovery(int delay_ms)
+{
+    if (!mDiscoveryAgent) return;
+
+    mDiscoveryRunning = true;
+    QTimer::singleShot(delay_ms, this, [this]{
+        ui->scanningIndicatorLabel->setText("Scanning");
+        // start() must run in the thread the agent lives in.
+        QTimer::singleShot(0, mDiscoveryAgent, [this]() {
+            mDiscoveryAgent->start();
+            QMetaObject::invokeMethod(this, [this]() {
+                if (!mScanningTraced) {
+                    mScanningTraced = true;
+                    startupTrace("scanning");
+                }
+            }, Qt::QueuedConnection);
+        });
+    });
+}
+
+QSerialPort *MainWindow::serialPort()
+{
+    if (!mNRF52SerialPort) {
+        mNRF52SerialPort = new QSerialPort(this);
+
+        connect(mNRF52SerialPort, &QSerialPort::readyRead,
+                this, &MainWindow::on_NRF52SerialReadyRead);
     }
+    return mNRF52SerialPort;
+}
 
-    if (!found) {
-        int row = ui->devicesTableWidget->rowCount();
-        ui->devicesTableWidget->setRowCount(row + 1);
+void MainWindow::addDevice(QBluetoothDeviceInfo info)
+{
+/*
+    if (!(info.name() == QString("NRF52-0101") ||
+          info.name() == QString("NRF52-2121"))) {
+        return;
     }
-    ui->devicesTableWidget->setItem(row, DEVICE_ADDRESS, it0);
-    ui->devicesTableWidget->setItem(row, DEVICE_NAME, it1);
-    ui->devicesTableWidget->setItem(row, DEVICE_CORE_CONF, it2);
-    ui->devicesTableWidget->setItem(row, DEVICE_RSSI, it3);
+    */
 
+    mDeviceModel->update(info);
 }
 
 void MainWindow::deviceUpdated(const QBluetoothDeviceInfo info, QBluetoothDeviceInfo::Fields fields)
 {
-    QString addrStr = info.address().toString();
-
-    int row = 0;
-    bool found = false;
-
-    for (row = 0; row < ui->devicesTableWidget->rowCount(); row ++) {
-        if (ui->devicesTableWidget->item(row,0)->text() == addrStr) {
-            found = true;
-            break;
-        }
-    }
+    (void) fields;
 
-    if (found && fields & 1) {
-        QTableWidgetItem *it = new QTableWidgetItem();
-        it->setText(QString::number(info.rssi(),10));
-        ui->devicesTableWidget->setItem(row, DEVICE_RSSI, it);
-    }
+    mDeviceModel->update(info);
 }
 
 void MainWindow::deviceDiscoveryFinished()
 {
+    mDiscoveryRunning = false;
     ui->scanningIndicatorLabel->setText("Resting");
     qDebug() << "Device discovery done!";
 
     if (ui->scanPeriodicallyCheckBox->isChecked()) {
-        QTimer::singleShot(25000, [this]{
-            ui->scanningIndicatorLabel->setText("Scanning");
-            mDiscoveryAgent->start();});
+        startDiscovery(25000);
     }
 
 }
 
 void MainWindow::deviceDiscoveryError(QBluetoothDeviceDiscoveryAgent::Error error)
 {
+    mDiscoveryRunning = false;
     qDebug() << "Device discovery error: " << error;
 }
 
 void MainWindow::deviceDiscoveryCanceled()
 {
+    mDiscoveryRunning = false;
     qDebug() << "Device discovery canceled!";
 }
 
@@ -230,9 +282,10 @@ void MainWindow::addService(QBluetoothServiceInfo info)
 
 }
 
-void MainWindow::addServiceError(QBluetoothDeviceDiscoveryAgent::Error error)
+void MainWindow::addServiceError(QBluetoothServiceDiscoveryAgent::Error error)
 {
    qDebug() << error;
+   ui->servicesPushButton->setEnabled(true);
 }
 
 void MainWindow::addServiceDone()
@@ -303,6 +356,11 @@ void MainWindow::bleServiceDiscovered(const QBluetoothUuid &gatt)
                     it->addChild(child);
 
                 }
+                // Reattach the uart after an automatic reconnect.
+                if (mUartWanted && !mBLEUartService &&
+                    bleService->serviceUuid() == QBluetoothUuid(QString("{6e400001-b5a3-f393-e0a9-e50e24dcca9e}"))) {
+                    attachBleUart(bleService);
+                }
                 break;
             case QLowEnergyService::LocalService: {
                 QTreeWidgetItem *child = new QTreeWidgetItem();
@@ -347,6 +405,7 @@ void MainWindow::bleServiceCharacteristic(const QLowEnergyCharacteristic &info,
     // If value comes from uart service, redirect to uart text output
     if (info.uuid() == QBluetoothUuid(QString("{6e400003-b5a3-f393-e0a9-e50e24dcca9e}"))) {
         // UART RX
+        mLinkManager->noteTraffic(value.size());
         QTextCursor text_cursor = QTextCursor(ui->bleUartOutputPlainTextEdit->document());
         text_cursor.movePosition(QTextCursor::End);
         text_cursor.insertText(str);
@@ -367,63 +426,26 @@ void MainWindow::bleServiceCharacteristicRead(const QLowEnergyCharacteristic &in
     (void) info;
 
     int index = ui->bleCharacteristicReadTypeComboBox->currentIndex();
-    QString str;
-
-    switch(index) {
-    case CH_STRING:  //String
-        str = QString(value);
-        break;
-    case CH_INT8:  // int8;
-        str = QString("%1").number(value.at(0));
-        break;
-    case CH_INT16:
-        break;
-    case CH_INT32:
-        break;
-    case CH_UINT8:
-        break;
-    case CH_UINT16:
-        break;
-    case CH_UINT32:
-        break;
-    case CH_HEX:
-        for (auto c: value)  {
-            str.append(QString("0x%1").number(c,16));
-        }
-    }
+    QString str = decodeCharacteristicValue(index, value);
 
     ui->outputPlainTextEdit->appendPlainText(str);
 }
 
 void MainWindow::on_servicesPushButton_clicked()
 {
-    ui->servicesPushButton->setEnabled(false);
-    ui->servicesListWidget->clear();
-
     //QListWidgetItem *it = ui->devicesListWidget->currentItem();
-    QTableWidgetItem *it = ui->devicesTableWidget->currentItem();
+    QBluetoothDeviceInfo info = mDeviceModel->device(ui->devicesTableView->currentIndex().row());
 
-    QBluetoothDeviceInfo info = it->data(Qt::UserRole).value<QBluetoothDeviceInfo>();
+    if (!info.isValid()) return;
+
+    ui->servicesPushButton->setEnabled(false);
+    ui->servicesListWidget->clear();
 
     qDebug() << info.name();
     qDebug() << info.address();
 
-
-    mServiceDiscoveryAgent = new QBluetoothServiceDiscoveryAgent();
-    mServiceDiscoveryAgent->setRemoteAddress(info.address());
-
-    if (mServiceDiscoveryAgent->error()) {
-        qDebug() << "wrong device address";
-    }
-
-    connect(mServiceDiscoveryAgent, SIGNAL(serviceDiscovered(QBluetoothServiceInfo)),
-            this, SLOT(addService(QBluetoothServiceInfo)));
-    connect(mServiceDiscoveryAgent, SIGNAL(finished()),
-            this, SLOT(addServiceDone()));
-    connect(mServiceDiscoveryAgent, QOverload<QBluetoothServiceDiscoveryAgent::Error>::of(&QBluetoothServiceDiscoveryAgent::error),
-        [=](QBluetoothServiceDiscoveryAgent::Error error){ qDebug() << error; ui->servicesPushButton->setEnabled(true); });
-
-    mServiceDiscoveryAgent->start();
+    mServicesAddress = info.address();
+    mSdpPool->lookup(info.address());
 }
 
 void MainWindow::on_connectPushButton_clicked()
@@ -470,16 +492,26 @@ void MainWindow::on_connectPushButton_clicked()
 void MainWindow::on_bleConnectPushButton_clicked()
 {
     //QBluetoothDeviceInfo dev = ui->devicesListWidget->currentItem()->data(Qt::UserRole).value<QBluetoothDeviceInfo>();
-    int row = ui->devicesTableWidget->currentRow();
-    QTableWidgetItem *it = ui->devicesTableWidget->item(row, 0);
+    QBluetoothDeviceInfo dev = mDeviceModel->device(ui->devicesTableView->currentIndex().row());
 
-    if (!it) {
+    if (!dev.isValid()) {
         qDebug() << "No device selected!";
         return;
     }
 
-    QBluetoothDeviceInfo dev = it->data(Qt::UserRole).value<QBluetoothDeviceInfo>();
+    if (mBLEControl) {
+        mLinkManager->userDisconnect();
+        mBLEControl->disconnect(this);
+        mBLEControl->disconnectFromDevice();
+        mBLEControl->deleteLater();
+        resetBleServices();
+        mUartWanted = false;
+    }
+
     mBLEControl = QLowEnergyController::createCentral(dev, this);
+    mWriteEngine->clear();
+    mWriteEngine->setController(mBLEControl);
+    mLinkManager->attach(mBLEControl);
 
     connect(mBLEControl, &QLowEnergyController::serviceDiscovered,
             this, &MainWindow::bleServiceDiscovered);
@@ -493,7 +525,10 @@ void MainWindow::on_bleConnectPushButton_clicked()
     });
 
     connect(mBLEControl, &QLowEnergyController::disconnected, this, [this]() {
-        (void) this; qDebug() << "Disconnected from BLE device!";
+        qDebug() << "Disconnected from BLE device!";
+        // Services of the old link are stale, they are rediscovered
+        // (and the uart reattached) if the link manager reconnects.
+        resetBleServices();
     });
 
     mBLEControl->connectToDevice();
@@ -502,8 +537,21 @@ void MainWindow::on_bleConnectPushButton_clicked()
 
 void MainWindow::on_bleDisconnectPushButton_clicked()
 {
+    if (!mBLEControl) return;
+
+    mLinkManager->userDisconnect();
+    mUartWanted = false;
     mBLEControl->disconnectFromDevice();
 
+    resetBleServices();
+}
+
+void MainWindow::resetBleServices()
+{
+    mWriteEngine->clear();
+    mUartWrites.clear();
+    mBLEUartService = nullptr;
+
     //ui->bleServicesListWidget->clear();
     ui->bleServicesTreeWidget->clear();
     //ui->bleCharacteristicsListWidget->clear();
@@ -536,22 +584,65 @@ void MainWindow::on_bleCharacteristicReadPushButton_clicked()
     }
 }
 
+// The top-level item of the services tree holds the service.
+static QLowEnergyService *serviceForItem(QTreeWidgetItem *it)
+{
+    QTreeWidgetItem *p = it;
+
+    while (p->parent() != nullptr) {
+        p = p->parent();
+    }
+
+    if (!(p->data(1, Qt::UserRole).canConvert<QLowEnergyService*>())) return nullptr;
+
+    return p->data(1, Qt::UserRole).value<QLowEnergyService*>();
+}
+
 void MainWindow::on_bleCharacteristicWritePushButton_clicked()
 {
-    qDebug() << "not implemented";
+    bool ok;
+    int type = ui->bleCharacteristicReadTypeComboBox->currentIndex();
+    QByteArray value = encodeCharacteristicValue(type, ui->bleCharacteristicWriteLineEdit->text(), &ok);
+
+    if (!ok) {
+        ui->outputPlainTextEdit->appendPlainText("Value does not match the selected type");
+        return;
+    }
+
+    BleWriteEngine::WriteMode mode =
+            (BleWriteEngine::WriteMode)ui->bleCharacteristicWriteModeComboBox->currentIndex();
+
+    // Every selected characteristic gets the value, the writes are queued
+    // and pipelined by the write engine.
+    for (QTreeWidgetItem *it : ui->bleServicesTreeWidget->selectedItems()) {
+        if (!it->data(0, Qt::UserRole).canConvert<QLowEnergyCharacteristic>()) continue;
+
+        QLowEnergyCharacteristic ch = it->data(0,Qt::UserRole).value<QLowEnergyCharacteristic>();
+        QLowEnergyService *s = serviceForItem(it);
+
+        if (!s) continue;
+
+        if (mWriteEngine->enqueue(s, ch, value, mode) < 0) {
+            ui->outputPlainTextEdit->appendPlainText(
+                        QString("%1 does not support this kind of write").arg(ch.uuid().toString()));
+        }
+    }
 }
 
 void MainWindow::on_scanPeriodicallyCheckBox_clicked(bool checked)
 {
-    if (!mDiscoveryAgent->isActive() && checked) {
-        QTimer::singleShot(1000, [this]{
-            ui->scanningIndicatorLabel->setText("Scanning");
-            mDiscoveryAgent->start();});
+    // Until the agent exists deviceDiscoveryFinished picks the checkbox up.
+    if (!mDiscoveryAgent) return;
+
+    if (!mDiscoveryRunning && checked) {
+        startDiscovery(1000);
     }
 }
 
 void MainWindow::on_ttyConnectPushButton_clicked()
 {
+    serialPort();
+
     if (mNRF52SerialPort->isOpen()) {
         mNRF52SerialPort->close();
     }
@@ -590,7 +681,7 @@ void MainWindow::on_NRF52SerialReadyRead()
 
 void MainWindow::on_consoleSendPushButton_clicked()
 {
-    if( mNRF52SerialPort->isOpen()) {
+    if (mNRF52SerialPort && mNRF52SerialPort->isOpen()) {
 
         QString str = ui->consoleInputLineEdit->text();
         ui->consoleInputLineEdit->clear();
@@ -603,8 +694,72 @@ void MainWindow::on_consoleSendPushButton_clicked()
 void MainWindow::on_scriptDirBrowsePushButton_clicked()
 {
     QString str = QFileDialog::getExistingDirectory(nullptr, ("Select Output Folder"), QDir::currentPath());
-    if (!str.isEmpty())
+    if (!str.isEmpty()) {
         ui->scriptDirLineEdit->setText(str);
+        indexScriptDir(false);
+    }
+}
+
+static QStringList scanScriptDir(const QString &dir)
+{
+    QStringList scripts;
+    QDirIterator it(dir, QStringList() << "*.lisp" << "*.lsp",
+                    QDir::Files, QDirIterator::Subdirectories);
+
+    while (it.hasNext()) {
+        scripts << QDir(dir).relativeFilePath(it.next());
+    }
+    scripts.sort();
+    return scripts;
+}
+
+void MainWindow::indexScriptDir(bool force)
+{
+    QString dir = ui->scriptDirLineEdit->text();
+
+    if (dir.isEmpty()) return;
+    if (mScriptIndexWatcher && mScriptIndexWatcher->isRunning()) return;
+
+    if (!force && mScriptIndexCache.contains(dir)) {
+        ui->scripstsListWidget->clear();
+        ui->scripstsListWidget->addItems(mScriptIndexCache.value(dir));
+        return;
+    }
+
+    if (!mScriptIndexWatcher) {
+        mScriptIndexWatcher = new QFutureWatcher<QStringList>(this);
+        connect(mScriptIndexWatcher, &QFutureWatcher<QStringList>::finished,
+                this, &MainWindow::scriptIndexReady);
+    }
+    mScriptIndexDir = dir;
+    mScriptIndexWatcher->setFuture(QtConcurrent::run(scanScriptDir, dir));
+}
+
+void MainWindow::scriptIndexReady()
+{
+    QStringList scripts = mScriptIndexWatcher->result();
+
+    mScriptIndexCache.insert(mScriptIndexDir, scripts);
+
+    if (ui->scriptDirLineEdit->text() == mScriptIndexDir) {
+        ui->scripstsListWidget->clear();
+        ui->scripstsListWidget->addItems(scripts);
+    } else {
+        indexScriptDir(false);
+    }
+}
+
+void MainWindow::on_scriptsRefreshPushButton_clicked()
+{
+    indexScriptDir(true);
+}
+
+void MainWindow::on_tabWidget_2_currentChanged(int index)
+{
+    // The script list is only needed once the USB Lisp tab is shown.
+    if (ui->tabWidget_2->widget(index) == ui->tab_4) {
+        indexScriptDir(false);
+    }
 }
 
 void MainWindow::on_bleServicesTreeWidget_currentItemChanged(QTreeWidgetItem *current, QTreeWidgetItem *previous)
@@ -665,25 +820,23 @@ void MainWindow::on_bleUartConnectPushButton_clicked()
     if (!it) return;
 
     // the root service here should be of ble uart type.
-    QTreeWidgetItem *p = it;
-
-    while (p->parent() != nullptr) {
-        p = p->parent();
-    }
+    QLowEnergyService *s = serviceForItem(it);
 
-    if (!(p->data(1, Qt::UserRole).canConvert<QLowEnergyService*>())) {
+    if (!s) {
         qDebug() << "root of tree is not a service!";
         return;
     }
-    QLowEnergyService *s = p->data(1, Qt::UserRole).value<QLowEnergyService*>();
 
-    mBLEUartService = s;
+    mUartWanted = attachBleUart(s);
+}
 
+bool MainWindow::attachBleUart(QLowEnergyService *s)
+{
     QList<QLowEnergyCharacteristic> chs =  s->characteristics();
 
     if (chs.size() != 2) {
         qDebug() << "Ble uart service should have exactly 2 characteristics";
-        return;
+        return false;
     }
 
     QLowEnergyCharacteristic rx;
@@ -697,9 +850,11 @@ void MainWindow::on_bleUartConnectPushButton_clicked()
         qDebug() << chs[0].uuid().toString();
         qDebug() << chs[1].uuid().toString();
         qDebug() << "Probably not a proper uart!";
-        return;
+        return false;
     }
 
+    mBLEUartService = s;
+
     QLowEnergyDescriptor desc = rx.descriptor(QBluetoothUuid::ClientCharacteristicConfiguration);
 
     if (desc.isValid()) {
@@ -708,6 +863,7 @@ void MainWindow::on_bleUartConnectPushButton_clicked()
     } else {
         qDebug() << "Rx Characteristc descriptor is invalid!";
     }
+    return true;
 }
 
 void MainWindow::on_bleUartSendPushButton_clicked()
@@ -733,10 +889,15 @@ void MainWindow::on_bleUartSendPushButton_clicked()
         }
         if (tx.isValid()) {
             QByteArray ba = ui->bleUartInputLineEdit->text().append("\n").toLocal8Bit();
-            while (ba.size() > 0) {
-                qDebug() << "ba = " << QString(ba);
-                mBLEUartService->writeCharacteristic(tx, ba.mid(0,20), QLowEnergyService::WriteWithoutResponse);
-                ba = ba.mid(20,-1);
+            // The uart tx only takes plain write requests (no prepare
+            // writes), split the line. The firmware refuses a write
+            // while its receive ring is full, those are sent again in
+            // order, one write in flight at a time.
+            int chunk = mWriteEngine->maxPayload();
+            for (int i = 0; i < ba.size(); i += chunk) {
+                int id = mWriteEngine->enqueue(mBLEUartService, tx, ba.mid(i, chunk),
+                                               BleWriteEngine::WriteRequest, true);
+                if (id >= 0) mUartWrites.insert(id);
             }
         }
 
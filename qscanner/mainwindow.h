@@ -33,6 +33,10 @@
 #include <qlowenergycharacteristicdata.h>
 
 #include <QTimer>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QSerialPort>
 #include <QSerialPortInfo>
 #include <QScrollBar>
@@ -40,6 +44,11 @@
 #include <QFileDialog>
 #include <QTreeWidgetItem>
 
+#include "blewriteengine.h"
+#include "blelinkmanager.h"
+#include "sdpdiscoverypool.h"
+#include "devicetablemodel.h"
+
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
@@ -61,7 +70,7 @@ public slots:
     void deviceDiscoveryError(QBluetoothDeviceDiscoveryAgent::Error error);
     void deviceDiscoveryCanceled();
     void addService(QBluetoothServiceInfo info);
-    void addServiceError(QBluetoothDeviceDiscoveryAgent::Error);
+    void addServiceError(QBluetoothServiceDiscoveryAgent::Error);
     void addServiceDone();
     void socketRead();
     void socketConnected();
@@ -73,6 +82,10 @@ public slots:
                                   const QByteArray &value);
     void bleServiceCharacteristicRead(const QLowEnergyCharacteristic &info,
                                       const QByteArray &value);
+    void scriptIndexReady();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
 
 private slots:
     void on_servicesPushButton_clicked();
@@ -94,19 +107,55 @@ private slots:
 
     void on_bleUartSendPushButton_clicked();
 
+    void on_scriptsRefreshPushButton_clicked();
+    void on_tabWidget_2_currentChanged(int index);
+
 private:
+    void startupTrace(const QString &what);
+    void initBluetooth();
+    void bluetoothReady(QBluetoothDeviceDiscoveryAgent *agent);
+    void startDiscovery(int delay_ms);
+    QSerialPort *serialPort();
+    void indexScriptDir(bool force);
+    void resetBleServices();
+    bool attachBleUart(QLowEnergyService *s);
+
     Ui::MainWindow *ui;
 
+    // The discovery agent lives in mBluetoothThread, creating it talks to
+    // BlueZ and can block for seconds. Use startDiscovery() to (re)start it.
+    QThread *mBluetoothThread = nullptr;
     QBluetoothDeviceDiscoveryAgent *mDiscoveryAgent = nullptr;
-    QBluetoothServiceDiscoveryAgent *mServiceDiscoveryAgent = nullptr;
+    // Set by startDiscovery, cleared by the agent's queued finished,
+    // error and canceled signals. Includes a start that is still waiting
+    // out its delay. The agent itself is not asked from this thread.
+    bool mDiscoveryRunning = false;
+    DeviceTableModel *mDeviceModel = nullptr;
+
+    SdpDiscoveryPool *mSdpPool = nullptr;
+    QBluetoothAddress mServicesAddress;
     QBluetoothSocket *mSocket = nullptr;
 
     QLowEnergyController *mBLEControl = nullptr;
     QLowEnergyService    *mBLEService = nullptr;
 
     QLowEnergyService    *mBLEUartService = nullptr;
+    bool mUartWanted = false;
+
+    BleLinkManager *mLinkManager = nullptr;
+
+    BleWriteEngine *mWriteEngine = nullptr;
+    QSet<int> mUartWrites;
+
+    QSerialPort *mNRF52SerialPort = nullptr;
+
+    QElapsedTimer mStartupTimer;
+    bool mFirstPaintDone = false;
+    bool mScanningTraced = false;
 
-    QSerialPort *mNRF52SerialPort;
+    QFutureWatcher<QStringList> *mScriptIndexWatcher = nullptr;
+    QHash<QString, QStringList> mScriptIndexCache;
+    QString mScriptIndexDir;
 
 
 };
@@ -1,5 +1,6 @@
 QT       += core gui
 QT       += bluetooth serialport
+QT       += concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -16,12 +17,27 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# The AD structure decoder is shared with the command line scanner.
+INCLUDEPATH += ../scanner
+
 SOURCES += \
+    ../scanner/ad_decoder.c \
+    blelinkmanager.cpp \
+    blewriteengine.cpp \
+    characteristicvalue.cpp \
+    devicetablemodel.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    sdpdiscoverypool.cpp
 
 HEADERS += \
-    mainwindow.h
+    ../scanner/ad_decoder.h \
+    blelinkmanager.h \
+    blewriteengine.h \
+    characteristicvalue.h \
+    devicetablemodel.h \
+    mainwindow.h \
+    sdpdiscoverypool.h
 
 FORMS += \
     mainwindow.ui
@@ -0,0 +1,164 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sdpdiscoverypool.h"
+
+#include <QDebug>
+
+SdpDiscoveryPool::SdpDiscoveryPool(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void SdpDiscoveryPool::setMaxConcurrent(int n)
+{
+    mMaxConcurrent = n > 0 ? n : 1;
+}
+
+void SdpDiscoveryPool::setTtl(int ms)
+{
+    mTtl = ms;
+}
+
+void SdpDiscoveryPool::setMaxCached(int n)
+{
+    mMaxCached = n > 0 ? n : 1;
+}
+
+void SdpDiscoveryPool::lookup(const QBluetoothAddress &address, bool refresh)
+{
+    quint64 key = address.toUInt64();
+
+    if (!refresh && mCache.contains(key)) {
+        CacheEntry &e = mCache[key];
+        if (e.age.elapsed() < mTtl) {
+            e.used = ++ mUseCount;
+            for (const QBluetoothServiceInfo &info : e.services) {
+                emit serviceDiscovered(address, info);
+            }
+            emit finished(address, true);
+            return;
+        }
+        mCache.remove(key);
+    }
+
+    // Already being looked up, the caller gets the results of that query.
+    if (mCollecting.contains(key) || mPending.contains(key)) return;
+
+    mPending.enqueue(key);
+    startNext();
+}
+
+void SdpDiscoveryPool::invalidate(const QBluetoothAddress &address)
+{
+    mCache.remove(address.toUInt64());
+}
+
+QBluetoothServiceDiscoveryAgent *SdpDiscoveryPool::takeAgent()
+{
+    if (!mIdle.isEmpty()) return mIdle.takeLast();
+    if (mAgents >= mMaxConcurrent) return nullptr;
+
+    QBluetoothServiceDiscoveryAgent *agent = new QBluetoothServiceDiscoveryAgent(this);
+    mAgents ++;
+
+    connect(agent, &QBluetoothServiceDiscoveryAgent::serviceDiscovered,
+            this, [this, agent](const QBluetoothServiceInfo &info) {
+        quint64 key = mBusy.value(agent);
+        mCollecting[key].append(info);
+        emit serviceDiscovered(QBluetoothAddress(key), info);
+    });
+    connect(agent, &QBluetoothServiceDiscoveryAgent::finished,
+            this, [this, agent]() {
+        if (!mBusy.contains(agent)) return;
+        quint64 key = mBusy.value(agent);
+
+        cache(key, mCollecting.take(key));
+
+        release(agent);
+        emit finished(QBluetoothAddress(key), false);
+        startNext();
+    });
+    connect(agent, QOverload<QBluetoothServiceDiscoveryAgent::Error>::of(&QBluetoothServiceDiscoveryAgent::error),
+            this, [this, agent](QBluetoothServiceDiscoveryAgent::Error err) {
+        if (!mBusy.contains(agent)) return;
+        quint64 key = mBusy.value(agent);
+
+        // Partial results are not cached.
+        mCollecting.remove(key);
+        release(agent);
+        emit error(QBluetoothAddress(key), err);
+        startNext();
+    });
+
+    return agent;
+}
+
+void SdpDiscoveryPool::cache(quint64 key, const QList<QBluetoothServiceInfo> &services)
+{
+    for (auto it = mCache.begin(); it != mCache.end(); ) {
+        if (it.value().age.elapsed() >= mTtl) {
+            it = mCache.erase(it);
+        } else {
+            ++ it;
+        }
+    }
+
+    mCache.remove(key);
+    while (mCache.size() >= mMaxCached) {
+        auto oldest = mCache.begin();
+        for (auto it = mCache.begin(); it != mCache.end(); ++ it) {
+            if (it.value().used < oldest.value().used) oldest = it;
+        }
+        mCache.erase(oldest);
+    }
+
+    CacheEntry e;
+    e.services = services;
+    e.age.start();
+    e.used = ++ mUseCount;
+    mCache.insert(key, e);
+}
+
+void SdpDiscoveryPool::release(QBluetoothServiceDiscoveryAgent *agent)
+{
+    mBusy.remove(agent);
+    if (agent->isActive()) agent->stop();
+    mIdle.append(agent);
+}
+
+void SdpDiscoveryPool::startNext()
+{
+    while (!mPending.isEmpty()) {
+        QBluetoothServiceDiscoveryAgent *agent = takeAgent();
+        if (!agent) return;
+
+        quint64 key = mPending.dequeue();
+
+        agent->clear();
+        if (!agent->setRemoteAddress(QBluetoothAddress(key))) {
+            qDebug() << "wrong device address";
+            mIdle.append(agent);
+            emit error(QBluetoothAddress(key), agent->error());
+            continue;
+        }
+
+        mBusy.insert(agent, key);
+        mCollecting.insert(key, QList<QBluetoothServiceInfo>());
+        agent->start();
+    }
+}
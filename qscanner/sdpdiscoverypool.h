@@ -0,0 +1,82 @@
+/*
+    Copyright 2019 Joel Svensson	svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SDPDISCOVERYPOOL_H
+#define SDPDISCOVERYPOOL_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QQueue>
+#include <QElapsedTimer>
+
+#include <qbluetoothaddress.h>
+#include <qbluetoothservicediscoveryagent.h>
+#include <qbluetoothserviceinfo.h>
+
+// Classic (SDP) service lookups through a small pool of reused discovery
+// agents. At most maxConcurrent lookups run at once, the rest are queued.
+// Results are cached per address for ttl milliseconds, a lookup hitting
+// the cache is answered immediately without touching the radio. Expired
+// entries are pruned whenever a result is added and at most maxCached
+// addresses are kept, the least recently used one goes first.
+class SdpDiscoveryPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SdpDiscoveryPool(QObject *parent = nullptr);
+
+    void setMaxConcurrent(int n);
+    void setTtl(int ms);
+    void setMaxCached(int n);
+
+    void lookup(const QBluetoothAddress &address, bool refresh = false);
+    void invalidate(const QBluetoothAddress &address);
+
+signals:
+    void serviceDiscovered(const QBluetoothAddress &address, const QBluetoothServiceInfo &info);
+    void finished(const QBluetoothAddress &address, bool cached);
+    void error(const QBluetoothAddress &address, QBluetoothServiceDiscoveryAgent::Error error);
+
+private:
+    struct CacheEntry {
+        QList<QBluetoothServiceInfo> services;
+        QElapsedTimer age;
+        quint64 used;
+    };
+
+    QBluetoothServiceDiscoveryAgent *takeAgent();
+    void startNext();
+    void release(QBluetoothServiceDiscoveryAgent *agent);
+    void cache(quint64 key, const QList<QBluetoothServiceInfo> &services);
+
+    int mMaxConcurrent = 2;
+    int mTtl = 5 * 60 * 1000;
+    int mMaxCached = 256;
+    quint64 mUseCount = 0;
+
+    QList<QBluetoothServiceDiscoveryAgent *> mIdle;
+    QHash<QBluetoothServiceDiscoveryAgent *, quint64> mBusy;
+    int mAgents = 0;
+
+    QQueue<quint64> mPending;
+    QHash<quint64, QList<QBluetoothServiceInfo>> mCollecting;
+    QHash<quint64, CacheEntry> mCache;
+};
+
+#endif // SDPDISCOVERYPOOL_H
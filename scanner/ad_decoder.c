@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "ad_decoder.h"
+
+typedef enum {
+  KIND_NONE = 0,
+  KIND_FLAGS,
+  KIND_UUID16,
+  KIND_UUID32,
+  KIND_UUID128,
+  KIND_NAME,
+  KIND_TX_POWER,
+  KIND_SERVICE_DATA,
+  KIND_MANUFACTURER
+} ad_kind_t;
+
+/* How each AD type is decoded. For UUID lists elem is the UUID size and
+   the value has to be a whole number of them, for service data it is
+   the size of the leading UUID. */
+typedef struct {
+  uint8_t kind;
+  uint8_t min_len;
+  uint8_t elem;
+} ad_desc_t;
+
+static const ad_desc_t ad_types[256] = {
+  [AD_FLAGS]             = { KIND_FLAGS,        1,  0 },
+  [AD_UUID16_SOME]       = { KIND_UUID16,       2,  2 },
+  [AD_UUID16_ALL]        = { KIND_UUID16,       0,  2 },
+  [AD_UUID32_SOME]       = { KIND_UUID32,       4,  4 },
+  [AD_UUID32_ALL]        = { KIND_UUID32,       0,  4 },
+  [AD_UUID128_SOME]      = { KIND_UUID128,      16, 16 },
+  [AD_UUID128_ALL]       = { KIND_UUID128,      0,  16 },
+  [AD_NAME_SHORT]        = { KIND_NAME,         0,  0 },
+  [AD_NAME_COMPLETE]     = { KIND_NAME,         0,  0 },
+  [AD_TX_POWER]          = { KIND_TX_POWER,     1,  0 },
+  [AD_SERVICE_DATA16]    = { KIND_SERVICE_DATA, 2,  2 },
+  [AD_SERVICE_DATA32]    = { KIND_SERVICE_DATA, 4,  4 },
+  [AD_SERVICE_DATA128]   = { KIND_SERVICE_DATA, 16, 16 },
+  [AD_MANUFACTURER_DATA] = { KIND_MANUFACTURER, 2,  0 },
+};
+
+bool ad_iter_next(ad_iter_t *it, ad_field_t *field) {
+  if (it->end - it->p < 2) return false;
+
+  uint8_t len = it->p[0];
+  if (len == 0 || it->end - it->p < 1 + len) return false;
+
+  field->type = it->p[1];
+  field->value.data = it->p + 2;
+  field->value.len = len - 1;
+
+  it->p += 1 + len;
+  return true;
+}
+
+static bool add_view(ad_view_t *views, uint8_t *num, const ad_view_t *v) {
+  if (*num >= AD_MAX_VIEWS) return false;
+  views[(*num) ++] = *v;
+  return true;
+}
+
+int ad_decode(const uint8_t *data, size_t len, ad_info_t *info) {
+  ad_iter_t it;
+  ad_field_t f;
+
+  memset(info, 0, sizeof(ad_info_t));
+  ad_iter_init(&it, data, len);
+
+  while (ad_iter_next(&it, &f)) {
+    const ad_desc_t *desc = &ad_types[f.type];
+    bool ok = true;
+
+    info->num_fields ++;
+    if (desc->kind == KIND_NONE) continue;
+
+    if (f.value.len < desc->min_len) {
+      info->dropped ++;
+      continue;
+    }
+
+    switch (desc->kind) {
+    case KIND_FLAGS:
+      info->has_flags = true;
+      info->flags = f.value.data[0];
+      break;
+    case KIND_UUID16:
+    case KIND_UUID32:
+    case KIND_UUID128:
+      if (f.value.len % desc->elem) {
+	ok = false;
+      } else if (desc->kind == KIND_UUID16) {
+	ok = add_view(info->uuid16, &info->num_uuid16_views, &f.value);
+      } else if (desc->kind == KIND_UUID32) {
+	ok = add_view(info->uuid32, &info->num_uuid32_views, &f.value);
+      } else {
+	ok = add_view(info->uuid128, &info->num_uuid128_views, &f.value);
+      }
+      break;
+    case KIND_NAME:
+      /* a complete name wins over a shortened one */
+      if (!info->name.data || f.type == AD_NAME_COMPLETE) {
+	info->name = f.value;
+	info->name_complete = f.type == AD_NAME_COMPLETE;
+      }
+      break;
+    case KIND_TX_POWER:
+      info->has_tx_power = true;
+      info->tx_power = (int8_t)f.value.data[0];
+      break;
+    case KIND_SERVICE_DATA:
+      if (info->num_service_data < AD_MAX_VIEWS) {
+	ad_service_data_t *sd = &info->service_data[info->num_service_data ++];
+	sd->uuid = f.value.data;
+	sd->uuid_len = desc->elem;
+	sd->data.data = f.value.data + desc->elem;
+	sd->data.len = f.value.len - desc->elem;
+      } else {
+	ok = false;
+      }
+      break;
+    case KIND_MANUFACTURER:
+      if (info->num_manufacturer < AD_MAX_VIEWS) {
+	ad_manufacturer_data_t *md = &info->manufacturer[info->num_manufacturer ++];
+	md->company = ad_get_le16(f.value.data);
+	md->data.data = f.value.data + 2;
+	md->data.len = f.value.len - 2;
+      } else {
+	ok = false;
+      }
+      break;
+    }
+
+    if (!ok) info->dropped ++;
+  }
+
+  /* stopping on a length byte that is not padding means a field was cut */
+  info->truncated = it.p < it.end && it.p[0] != 0;
+  return info->num_fields;
+}
+
+void ad_uuid128_str(const uint8_t *uuid, char *out) {
+  /* the wire order is reversed compared to the text form */
+  static const int dash_after[] = { 3, 5, 7, 9 };
+  int d = 0;
+  char *o = out;
+
+  for (int i = 0; i < 16; i ++) {
+    o += sprintf(o, "%02x", uuid[15 - i]);
+    if (d < 4 && i == dash_after[d]) {
+      *o ++ = '-';
+      d ++;
+    }
+  }
+  *o = 0;
+}
+
+/* appends like snprintf but keeps counting once the buffer is full */
+static int append(char *buf, size_t size, int pos, const char *fmt, ...)
+  __attribute__((format(printf, 4, 5)));
+
+static int append(char *buf, size_t size, int pos, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf((size_t)pos < size ? buf + pos : NULL,
+		    (size_t)pos < size ? size - pos : 0, fmt, ap);
+  va_end(ap);
+  return n < 0 ? pos : pos + n;
+}
+
+int ad_format(const ad_info_t *info, char *buf, size_t size) {
+  char uuid[37];
+  int pos = 0;
+
+  if (size) buf[0] = 0;
+
+  if (info->has_flags)
+    pos = append(buf, size, pos, " flags=0x%02x", info->flags);
+  if (info->has_tx_power)
+    pos = append(buf, size, pos, " tx=%ddBm", info->tx_power);
+
+  for (int v = 0; v < info->num_uuid16_views; v ++) {
+    for (int i = 0; i < info->uuid16[v].len / 2; i ++) {
+      pos = append(buf, size, pos, " uuid=%04x", ad_uuid16(&info->uuid16[v], i));
+    }
+  }
+  for (int v = 0; v < info->num_uuid32_views; v ++) {
+    for (int i = 0; i < info->uuid32[v].len / 4; i ++) {
+      pos = append(buf, size, pos, " uuid=%08x", ad_uuid32(&info->uuid32[v], i));
+    }
+  }
+  for (int v = 0; v < info->num_uuid128_views; v ++) {
+    for (int i = 0; i < info->uuid128[v].len / 16; i ++) {
+      ad_uuid128_str(ad_uuid128(&info->uuid128[v], i), uuid);
+      pos = append(buf, size, pos, " uuid=%s", uuid);
+    }
+  }
+
+  for (int i = 0; i < info->num_service_data; i ++) {
+    const ad_service_data_t *sd = &info->service_data[i];
+    if (sd->uuid_len == 2) {
+      pos = append(buf, size, pos, " svc[%04x]=", ad_get_le16(sd->uuid));
+    } else if (sd->uuid_len == 4) {
+      pos = append(buf, size, pos, " svc[%08x]=", ad_get_le32(sd->uuid));
+    } else {
+      ad_uuid128_str(sd->uuid, uuid);
+      pos = append(buf, size, pos, " svc[%s]=", uuid);
+    }
+    for (int j = 0; j < sd->data.len; j ++) {
+      pos = append(buf, size, pos, "%02x", sd->data.data[j]);
+    }
+  }
+
+  for (int i = 0; i < info->num_manufacturer; i ++) {
+    const ad_manufacturer_data_t *md = &info->manufacturer[i];
+    pos = append(buf, size, pos, " mfg[%04x]=", md->company);
+    for (int j = 0; j < md->data.len; j ++) {
+      pos = append(buf, size, pos, "%02x", md->data.data[j]);
+    }
+  }
+
+  if (info->truncated) pos = append(buf, size, pos, " [truncated]");
+
+  /* no leading blank */
+  if (pos > 0 && size > 1) {
+    size_t n = strlen(buf);
+    memmove(buf, buf + 1, n);
+  }
+  return pos > 0 ? pos - 1 : 0;
+}
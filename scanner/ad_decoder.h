@@ -0,0 +1,141 @@
+#ifndef AD_DECODER_H
+#define AD_DECODER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Decoder for the length-type-value AD structures in advertising data
+ * and scan responses.
+ *
+ * Nothing is allocated or copied, every view points into the buffer that
+ * was decoded and is valid as long as that buffer is. Multi byte values
+ * inside views are little endian as on the air, use the accessors below.
+ */
+
+#define AD_FLAGS              0x01
+#define AD_UUID16_SOME        0x02
+#define AD_UUID16_ALL         0x03
+#define AD_UUID32_SOME        0x04
+#define AD_UUID32_ALL         0x05
+#define AD_UUID128_SOME       0x06
+#define AD_UUID128_ALL        0x07
+#define AD_NAME_SHORT         0x08
+#define AD_NAME_COMPLETE      0x09
+#define AD_TX_POWER           0x0a
+#define AD_SERVICE_DATA16     0x16
+#define AD_SERVICE_DATA32     0x20
+#define AD_SERVICE_DATA128    0x21
+#define AD_MANUFACTURER_DATA  0xff
+
+/* max number of fields of one kind that are kept, more are counted in
+   ad_info_t.dropped */
+#define AD_MAX_VIEWS 4
+
+typedef struct {
+  const uint8_t *data;
+  uint8_t len;
+} ad_view_t;
+
+/* A service data field, uuid is 2, 4 or 16 bytes */
+typedef struct {
+  const uint8_t *uuid;
+  uint8_t uuid_len;
+  ad_view_t data;
+} ad_service_data_t;
+
+typedef struct {
+  uint16_t company;
+  ad_view_t data;       /* without the company id */
+} ad_manufacturer_data_t;
+
+typedef struct {
+  bool has_flags;
+  uint8_t flags;
+
+  bool has_tx_power;
+  int8_t tx_power;      /* dBm */
+
+  ad_view_t name;       /* not null terminated */
+  bool name_complete;
+
+  /* UUID lists, one view per field of len / 2, len / 4 or len / 16 UUIDs */
+  ad_view_t uuid16[AD_MAX_VIEWS];
+  uint8_t num_uuid16_views;
+  ad_view_t uuid32[AD_MAX_VIEWS];
+  uint8_t num_uuid32_views;
+  ad_view_t uuid128[AD_MAX_VIEWS];
+  uint8_t num_uuid128_views;
+
+  ad_service_data_t service_data[AD_MAX_VIEWS];
+  uint8_t num_service_data;
+
+  ad_manufacturer_data_t manufacturer[AD_MAX_VIEWS];
+  uint8_t num_manufacturer;
+
+  uint8_t num_fields;   /* well formed fields seen, known or not */
+  uint8_t dropped;      /* known fields that did not fit or were malformed */
+  bool truncated;       /* a field ran past the end of the data */
+} ad_info_t;
+
+/* Raw walk over the structures */
+typedef struct {
+  const uint8_t *p;
+  const uint8_t *end;
+} ad_iter_t;
+
+typedef struct {
+  uint8_t type;
+  ad_view_t value;
+} ad_field_t;
+
+static inline void ad_iter_init(ad_iter_t *it, const uint8_t *data, size_t len) {
+  it->p = data;
+  it->end = data + len;
+}
+
+/* Returns false at the end of the data, on a zero length field (the rest
+   is padding) or when a field does not fit. */
+extern bool ad_iter_next(ad_iter_t *it, ad_field_t *field);
+
+/* Decodes all fields into info. Returns the number of fields. */
+extern int ad_decode(const uint8_t *data, size_t len, ad_info_t *info);
+
+static inline uint16_t ad_get_le16(const uint8_t *p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t ad_get_le32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+    ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Element i of a UUID list view */
+static inline uint16_t ad_uuid16(const ad_view_t *v, int i) {
+  return ad_get_le16(v->data + 2 * i);
+}
+
+static inline uint32_t ad_uuid32(const ad_view_t *v, int i) {
+  return ad_get_le32(v->data + 4 * i);
+}
+
+static inline const uint8_t *ad_uuid128(const ad_view_t *v, int i) {
+  return v->data + 16 * i;
+}
+
+/* Formats a 16 byte little endian UUID as text, out needs 37 bytes */
+extern void ad_uuid128_str(const uint8_t *uuid, char *out);
+
+/* Human readable one line summary of the decoded fields, except the name.
+   Returns the length as snprintf does. */
+extern int ad_format(const ad_info_t *info, char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,186 @@
+/* Micro-benchmark of the AD structure decoder.
+ *
+ * Decodes a corpus of advertising payloads over and over and reports the
+ * time per payload. Payloads come from a text corpus (hex, one per line)
+ * and/or the advertising reports in a btsnoop capture.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "ad_decoder.h"
+#include "btsnoop.h"
+#include "le_scan.h"
+
+typedef struct {
+  uint8_t *pool;        /* all payloads back to back */
+  size_t pool_len;
+  size_t pool_size;
+  uint32_t *offsets;    /* start of payload i, payload i ends at i + 1 */
+  uint32_t num;
+  uint32_t size;
+} corpus_t;
+
+static bool corpus_add(corpus_t *c, const uint8_t *data, int len) {
+  if (c->num + 2 > c->size) {
+    uint32_t size = c->size ? c->size * 2 : 1024;
+    uint32_t *o = realloc(c->offsets, size * sizeof(uint32_t));
+    if (!o) return false;
+    c->offsets = o;
+    c->size = size;
+  }
+  if (c->pool_len + len > c->pool_size) {
+    size_t size = c->pool_size ? c->pool_size * 2 : 32768;
+    while (size < c->pool_len + len) size *= 2;
+    uint8_t *p = realloc(c->pool, size);
+    if (!p) return false;
+    c->pool = p;
+    c->pool_size = size;
+  }
+  memcpy(c->pool + c->pool_len, data, len);
+  c->offsets[c->num ++] = c->pool_len;
+  c->pool_len += len;
+  c->offsets[c->num] = c->pool_len;
+  return true;
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static int load_text(corpus_t *c, const char *path) {
+  char line[1024];
+  uint8_t data[255];
+  int n = 0;
+
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror("Error opening corpus");
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), f)) {
+    int len = 0;
+    if (line[0] == '#') continue;
+
+    for (char *p = line; hex_value(p[0]) >= 0 && hex_value(p[1]) >= 0 &&
+	   len < (int)sizeof(data); p += 2) {
+      data[len ++] = (uint8_t)(hex_value(p[0]) << 4 | hex_value(p[1]));
+    }
+    if (len == 0) continue;
+    if (!corpus_add(c, data, len)) {
+      fclose(f);
+      return -1;
+    }
+    n ++;
+  }
+  fclose(f);
+  return n;
+}
+
+static void add_report(const le_adv_report_t *r, void *arg) {
+  corpus_add((corpus_t *)arg, r->data, r->data_len);
+}
+
+static int load_capture(corpus_t *c, const char *path) {
+  btsnoop_t snoop;
+  const uint8_t *evt;
+  int len;
+  uint64_t ts;
+  uint32_t before = c->num;
+
+  if (btsnoop_open(&snoop, path) < 0) return -1;
+  while (btsnoop_next_event(&snoop, &evt, &len, &ts) > 0) {
+    le_scan_process_event(evt, len, add_report, c);
+  }
+  btsnoop_close(&snoop);
+  return (int)(c->num - before);
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void usage(const char *prg) {
+  printf("Usage: %s [options] [corpus.txt ...]\n"
+	 "  -r <file>  add the advertising reports of a btsnoop capture\n"
+	 "  -n <n>     passes over the corpus (default 100000)\n"
+	 "  -v         print every payload of the corpus decoded once\n"
+	 "  -h         this help\n", prg);
+}
+
+int main(int argc, char **argv) {
+  corpus_t corpus = { 0 };
+  long passes = 100000;
+  bool verbose = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "r:n:vh")) != -1) {
+    switch (opt) {
+    case 'r':
+      if (load_capture(&corpus, optarg) < 0) return -1;
+      break;
+    case 'n':
+      passes = atol(optarg);
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    case 'h':
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : -1;
+    }
+  }
+
+  for (int i = optind; i < argc; i ++) {
+    if (load_text(&corpus, argv[i]) < 0) return -1;
+  }
+
+  if (corpus.num == 0) {
+    printf("Empty corpus\n");
+    return -1;
+  }
+
+  if (verbose) {
+    char buf[1024];
+    ad_info_t info;
+    for (uint32_t i = 0; i < corpus.num; i ++) {
+      ad_decode(corpus.pool + corpus.offsets[i], corpus.offsets[i + 1] - corpus.offsets[i], &info);
+      ad_format(&info, buf, sizeof(buf));
+      printf("%.*s: %s\n", info.name.len, info.name.data ? (const char *)info.name.data : "", buf);
+    }
+  }
+
+  /* the checksum keeps the decoding from being optimized away */
+  uint64_t check = 0;
+  ad_info_t info;
+
+  uint64_t start = now_ns();
+  for (long p = 0; p < passes; p ++) {
+    for (uint32_t i = 0; i < corpus.num; i ++) {
+      check += ad_decode(corpus.pool + corpus.offsets[i],
+			 corpus.offsets[i + 1] - corpus.offsets[i], &info);
+      check += info.num_uuid16_views + info.num_manufacturer + info.name.len;
+    }
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  double payloads = (double)passes * corpus.num;
+  double bytes = (double)passes * corpus.pool_len;
+  printf("%u payloads (%zu bytes), %ld passes: %.1f ns/payload, %.1f MB/s (check %llu)\n",
+	 corpus.num, corpus.pool_len, passes, elapsed / payloads,
+	 bytes / (elapsed / 1e9) / 1e6, (unsigned long long)check);
+
+  free(corpus.pool);
+  free(corpus.offsets);
+  return 0;
+}
@@ -0,0 +1,223 @@
+/* Synthetic HCI event generator.
+ *
+ * Writes a btsnoop capture (H4 datalink) of LE advertising report and
+ * extended inquiry result events from a pool of simulated devices, for
+ * running the scanner with -r without a Bluetooth adapter.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <getopt.h>
+
+#define EPOCH_OFFSET_US 0x00dcddb30f2f8000ULL
+
+#define H4_EVENT_PKT                 0x04
+#define EVT_LE_META_EVENT            0x3e
+#define EVT_LE_ADVERTISING_REPORT    0x02
+#define EVT_EXTENDED_INQUIRY_RESULT  0x2f
+
+#define ADV_INFO_SIZE 9    /* evt_type, addr_type, addr, length */
+#define EIR_SIZE 240
+
+typedef struct {
+  uint8_t addr[6];
+  int8_t rssi;
+} sim_device_t;
+
+static uint64_t rng_state = 88172645463325252ull;
+
+static uint64_t rng(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static uint32_t rng_below(uint32_t n) {
+  return (uint32_t)(rng() % n);
+}
+
+static void new_device(sim_device_t *d) {
+  uint64_t r = rng();
+  for (int i = 0; i < 6; i ++) d->addr[i] = (uint8_t)(r >> (8 * i));
+  d->addr[5] |= 0xc0;  /* static random address */
+  d->rssi = (int8_t)(-40 - (int)rng_below(55));
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static void put_be64(uint8_t *p, uint64_t v) {
+  put_be32(p, (uint32_t)(v >> 32));
+  put_be32(p + 4, (uint32_t)v);
+}
+
+static void write_record(FILE *f, const uint8_t *pkt, uint32_t len, uint64_t ts_us) {
+  uint8_t hdr[24];
+  put_be32(hdr, len);
+  put_be32(hdr + 4, len);
+  put_be32(hdr + 8, 3);  /* received, command/event */
+  put_be32(hdr + 12, 0);
+  put_be64(hdr + 16, ts_us + EPOCH_OFFSET_US);
+  fwrite(hdr, 1, sizeof(hdr), f);
+  fwrite(pkt, 1, len, f);
+}
+
+/* Advertising data of exactly len bytes: flags, a name and manufacturer
+   data filling the rest */
+static void fill_ad(uint8_t *p, int len, const sim_device_t *d) {
+  char name[16];
+  int n = snprintf(name, sizeof(name), "sim-%02x%02x", d->addr[1], d->addr[0]);
+  int i = 0;
+
+  memset(p, 0, len);
+  if (len - i >= 3) {
+    p[i ++] = 2; p[i ++] = 0x01; p[i ++] = 0x06;
+  }
+  if (len - i >= 2 + n) {
+    p[i ++] = n + 1; p[i ++] = 0x09;
+    memcpy(p + i, name, n);
+    i += n;
+  }
+  if (len - i >= 4) {
+    int m = len - i - 2;
+    p[i ++] = m + 1; p[i ++] = 0xff;
+    p[i ++] = 0x59; p[i ++] = 0x00;
+    for (int j = 2; j < m; j ++) p[i ++] = (uint8_t)rng();
+  }
+}
+
+static void usage(const char *prg) {
+  printf("Usage: %s [options] <out.snoop>\n"
+	 "  -n <n>        number of events (default 1000000)\n"
+	 "  -d <n>        devices in range at any time (default 10000)\n"
+	 "  -c <frac>     chance that a report comes from a new device that\n"
+	 "                replaces one in range (default 0.01)\n"
+	 "  -p <min:max>  advertising data bytes (default 3:31)\n"
+	 "  -r <n>        reports per LE event (default 1)\n"
+	 "  -i <percent>  share of extended inquiry results (default 0)\n"
+	 "  -t <us>       time between events (default 1000)\n"
+	 "  -s <seed>     random seed\n"
+	 "  -h            this help\n", prg);
+}
+
+int main(int argc, char **argv) {
+  long num_events = 1000000;
+  uint32_t num_devices = 10000;
+  double churn = 0.01;
+  int payload_min = 3, payload_max = 31;
+  int per_event = 1;
+  int inquiry_pct = 0;
+  uint64_t step_us = 1000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:d:c:p:r:i:t:s:h")) != -1) {
+    switch (opt) {
+    case 'n': num_events = atol(optarg); break;
+    case 'd': num_devices = (uint32_t)atol(optarg); break;
+    case 'c': churn = atof(optarg); break;
+    case 'p':
+      if (sscanf(optarg, "%d:%d", &payload_min, &payload_max) != 2) {
+	usage(argv[0]);
+	return -1;
+      }
+      break;
+    case 'r': per_event = atoi(optarg); break;
+    case 'i': inquiry_pct = atoi(optarg); break;
+    case 't': step_us = (uint64_t)atol(optarg); break;
+    case 's': rng_state = (uint64_t)atoll(optarg) * 2654435761ull + 1; break;
+    case 'h':
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : -1;
+    }
+  }
+
+  if (optind != argc - 1 || num_devices == 0 ||
+      payload_min < 0 || payload_max > 31 || payload_min > payload_max ||
+      per_event < 1 || per_event * (ADV_INFO_SIZE + payload_max + 1) + 2 > 255) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  sim_device_t *devices = malloc(num_devices * sizeof(sim_device_t));
+  if (!devices) {
+    printf("Error allocating memory\n");
+    return -1;
+  }
+  for (uint32_t i = 0; i < num_devices; i ++) new_device(&devices[i]);
+
+  FILE *f = fopen(argv[optind], "wb");
+  if (!f) {
+    perror("Error opening output");
+    free(devices);
+    return -1;
+  }
+  setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+  uint8_t hdr[16] = { 'b', 't', 's', 'n', 'o', 'o', 'p', 0 };
+  put_be32(hdr + 8, 1);
+  put_be32(hdr + 12, 1002);
+  fwrite(hdr, 1, sizeof(hdr), f);
+
+  uint8_t pkt[3 + 255];
+  uint64_t ts = 1700000000ull * 1000000;
+  uint32_t churn_limit = (uint32_t)(churn * 4294967295.0);
+
+  for (long e = 0; e < num_events; e ++, ts += step_us) {
+    bool inquiry = inquiry_pct > 0 && (int)rng_below(100) < inquiry_pct;
+    int reports = inquiry ? 1 : per_event;
+    uint8_t *first = pkt + (inquiry ? 4 : 5);
+    uint8_t *p = first;
+
+    for (int r = 0; r < reports; r ++) {
+      uint32_t ix = rng_below(num_devices);
+      sim_device_t *d = &devices[ix];
+      if ((uint32_t)rng() < churn_limit) new_device(d);
+
+      int8_t rssi = (int8_t)(d->rssi + (int)rng_below(9) - 4);
+
+      if (inquiry) {
+	memcpy(p, d->addr, 6);
+	p[6] = 1; p[7] = 0;                     /* page scan modes */
+	p[8] = 0x0c; p[9] = 0x02; p[10] = 0x5a; /* class of device */
+	p[11] = 0; p[12] = 0;                   /* clock offset */
+	p[13] = (uint8_t)rssi;
+	fill_ad(p + 14, EIR_SIZE, d);
+	p += 14 + EIR_SIZE;
+      } else {
+	int len = payload_min + (int)rng_below(payload_max - payload_min + 1);
+	p[0] = 0x00;  /* ADV_IND */
+	p[1] = 0x01;  /* random address */
+	memcpy(p + 2, d->addr, 6);
+	p[8] = (uint8_t)len;
+	fill_ad(p + 9, len, d);
+	p[9 + len] = (uint8_t)rssi;
+	p += ADV_INFO_SIZE + len + 1;
+      }
+    }
+
+    int plen;
+    pkt[0] = H4_EVENT_PKT;
+    if (inquiry) {
+      pkt[1] = EVT_EXTENDED_INQUIRY_RESULT;
+      pkt[3] = 1;
+      plen = 1 + (int)(p - first);
+    } else {
+      pkt[1] = EVT_LE_META_EVENT;
+      pkt[3] = EVT_LE_ADVERTISING_REPORT;
+      pkt[4] = (uint8_t)reports;
+      plen = 2 + (int)(p - first);
+    }
+    pkt[2] = (uint8_t)plen;
+    write_record(f, pkt, 3 + plen, ts);
+  }
+
+  fclose(f);
+  free(devices);
+  return 0;
+}
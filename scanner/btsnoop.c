@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "btsnoop.h"
+
+#define FILE_HDR_SIZE   16
+#define RECORD_HDR_SIZE 24
+
+/* timestamps count microseconds from year 0 */
+#define EPOCH_OFFSET_US 0x00dcddb30f2f8000ULL
+
+#define FLAG_RECEIVED   0x01
+#define FLAG_CMD_EVT    0x02
+
+#define H4_EVENT_PKT    0x04
+#define MONITOR_EVENT   0x0003
+
+static uint32_t get_be32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t get_be64(const uint8_t *p) {
+  return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+int btsnoop_open(btsnoop_t *s, const char *path) {
+  struct stat st;
+
+  memset(s, 0, sizeof(btsnoop_t));
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror("Error opening btsnoop file");
+    return -1;
+  }
+
+  if (fstat(fd, &st) < 0 || st.st_size < FILE_HDR_SIZE) {
+    printf("Error: %s is not a btsnoop file\n", path);
+    close(fd);
+    return -1;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror("Error mapping btsnoop file");
+    return -1;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  s->map = (const uint8_t *)map;
+  s->size = st.st_size;
+
+  if (memcmp(s->map, "btsnoop\0", 8) != 0 || get_be32(s->map + 8) != 1) {
+    printf("Error: %s is not a btsnoop version 1 file\n", path);
+    btsnoop_close(s);
+    return -1;
+  }
+
+  s->datalink = get_be32(s->map + 12);
+  if (s->datalink != BTSNOOP_HCI_H1 &&
+      s->datalink != BTSNOOP_HCI_H4 &&
+      s->datalink != BTSNOOP_HCI_MONITOR) {
+    printf("Error: unsupported btsnoop datalink %u\n", s->datalink);
+    btsnoop_close(s);
+    return -1;
+  }
+
+  s->pos = FILE_HDR_SIZE;
+  return 0;
+}
+
+void btsnoop_close(btsnoop_t *s) {
+  if (s->map) munmap((void *)s->map, s->size);
+  s->map = NULL;
+  s->size = 0;
+}
+
+int btsnoop_next_event(btsnoop_t *s, const uint8_t **evt, int *len, uint64_t *ts_ms) {
+
+  while (s->pos < s->size) {
+    if (s->size - s->pos < RECORD_HDR_SIZE) return -1;
+
+    const uint8_t *rec = s->map + s->pos;
+    uint32_t incl_len = get_be32(rec + 4);
+    uint32_t flags = get_be32(rec + 8);
+    uint64_t ts = get_be64(rec + 16);
+    const uint8_t *data = rec + RECORD_HDR_SIZE;
+
+    if (s->size - s->pos - RECORD_HDR_SIZE < incl_len) return -1;
+    s->pos += RECORD_HDR_SIZE + incl_len;
+
+    switch (s->datalink) {
+    case BTSNOOP_HCI_H1:
+      if ((flags & (FLAG_RECEIVED | FLAG_CMD_EVT)) != (FLAG_RECEIVED | FLAG_CMD_EVT)) continue;
+      break;
+    case BTSNOOP_HCI_H4:
+      if (incl_len < 1 || data[0] != H4_EVENT_PKT) continue;
+      data ++;
+      incl_len --;
+      break;
+    case BTSNOOP_HCI_MONITOR:
+      if ((flags & 0xffff) != MONITOR_EVENT) continue;
+      break;
+    }
+
+    *evt = data;
+    *len = (int)incl_len;
+    *ts_ms = ts > EPOCH_OFFSET_US ? (ts - EPOCH_OFFSET_US) / 1000 : 0;
+    return 1;
+  }
+  return 0;
+}
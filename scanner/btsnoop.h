@@ -0,0 +1,29 @@
+#ifndef BTSNOOP_H
+#define BTSNOOP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Datalink types of the btsnoop format */
+#define BTSNOOP_HCI_H1       1001  /* un-encapsulated, direction in flags */
+#define BTSNOOP_HCI_H4       1002  /* packet type byte in front */
+#define BTSNOOP_HCI_MONITOR  2001  /* btmon, opcode in flags */
+
+/* A btsnoop capture mapped into memory, records are read in place */
+typedef struct {
+  const uint8_t *map;
+  size_t size;
+  size_t pos;
+  uint32_t datalink;
+} btsnoop_t;
+
+extern int btsnoop_open(btsnoop_t *s, const char *path);
+extern void btsnoop_close(btsnoop_t *s);
+
+/* Steps to the next HCI event in the capture, other packets are skipped.
+   evt points to the event header (no packet type byte) inside the mapping
+   and ts_ms is the capture time in ms since the unix epoch.
+   Returns 1 for an event, 0 at the end of the file, -1 if it is truncated. */
+extern int btsnoop_next_event(btsnoop_t *s, const uint8_t **evt, int *len, uint64_t *ts_ms);
+
+#endif
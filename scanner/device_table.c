@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "device_table.h"
+
+#define MIN_SLOTS 1024
+
+static inline uint64_t addr_key(const bdaddr_t *addr) {
+  uint64_t k = 0;
+  for (int i = 0; i < 6; i ++) {
+    k |= (uint64_t)addr->b[i] << (8 * i);
+  }
+  return k;
+}
+
+static inline uint32_t hash_addr(const bdaddr_t *addr, uint32_t mask) {
+  /* Fibonacci hashing, the low address bytes are the random ones but
+     the multiplication spreads all of them into the top bits. */
+  uint64_t h = addr_key(addr) * 0x9E3779B97F4A7C15ull;
+  return (uint32_t)(h >> 32) & mask;
+}
+
+static uint32_t next_pow2(uint32_t n) {
+  uint32_t p = MIN_SLOTS;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+bool device_table_init(device_table_t *t, uint32_t size_hint) {
+  memset(t, 0, sizeof(device_table_t));
+
+  t->num_slots = next_pow2(size_hint * 2);
+  t->slots = calloc(t->num_slots, sizeof(uint32_t));
+  t->devices_size = t->num_slots / 2;
+  t->devices = malloc(t->devices_size * sizeof(device_t));
+
+  if (!t->slots || !t->devices) {
+    device_table_free(t);
+    return false;
+  }
+  return true;
+}
+
+void device_table_free(device_table_t *t) {
+  free(t->slots);
+  free(t->devices);
+  memset(t, 0, sizeof(device_table_t));
+}
+
+/* Returns the slot holding addr, or the empty slot where it would go */
+static uint32_t probe(device_table_t *t, const bdaddr_t *addr) {
+  uint32_t mask = t->num_slots - 1;
+  uint32_t s = hash_addr(addr, mask);
+
+  while (t->slots[s]) {
+    if (bacmp(&t->devices[t->slots[s] - 1].addr, addr) == 0) break;
+    s = (s + 1) & mask;
+  }
+  return s;
+}
+
+static bool grow(device_table_t *t) {
+  uint32_t new_num_slots = t->num_slots * 2;
+  uint32_t *new_slots = calloc(new_num_slots, sizeof(uint32_t));
+  device_t *new_devices = realloc(t->devices, (new_num_slots / 2) * sizeof(device_t));
+
+  if (!new_slots || !new_devices) {
+    free(new_slots);
+    if (new_devices) t->devices = new_devices;
+    return false;
+  }
+
+  free(t->slots);
+  t->slots = new_slots;
+  t->num_slots = new_num_slots;
+  t->devices = new_devices;
+  t->devices_size = new_num_slots / 2;
+
+  for (uint32_t i = 0; i < t->num_devices; i ++) {
+    t->slots[probe(t, &t->devices[i].addr)] = i + 1;
+  }
+  return true;
+}
+
+int32_t device_table_find(device_table_t *t, const bdaddr_t *addr) {
+  uint32_t s = probe(t, addr);
+  return t->slots[s] ? (int32_t)(t->slots[s] - 1) : -1;
+}
+
+int32_t device_table_sighting(device_table_t *t, const bdaddr_t *addr,
+			      int adapter, int8_t rssi,
+			      uint64_t now, bool *is_new) {
+  uint32_t s = probe(t, addr);
+
+  if (t->slots[s]) {
+    device_t *d = &t->devices[t->slots[s] - 1];
+    d->last_seen = now;
+    d->sightings ++;
+    d->adapters |= 1 << adapter;
+    d->rssi[adapter] = rssi;
+    d->rssi_seen[adapter] = (uint32_t)now;
+    *is_new = false;
+    return (int32_t)(t->slots[s] - 1);
+  }
+
+  /* keep the load factor at or below 1/2 */
+  if (t->num_devices + 1 > t->num_slots / 2) {
+    if (!grow(t)) return -1;
+    s = probe(t, addr);
+  }
+
+  uint32_t ix = t->num_devices++;
+  device_t *d = &t->devices[ix];
+  memset(d, 0, sizeof(device_t));
+  d->addr = *addr;
+  d->first_seen = now;
+  d->last_seen = now;
+  d->sightings = 1;
+  for (int i = 0; i < DEVICE_MAX_ADAPTERS; i ++) d->rssi[i] = DEVICE_RSSI_NONE;
+  d->adapters = 1 << adapter;
+  d->rssi[adapter] = rssi;
+  d->rssi_seen[adapter] = (uint32_t)now;
+  t->slots[s] = ix + 1;
+
+  *is_new = true;
+  return (int32_t)ix;
+}
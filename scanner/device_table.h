@@ -0,0 +1,75 @@
+#ifndef DEVICE_TABLE_H
+#define DEVICE_TABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <bluetooth/bluetooth.h>
+
+/* Set of seen devices keyed on the 6 byte bluetooth address.
+ *
+ * Devices live in a dense array and are referred to by index, the
+ * index of a device never changes. The hash part is an open addressing
+ * (linear probing) table of indices that is doubled when it gets half
+ * full, so there is no upper limit on the number of devices.
+ *
+ * Pointers returned by the functions below are valid until the next
+ * call to device_table_sighting, which may grow the array.
+ */
+
+/* Adapters are numbered 0 .. DEVICE_MAX_ADAPTERS - 1 by the caller */
+#define DEVICE_MAX_ADAPTERS 8
+
+/* RSSI value when none is known, as in HCI events */
+#define DEVICE_RSSI_NONE 127
+
+typedef struct {
+  bdaddr_t addr;
+  uint64_t first_seen; /* ms, monotonic */
+  uint64_t last_seen;
+  uint32_t sightings;
+  uint8_t adapters;    /* bit n set when adapter n has seen the device */
+  int8_t rssi[DEVICE_MAX_ADAPTERS]; /* latest RSSI per adapter */
+  uint32_t rssi_seen[DEVICE_MAX_ADAPTERS]; /* low 32 bits of its time */
+} device_t;
+
+typedef struct {
+  device_t *devices;
+  uint32_t num_devices;
+  uint32_t devices_size;
+
+  uint32_t *slots;      /* device index + 1, 0 marks an empty slot */
+  uint32_t num_slots;   /* power of two */
+} device_table_t;
+
+extern bool device_table_init(device_table_t *t, uint32_t size_hint);
+extern void device_table_free(device_table_t *t);
+
+/* Returns the index of the device or -1 if it has not been seen */
+extern int32_t device_table_find(device_table_t *t, const bdaddr_t *addr);
+
+/* Records a sighting by adapter at time now, adding the device if it is
+ * new. Returns the index of the device or -1 if out of memory. */
+extern int32_t device_table_sighting(device_table_t *t, const bdaddr_t *addr,
+				     int adapter, int8_t rssi,
+				     uint64_t now, bool *is_new);
+
+static inline device_t *device_table_get(device_table_t *t, int32_t ix) {
+  return &t->devices[ix];
+}
+
+/* Strongest RSSI over the adapters that have seen the device in the last
+ * max_age ms, DEVICE_RSSI_NONE if none is known. An adapter that lost
+ * the device keeps its last reading, which must not hide the readings
+ * of the adapters that still see it. Ages are compared in 32 bits,
+ * which is exact for ages below 49 days. */
+static inline int8_t device_best_rssi(const device_t *d, uint64_t now, uint32_t max_age) {
+  int8_t best = DEVICE_RSSI_NONE;
+  for (int i = 0; i < DEVICE_MAX_ADAPTERS; i ++) {
+    if (d->rssi[i] == DEVICE_RSSI_NONE) continue;
+    if ((uint32_t)now - d->rssi_seen[i] > max_age) continue;
+    if (best == DEVICE_RSSI_NONE || d->rssi[i] > best) best = d->rssi[i];
+  }
+  return best;
+}
+
+#endif
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/hci_lib.h>
+
+#include "event_filter.h"
+
+typedef struct {
+  const char *name;
+  uint32_t bit;
+} filter_name_t;
+
+static const filter_name_t filter_names[] = {
+  { "le",      EVENT_FILTER_LE },
+  { "inquiry", EVENT_FILTER_INQUIRY },
+  { "cmd",     EVENT_FILTER_CMD },
+  { "all",     EVENT_FILTER_ALL },
+};
+
+#define NUM_FILTER_NAMES (sizeof(filter_names) / sizeof(filter_names[0]))
+
+int event_filter_parse(const char *spec, uint32_t *mask) {
+  char buf[256];
+  char *save = NULL;
+
+  snprintf(buf, sizeof(buf), "%s", spec);
+  *mask = 0;
+
+  for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+    unsigned int i;
+    for (i = 0; i < NUM_FILTER_NAMES; i ++) {
+      if (strcmp(tok, filter_names[i].name) == 0) {
+	*mask |= filter_names[i].bit;
+	break;
+      }
+    }
+    if (i == NUM_FILTER_NAMES) return -1;
+  }
+  return 0;
+}
+
+int event_filter_apply(int sock, uint32_t mask) {
+  struct hci_filter filter;
+
+  hci_filter_clear(&filter);
+  hci_filter_set_ptype(HCI_EVENT_PKT, &filter);
+
+  if (mask & EVENT_FILTER_ALL) {
+    hci_filter_all_events(&filter);
+  }
+  if (mask & EVENT_FILTER_LE) {
+    hci_filter_set_event(EVT_LE_META_EVENT, &filter);
+  }
+  if (mask & EVENT_FILTER_INQUIRY) {
+    hci_filter_set_event(EVT_INQUIRY_RESULT, &filter);
+    hci_filter_set_event(EVT_INQUIRY_RESULT_WITH_RSSI, &filter);
+    hci_filter_set_event(EVT_EXTENDED_INQUIRY_RESULT, &filter);
+    hci_filter_set_event(EVT_INQUIRY_COMPLETE, &filter);
+  }
+  if (mask & EVENT_FILTER_CMD) {
+    hci_filter_set_event(EVT_CMD_COMPLETE, &filter);
+    hci_filter_set_event(EVT_CMD_STATUS, &filter);
+  }
+
+  if (setsockopt(sock, SOL_HCI, HCI_FILTER, &filter, sizeof(filter)) < 0) {
+    perror("Error setting hci filter");
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef EVENT_FILTER_H
+#define EVENT_FILTER_H
+
+#include <stdint.h>
+
+/* Groups of HCI events the scanner can ask the kernel to deliver.
+ *
+ * The kernel filter works on HCI event codes only, LE meta sub-events
+ * can not be told apart there and are sorted out in userspace.
+ */
+#define EVENT_FILTER_LE       0x01  /* LE meta (advertising reports) */
+#define EVENT_FILTER_INQUIRY  0x02  /* inquiry results and completion */
+#define EVENT_FILTER_CMD      0x04  /* command complete/status */
+#define EVENT_FILTER_ALL      0x80  /* no filtering */
+
+/* Parses a comma separated list of le, inquiry, cmd and all.
+   Returns -1 on an unknown name. */
+extern int event_filter_parse(const char *spec, uint32_t *mask);
+
+/* Installs the filter on an HCI socket */
+extern int event_filter_apply(int sock, uint32_t mask);
+
+#endif
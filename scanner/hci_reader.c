@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+
+#include "hci_reader.h"
+
+/* packet type byte in front of the largest event */
+#define SLOT_SIZE (HCI_MAX_EVENT_SIZE + 1)
+
+bool hci_reader_init(hci_reader_t *r) {
+  memset(r, 0, sizeof(hci_reader_t));
+
+  r->buf = (uint8_t *)malloc(HCI_READER_BATCH * SLOT_SIZE);
+  if (!r->buf) return false;
+
+  for (int i = 0; i < HCI_READER_BATCH; i ++) {
+    r->iov[i].iov_base = r->buf + i * SLOT_SIZE;
+    r->iov[i].iov_len = SLOT_SIZE;
+    r->msgs[i].msg_hdr.msg_iov = &r->iov[i];
+    r->msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  return true;
+}
+
+void hci_reader_free(hci_reader_t *r) {
+  free(r->buf);
+  r->buf = NULL;
+}
+
+int hci_reader_drain(hci_reader_t *r, int sock, hci_packet_cb cb, void *arg) {
+  int total = 0;
+
+  while (true) {
+    int n = recvmmsg(sock, r->msgs, HCI_READER_BATCH, MSG_DONTWAIT, NULL);
+    r->syscalls ++;
+
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) break;
+      perror("Error reading hci socket");
+      return -1;
+    }
+
+    for (int i = 0; i < n; i ++) {
+      cb((const uint8_t *)r->iov[i].iov_base, (int)r->msgs[i].msg_len, arg);
+    }
+    total += n;
+
+    /* a short batch means the queue is empty, saves the EAGAIN call */
+    if (n < HCI_READER_BATCH) break;
+  }
+  return total;
+}
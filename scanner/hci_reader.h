@@ -0,0 +1,32 @@
+#ifndef HCI_READER_H
+#define HCI_READER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/* Number of packets fetched per recvmmsg call */
+#define HCI_READER_BATCH 32
+
+/* Called for every packet, pkt starts with the packet type byte and is
+   only valid during the call. */
+typedef void (*hci_packet_cb)(const uint8_t *pkt, int len, void *arg);
+
+/* Reads packets from a non-blocking HCI socket in batches into one
+   buffer that is allocated once and reused for every batch. */
+typedef struct {
+  uint8_t *buf;
+  struct iovec iov[HCI_READER_BATCH];
+  struct mmsghdr msgs[HCI_READER_BATCH];
+  uint64_t syscalls;
+} hci_reader_t;
+
+extern bool hci_reader_init(hci_reader_t *r);
+extern void hci_reader_free(hci_reader_t *r);
+
+/* Reads until the socket is empty and calls cb for each packet.
+   Returns the number of packets or -1 on a read error. */
+extern int hci_reader_drain(hci_reader_t *r, int sock, hci_packet_cb cb, void *arg);
+
+#endif
@@ -0,0 +1,54 @@
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+
+#include "inquiry.h"
+
+/* The EIR is 240 bytes of AD structures padded with zeros */
+static uint8_t eir_len(const uint8_t *data, int size) {
+  int i = 0;
+  while (i < size && data[i] != 0 && i + 1 + data[i] <= size) i += 1 + data[i];
+  return (uint8_t)i;
+}
+
+int inquiry_process_event(const uint8_t *evt, int len, inquiry_report_cb cb, void *arg) {
+
+  if (len < HCI_EVENT_HDR_SIZE + 1) return -1;
+
+  const hci_event_hdr *hdr = (const hci_event_hdr *)evt;
+  const uint8_t *p = evt + HCI_EVENT_HDR_SIZE;
+  const uint8_t *end = p + hdr->plen;
+
+  if (end > evt + len) return -1;
+
+  int size;
+  switch (hdr->evt) {
+  case EVT_INQUIRY_RESULT:           size = INQUIRY_INFO_SIZE; break;
+  case EVT_INQUIRY_RESULT_WITH_RSSI: size = INQUIRY_INFO_WITH_RSSI_SIZE; break;
+  case EVT_EXTENDED_INQUIRY_RESULT:  size = EXTENDED_INQUIRY_INFO_SIZE; break;
+  default: return -1;
+  }
+
+  uint8_t num = p[0];
+  p ++;
+
+  int n;
+  for (n = 0; n < num && p + size <= end; n ++, p += size) {
+    inquiry_report_t r = { .rssi = 127, .data = NULL, .data_len = 0 };
+
+    if (hdr->evt == EVT_INQUIRY_RESULT) {
+      r.addr = &((const inquiry_info *)p)->bdaddr;
+    } else if (hdr->evt == EVT_INQUIRY_RESULT_WITH_RSSI) {
+      const inquiry_info_with_rssi *info = (const inquiry_info_with_rssi *)p;
+      r.addr = &info->bdaddr;
+      r.rssi = info->rssi;
+    } else {
+      const extended_inquiry_info *info = (const extended_inquiry_info *)p;
+      r.addr = &info->bdaddr;
+      r.rssi = info->rssi;
+      r.data = info->data;
+      r.data_len = eir_len(info->data, sizeof(info->data));
+    }
+    cb(&r, arg);
+  }
+  return n;
+}
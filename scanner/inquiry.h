@@ -0,0 +1,22 @@
+#ifndef INQUIRY_H
+#define INQUIRY_H
+
+#include <stdint.h>
+#include <bluetooth/bluetooth.h>
+
+/* A classic inquiry response as found in the three inquiry result events */
+typedef struct {
+  const bdaddr_t *addr;
+  int8_t rssi;          /* 127 for plain inquiry results */
+  const uint8_t *data;  /* extended inquiry response (AD structures) or NULL */
+  uint8_t data_len;
+} inquiry_report_t;
+
+typedef void (*inquiry_report_cb)(const inquiry_report_t *report, void *arg);
+
+/* Parses an HCI event without the packet type byte and calls cb for every
+   inquiry response in it. Returns the number of responses, -1 if the
+   event is not an inquiry result. */
+extern int inquiry_process_event(const uint8_t *evt, int len, inquiry_report_cb cb, void *arg);
+
+#endif
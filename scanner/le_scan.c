@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/hci_lib.h>
+
+#include "le_scan.h"
+
+#define HCI_TIMEOUT_MS 1000
+
+int le_scan_start(int sock, const le_scan_params_t *params, struct hci_filter *saved) {
+  socklen_t olen = sizeof(struct hci_filter);
+
+  if (getsockopt(sock, SOL_HCI, HCI_FILTER, saved, &olen) < 0) {
+    perror("Error reading hci filter");
+    return -1;
+  }
+
+  /* These run synchronous HCI requests on the socket, do them before it
+     is switched to non-blocking */
+  if (hci_le_set_scan_parameters(sock, params->active ? 0x01 : 0x00,
+				 htobs(params->interval), htobs(params->window),
+				 0x00, 0x00, HCI_TIMEOUT_MS) < 0) {
+    perror("Error setting LE scan parameters");
+    return -1;
+  }
+
+  if (hci_le_set_scan_enable(sock, 0x01, params->filter_dup ? 0x01 : 0x00,
+			     HCI_TIMEOUT_MS) < 0) {
+    perror("Error enabling LE scan");
+    return -1;
+  }
+
+  int flags = fcntl(sock, F_GETFL, 0);
+  if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+    perror("Error making hci socket non-blocking");
+    return -1;
+  }
+  return 0;
+}
+
+int le_scan_stop(int sock, const struct hci_filter *saved) {
+  int flags = fcntl(sock, F_GETFL, 0);
+  if (flags >= 0) fcntl(sock, F_SETFL, flags & ~O_NONBLOCK);
+
+  setsockopt(sock, SOL_HCI, HCI_FILTER, saved, sizeof(struct hci_filter));
+
+  if (hci_le_set_scan_enable(sock, 0x00, 0x00, HCI_TIMEOUT_MS) < 0) {
+    perror("Error disabling LE scan");
+    return -1;
+  }
+  return 0;
+}
+
+int le_scan_process(const uint8_t *buf, int len, le_adv_report_cb cb, void *arg) {
+
+  if (len < 1 || buf[0] != HCI_EVENT_PKT) return -1;
+
+  return le_scan_process_event(buf + 1, len - 1, cb, arg);
+}
+
+int le_scan_process_event(const uint8_t *evt, int len, le_adv_report_cb cb, void *arg) {
+
+  if (len < HCI_EVENT_HDR_SIZE) return -1;
+
+  const hci_event_hdr *hdr = (const hci_event_hdr *)evt;
+  const uint8_t *p = evt + HCI_EVENT_HDR_SIZE;
+  const uint8_t *end = p + hdr->plen;
+
+  if (end > evt + len) return -1;
+  if (hdr->evt != EVT_LE_META_EVENT || hdr->plen < 2) return -1;
+
+  const evt_le_meta_event *meta = (const evt_le_meta_event *)p;
+  if (meta->subevent != EVT_LE_ADVERTISING_REPORT) return -1;
+
+  uint8_t num_reports = meta->data[0];
+  p = meta->data + 1;
+
+  int n;
+  for (n = 0; n < num_reports; n ++) {
+    const le_advertising_info *info = (const le_advertising_info *)p;
+
+    /* header, data and the trailing rssi byte */
+    if (p + LE_ADVERTISING_INFO_SIZE > end ||
+	p + LE_ADVERTISING_INFO_SIZE + info->length + 1 > end) break;
+
+    le_adv_report_t r;
+    r.evt_type = info->evt_type;
+    r.addr_type = info->bdaddr_type;
+    r.addr = &info->bdaddr;
+    r.data = info->data;
+    r.data_len = info->length;
+    r.rssi = (int8_t)info->data[info->length];
+
+    cb(&r, arg);
+
+    p += LE_ADVERTISING_INFO_SIZE + info->length + 1;
+  }
+  return n;
+}
@@ -0,0 +1,46 @@
+#ifndef LE_SCAN_H
+#define LE_SCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+
+/* Scan interval and window are in units of 0.625 ms as on the wire */
+typedef struct {
+  uint16_t interval;
+  uint16_t window;
+  bool active;          /* send scan requests to get scan responses */
+  bool filter_dup;      /* let the controller drop duplicate reports */
+} le_scan_params_t;
+
+#define LE_SCAN_MS_TO_UNITS(ms) ((uint16_t)((ms) / 0.625))
+
+typedef struct {
+  uint8_t evt_type;     /* ADV_IND, ADV_NONCONN_IND, SCAN_RSP ... */
+  uint8_t addr_type;
+  const bdaddr_t *addr;
+  int8_t rssi;
+  const uint8_t *data;  /* advertising data, points into the event buffer */
+  uint8_t data_len;
+} le_adv_report_t;
+
+typedef void (*le_adv_report_cb)(const le_adv_report_t *report, void *arg);
+
+/* Configures and enables LE scanning on sock. On success the socket is
+   left non-blocking, the caller installs the event filter it wants.
+   The socket's filter is stored in saved, le_scan_stop puts it back. */
+extern int le_scan_start(int sock, const le_scan_params_t *params, struct hci_filter *saved);
+extern int le_scan_stop(int sock, const struct hci_filter *saved);
+
+/* Parses one HCI packet (starting with the packet type byte) and calls
+   cb for every advertising report in it. Returns the number of reports,
+   -1 if the packet was not an advertising report event. */
+extern int le_scan_process(const uint8_t *buf, int len, le_adv_report_cb cb, void *arg);
+
+/* Same as le_scan_process for an event without the packet type byte,
+   as stored in btsnoop captures. Nothing is copied, the reports point
+   into evt. */
+extern int le_scan_process_event(const uint8_t *evt, int len, le_adv_report_cb cb, void *arg);
+
+#endif
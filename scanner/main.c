@@ -1,93 +1,788 @@
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
 #include <bluetooth/hci_lib.h>
 
+#include "ad_decoder.h"
+#include "btsnoop.h"
+#include "device_table.h"
+#include "event_filter.h"
+#include "hci_reader.h"
+#include "inquiry.h"
+#include "le_scan.h"
+#include "name_resolver.h"
+#include "output.h"
+#include "presence.h"
+
+#define NAME_QUEUE_SIZE 256
+#define MAX_ADAPTERS DEVICE_MAX_ADAPTERS
+#define PRESENCE_TICK_MS 250
+#define OUTPUT_BUF_SIZE (256 * 1024)
 
 typedef struct {
-  bdaddr_t addr; 
-} device;
+  int dev_id;
+  int sock;
+  char name[8];         /* hciN */
+  struct hci_filter saved_filter; /* restored when the LE scan stops */
+} adapter_t;
 
+static volatile sig_atomic_t running = 1;
 
-#define MAX_DEVICES 1024
+static void stop_handler(int sig) {
+  (void) sig;
+  running = 0;
+}
 
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
+/* Added to now_ms to get ms since the unix epoch for output */
+static uint64_t wall_offset_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - now_ms();
+}
 
-int main(int argc, char **argv) {
+/* Counters for judging how much work the scan loop does per report */
+typedef struct {
+  uint64_t syscalls;  /* epoll_wait and read calls */
+  uint64_t events;    /* hci packets read */
+  uint64_t ignored;   /* packets that were not advertising reports */
+  uint64_t reports;   /* advertising reports */
+  uint64_t last_print;
+} scan_stats_t;
+
+static void print_stats(scan_stats_t *stats, uint64_t now, uint64_t period_ms) {
+  uint64_t dt = now - stats->last_print;
+  if (period_ms == 0 || dt < period_ms) return;
+
+  double sec = dt / 1000.0;
+  fprintf(stderr, "events/s: %.1f syscalls/s: %.1f ignored/s: %.1f reports/s: %.1f\n",
+	  stats->events / sec, stats->syscalls / sec,
+	  stats->ignored / sec, stats->reports / sec);
+
+  stats->syscalls = stats->events = stats->ignored = stats->reports = 0;
+  stats->last_print = now;
+}
+
+typedef struct {
+  int *dev_ids;
+  int num;
+} adapter_list_t;
+
+static int add_adapter(int dd, int dev_id, long arg) {
+  adapter_list_t *list = (adapter_list_t *)arg;
+  (void) dd;
+  if (list->num < MAX_ADAPTERS) list->dev_ids[list->num ++] = dev_id;
+  return 0; /* keep going */
+}
+
+/* Collects the ids of all adapters that are up */
+static int find_adapters(int *dev_ids) {
+  adapter_list_t list = { .dev_ids = dev_ids, .num = 0 };
+  hci_for_each_dev(HCI_UP, add_adapter, (long)&list);
+  return list.num;
+}
+
+/* Parses a comma separated list of adapter numbers, with or without
+   the hci prefix */
+static int parse_adapters(const char *spec, int *dev_ids) {
+  char buf[256];
+  char *save = NULL;
+  int n = 0;
+
+  snprintf(buf, sizeof(buf), "%s", spec);
+
+  for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+    char *end;
+    if (strncmp(tok, "hci", 3) == 0) tok += 3;
+    long id = strtol(tok, &end, 10);
+    if (end == tok || *end || id < 0 || n == MAX_ADAPTERS) return -1;
+    dev_ids[n ++] = (int)id;
+  }
+  return n;
+}
+
+static void close_adapters(adapter_t *adapters, int n) {
+  for (int i = 0; i < n; i ++) {
+    if (adapters[i].sock >= 0) close(adapters[i].sock);
+  }
+}
 
-  inquiry_info *ii = NULL;
+static void usage(const char *prg) {
+  printf("Usage: %s [options]\n"
+	 "  -l         LE scan (default is classic inquiry)\n"
+	 "  -a <list>  adapters to scan on, e.g. 0,1 or hci0,hci1 (default all up)\n"
+	 "  -i <ms>    LE scan interval (default 10 ms)\n"
+	 "  -w <ms>    LE scan window (default 10 ms)\n"
+	 "  -p         passive LE scan, no scan requests\n"
+	 "  -d         let the controller filter duplicate LE reports\n"
+	 "  -f <list>  hci events to pass the kernel filter: le,inquiry,cmd,all\n"
+	 "             (default le)\n"
+	 "  -s <sec>   print event and syscall rates every <sec> seconds\n"
+	 "  -r <file>  replay LE advertising reports and inquiry results from a\n"
+	 "             btsnoop capture as fast as possible\n"
+	 "  -o <fmt>   output format: text, ndjson, csv or binary (default text)\n"
+	 "  -u <path>  also stream the output to clients of this unix socket\n"
+	 "  -F <ms>    flush buffered output at least this often (default 200 ms)\n"
+	 "  -T <sec>   track presence, report arrive/leave with this leave timeout\n"
+	 "  -R <dB>    RSSI change reported while tracking presence (default 10)\n"
+	 "  -n <file>  remote name cache (default ~/.cache/ble_s_names)\n"
+	 "  -N <n>     name resolver threads (default 2)\n"
+	 "  -t <ms>    remote name request timeout (default 5000 ms)\n"
+	 "  -h         this help\n", prg);
+}
 
-  int max_rsp = 255; 
+static void output_name(output_t *out, adapter_t *adapter, const bdaddr_t *addr,
+			const char *name) {
+  output_record_t rec = {
+    .event = OUTPUT_NAME,
+    .adapter_name = adapter->name,
+    .addr = addr,
+    .rssi = DEVICE_RSSI_NONE,
+    .time_ms = now_ms() + wall_offset_ms(),
+    .name = name
+  };
+  output_record(out, &rec, now_ms());
+}
+
+static void print_names(name_resolver_t *names, adapter_t *adapter, output_t *out) {
+  name_result_t results[16];
+  int n;
+
+  while ((n = name_resolver_poll(names, results, 16)) > 0) {
+    for (int i = 0; i < n; i ++) {
+      output_name(out, adapter, &results[i].addr, results[i].ok ? results[i].name : "[unknown]");
+    }
+  }
+}
+
+/* An inquiry blocks in the kernel for its whole length, it runs on its
+   own thread so that names and output are still handled meanwhile. */
+typedef struct {
+  int dev_id;
+  inquiry_info *ii;
+  int max_rsp;
   int num_rsp;
-  int dev_id, sock;
-  int flags = IREQ_CACHE_FLUSH;
-  int i, j, k;
-  char addr[19] = {0};
-  char name[248] = {0};
+  int done_fd;          /* eventfd, written when the inquiry is over */
+} inquiry_job_t;
+
+static void *inquiry_thread(void *arg) {
+  inquiry_job_t *job = (inquiry_job_t *)arg;
+  uint64_t one = 1;
+
+  job->num_rsp = hci_inquiry(job->dev_id, 2, job->max_rsp, NULL, &job->ii,
+			     IREQ_CACHE_FLUSH);
+  if (write(job->done_fd, &one, sizeof(one)) < 0) perror("Error signalling inquiry");
+  return NULL;
+}
 
-  device devices[MAX_DEVICES];
-  int devices_found; 
-  
-  dev_id = hci_get_route(NULL);
-  sock = hci_open_dev(dev_id);
+/* Waits for the inquiry thread, handling finished name lookups and
+   flushing output at the flush period. */
+static void wait_inquiry(int ep, inquiry_job_t *job, name_resolver_t *names,
+			 adapter_t *adapter, output_t *out) {
+  struct epoll_event events[2];
+  bool done = false;
 
-  if (dev_id < 0 || sock < 0) {
-    printf("Error opening socket or opening bluetooth device\n");
-    return -1; 
+  while (!done) {
+    int n = epoll_wait(ep, events, 2, out->flush_ms);
+    for (int i = 0; i < n; i ++) {
+      uint64_t count;
+      if (events[i].data.fd == job->done_fd &&
+	  read(job->done_fd, &count, sizeof(count)) == sizeof(count)) {
+	done = true;
+      }
+    }
+    print_names(names, adapter, out);
+    output_tick(out, now_ms());
   }
+}
 
-  printf("device_id: %d\nsocket_id: %d\n", dev_id, sock);
+static int run_inquiry(adapter_t *adapter, device_table_t *devices, name_resolver_t *names,
+		       output_t *out) {
 
-  struct hci_dev_info di = { .dev_id = dev_id };
+  inquiry_job_t job = { .dev_id = adapter->dev_id, .max_rsp = 255 };
+  struct epoll_event ev = { .events = EPOLLIN };
+  pthread_t thread;
+  int res = 0;
+  int ep;
+  int i;
 
-  if (ioctl(sock, HCIGETDEVINFO, (void *) &di))
-    return 0;
+  job.ii = (inquiry_info*)malloc(job.max_rsp * sizeof(inquiry_info));
 
-  ba2str(&di.bdaddr, addr);
-  printf("Bluetooth device: %s\t%s\n", di.name, addr); 
+  if (!job.ii) {
+    printf("Error allocating memory\n");
+    return -1;
+  }
 
-  ii = (inquiry_info*)malloc(max_rsp * sizeof(inquiry_info));
-  
+  ep = epoll_create1(EPOLL_CLOEXEC);
+  job.done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ev.data.fd = job.done_fd;
+  if (ep < 0 || job.done_fd < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, job.done_fd, &ev) < 0) {
+    perror("Error setting up inquiry");
+    res = -1;
+  } else {
+    ev.data.fd = name_resolver_fd(names);
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
+      perror("Error adding name resolver to epoll");
+      res = -1;
+    }
+  }
 
-  while (true) { 
-    num_rsp = hci_inquiry(dev_id, 2, max_rsp, NULL, &ii, flags);
+  while (running && res == 0) { 
+    if (pthread_create(&thread, NULL, inquiry_thread, &job) != 0) {
+      printf("Error starting inquiry\n");
+      res = -1;
+      break;
+    }
+    wait_inquiry(ep, &job, names, adapter, out);
+    pthread_join(thread, NULL);
 
-    if (num_rsp < 0 ) {
+    if (job.num_rsp < 0 ) {
       printf("Error performing hci inquiry\n");
+      res = -1;
+      break;
+    }
+
+    uint64_t now = now_ms();
+
+    for (i = 0; i < job.num_rsp; i ++) {
+      inquiry_info *info = &job.ii[i];
+      bool new_device;
+      if (device_table_sighting(devices, &info->bdaddr, 0, DEVICE_RSSI_NONE,
+				now, &new_device) < 0) {
+	printf("Error allocating memory\n");
+	res = -1;
+	break;
+      }
+
+      /* Names are resolved in the background, a device is printed when
+	 its name is known. A request dropped on a full queue is simply
+	 repeated at the next sighting. */
+      const char *name = name_resolver_lookup(names, &info->bdaddr);
+      if (name) {
+	if (new_device) output_name(out, adapter, &info->bdaddr, name);
+      } else {
+	name_resolver_request(names, &info->bdaddr);
+      }
+    }
+
+    print_names(names, adapter, out);
+    output_tick(out, now_ms());
+  }
+
+  if (job.done_fd >= 0) close(job.done_fd);
+  if (ep >= 0) close(ep);
+  free(job.ii);
+  return res;
+}
+
+typedef struct {
+  device_table_t *devices;
+  scan_stats_t *stats;
+  adapter_t *adapters;
+  int adapter;          /* adapter the reports are read from */
+  presence_t *presence; /* NULL when only new devices are reported */
+  output_t *out;
+  uint64_t wall_offset; /* now + wall_offset is ms since the epoch */
+  uint64_t now;
+  bool oom;
+} le_ctx_t;
+
+static void le_output(le_ctx_t *ctx, output_event_t event, const le_adv_report_t *r) {
+  output_record_t rec = {
+    .event = event,
+    .adapter = ctx->adapter,
+    .adapter_name = ctx->adapters[ctx->adapter].name,
+    .addr = r->addr,
+    .addr_type = r->addr_type,
+    .rssi = r->rssi,
+    .time_ms = ctx->now + ctx->wall_offset,
+    .data = r->data,
+    .data_len = r->data_len
+  };
+  output_record(ctx->out, &rec, ctx->now);
+}
+
+static void le_report(const le_adv_report_t *r, void *arg) {
+  le_ctx_t *ctx = (le_ctx_t *)arg;
+  bool new_device;
+
+  int32_t ix = device_table_sighting(ctx->devices, r->addr, ctx->adapter, r->rssi,
+				     ctx->now, &new_device);
+  if (ix < 0) {
+    ctx->oom = true;
+    return;
+  }
+
+  if (!ctx->presence) {
+    if (new_device) le_output(ctx, OUTPUT_NEW, r);
+    return;
+  }
+
+  int8_t rssi = device_best_rssi(device_table_get(ctx->devices, ix), ctx->now,
+				 ctx->presence->timeout_ms);
+
+  switch (presence_sighting(ctx->presence, ix, rssi, ctx->now)) {
+  case PRESENCE_ARRIVE:
+    le_output(ctx, OUTPUT_ARRIVE, r);
+    break;
+  case PRESENCE_RSSI: {
+    le_adv_report_t best = *r;
+    best.rssi = rssi;
+    best.data = NULL;
+    best.data_len = 0;
+    le_output(ctx, OUTPUT_RSSI, &best);
+    break;
+  }
+  case PRESENCE_NONE:
+    break;
+  default:
+    ctx->oom = true;
+    break;
+  }
+}
+
+/* Inquiry responses in a capture take the same path as LE reports */
+static void inquiry_report(const inquiry_report_t *r, void *arg) {
+  le_adv_report_t rep = {
+    .evt_type = 0,
+    .addr_type = 0,
+    .addr = r->addr,
+    .rssi = r->rssi,
+    .data = r->data,
+    .data_len = r->data_len
+  };
+  le_report(&rep, arg);
+}
+
+static void le_leave(uint32_t ix, void *arg) {
+  le_ctx_t *ctx = (le_ctx_t *)arg;
+  device_t *d = device_table_get(ctx->devices, ix);
+  output_record_t rec = {
+    .event = OUTPUT_LEAVE,
+    .adapter = ctx->adapter,
+    .adapter_name = ctx->adapters[ctx->adapter].name,
+    .addr = &d->addr,
+    /* the readings from around the last sighting, all are stale by now */
+    .rssi = device_best_rssi(d, d->last_seen, ctx->presence->timeout_ms),
+    .time_ms = ctx->now + ctx->wall_offset
+  };
+  output_record(ctx->out, &rec, ctx->now);
+}
+
+/* Reports the devices whose leave deadline has passed */
+static void le_expire(le_ctx_t *ctx, uint64_t now) {
+  if (ctx->presence) presence_advance(ctx->presence, now, le_leave, ctx);
+}
+
+static void le_packet(const uint8_t *pkt, int len, void *arg) {
+  le_ctx_t *ctx = (le_ctx_t *)arg;
+
+  int reports = le_scan_process(pkt, len, le_report, ctx);
+  ctx->stats->events ++;
+  if (reports < 0) ctx->stats->ignored ++;
+  else ctx->stats->reports += reports;
+}
+
+/* Enables scanning on every adapter and waits for all of them in one
+   epoll set. With a window shorter than the interval the adapters are
+   started interval / n apart so their scan windows interleave. */
+static int run_le_scan(adapter_t *adapters, int num_adapters,
+		       const le_scan_params_t *params, uint32_t filter,
+		       uint64_t stats_ms, presence_t *presence, output_t *out,
+		       device_table_t *devices) {
+  struct epoll_event ev, events[MAX_ADAPTERS];
+  hci_reader_t reader;
+  scan_stats_t stats = { .last_print = now_ms() };
+  le_ctx_t ctx = { .devices = devices, .stats = &stats, .adapters = adapters,
+		   .presence = presence, .out = out, .wall_offset = wall_offset_ms() };
+  int started = 0;
+  int res = 0;
+
+  if (!hci_reader_init(&reader)) {
+    printf("Error allocating memory\n");
+    return -1;
+  }
+
+  int ep = epoll_create1(0);
+  if (ep < 0) {
+    perror("Error creating epoll instance");
+    hci_reader_free(&reader);
+    return -1;
+  }
+
+  /* interval is in 0.625 ms units */
+  useconds_t stagger = params->window < params->interval ?
+    (useconds_t)params->interval * 625 / num_adapters : 0;
+
+  for (int i = 0; i < num_adapters && running; i ++) {
+    if (i > 0 && stagger) usleep(stagger);
+
+    if (le_scan_start(adapters[i].sock, params, &adapters[i].saved_filter) < 0 ||
+	event_filter_apply(adapters[i].sock, filter) < 0) {
+      printf("Error starting scan on %s\n", adapters[i].name);
+      res = -1;
+      break;
+    }
+    started ++;
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = i;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, adapters[i].sock, &ev) < 0) {
+      perror("Error adding hci socket to epoll");
+      res = -1;
+      break;
+    }
+  }
+  if (res < 0) running = 0;
+
+  while (running) {
+    int timeout = presence && PRESENCE_TICK_MS < out->flush_ms ? PRESENCE_TICK_MS : out->flush_ms;
+    int n = epoll_wait(ep, events, MAX_ADAPTERS, timeout);
+    stats.syscalls ++;
+
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      perror("Error waiting for hci events");
+      res = -1;
+      break;
+    }
+    if (n == 0) {
+      ctx.now = now_ms();
+      le_expire(&ctx, ctx.now);
+      output_tick(out, ctx.now);
+      print_stats(&stats, ctx.now, stats_ms);
+      continue;
+    }
+
+    ctx.now = now_ms();
+
+    /* drain everything that is queued on the ready sockets */
+    for (int i = 0; i < n; i ++) {
+      adapter_t *a = &adapters[events[i].data.u32];
+      uint64_t reads = reader.syscalls;
+
+      ctx.adapter = (int)events[i].data.u32;
+      if (hci_reader_drain(&reader, a->sock, le_packet, &ctx) < 0) {
+	printf("Error reading from %s\n", a->name);
+	res = -1;
+	running = 0;
+      }
+      stats.syscalls += reader.syscalls - reads;
+    }
+
+    if (ctx.oom) {
+      printf("Error allocating memory\n");
+      res = -1;
+      break;
+    }
+    le_expire(&ctx, ctx.now);
+    output_tick(out, ctx.now);
+    print_stats(&stats, ctx.now, stats_ms);
+  }
+
+  for (int i = 0; i < started; i ++) {
+    le_scan_stop(adapters[i].sock, &adapters[i].saved_filter);
+  }
+  close(ep);
+  hci_reader_free(&reader);
+  return res;
+}
+
+/* Runs the LE report path over a capture as fast as it can be parsed,
+   the capture timestamps stand in for the clock. */
+static int run_replay(const char *path, presence_t *presence, output_t *out,
+		      device_table_t *devices) {
+  btsnoop_t snoop;
+  const uint8_t *evt;
+  int len;
+  int r = 0;
+  scan_stats_t stats = { 0 };
+  adapter_t file = { .dev_id = -1, .sock = -1, .name = "file" };
+  le_ctx_t ctx = { .devices = devices, .stats = &stats, .adapters = &file,
+		   .presence = presence, .out = out };
+
+  struct timespec t0, t1;
+  struct rusage ru;
+
+  if (btsnoop_open(&snoop, path) < 0) return -1;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+  while (running && (r = btsnoop_next_event(&snoop, &evt, &len, &ctx.now)) > 0) {
+    int reports = le_scan_process_event(evt, len, le_report, &ctx);
+    if (reports < 0) reports = inquiry_process_event(evt, len, inquiry_report, &ctx);
+    stats.events ++;
+    if (reports < 0) stats.ignored ++;
+    else stats.reports += reports;
+    le_expire(&ctx, ctx.now);
+    output_tick(out, ctx.now);
+
+    if (ctx.oom) {
+      printf("Error allocating memory\n");
+      btsnoop_close(&snoop);
       return -1;
     }
+  }
+
+  output_flush(out);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  getrusage(RUSAGE_SELF, &ru);
+
+  double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  if (sec <= 0) sec = 1e-9;
+  fprintf(stderr, "replayed %llu events (%llu ignored), %llu reports, %u devices in %.3f s, "
+	  "events/s: %.1f reports/s: %.1f ns/event: %.1f peak rss: %ld KiB\n",
+	  (unsigned long long)stats.events, (unsigned long long)stats.ignored,
+	  (unsigned long long)stats.reports, devices->num_devices, sec,
+	  stats.events / sec, stats.reports / sec,
+	  stats.events ? sec * 1e9 / stats.events : 0.0, ru.ru_maxrss);
+
+  if (r < 0) printf("Warning: %s is truncated\n", path);
+
+  btsnoop_close(&snoop);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+
+  adapter_t adapters[MAX_ADAPTERS];
+  int dev_ids[MAX_ADAPTERS];
+  int num_adapters;
+  const char *adapter_spec = NULL;
+  char addr[19] = {0};
+  int opt;
+  int res;
+
+  bool le = false;
+  char cache_file[4096] = {0};
+  int name_workers = 2;
+  int name_timeout = 5000;
+  name_resolver_t *names;
+  le_scan_params_t le_params = {
+    .active = true,
+    .filter_dup = false
+  };
+  double interval_ms = 10;
+  double window_ms = 10;
+  uint32_t filter = EVENT_FILTER_LE;
+  uint64_t stats_ms = 0;
+  const char *replay_file = NULL;
+  uint32_t presence_ms = 0;
+  int rssi_delta = 10;
+  presence_t presence;
+  output_format_t format = OUTPUT_TEXT;
+  const char *socket_path = NULL;
+  uint32_t flush_ms = 200;
+  output_t out;
+
+  device_table_t devices;
+
+  const char *home = getenv("HOME");
+  if (home) snprintf(cache_file, sizeof(cache_file), "%s/.cache/ble_s_names", home);
 
-    for (i = 0; i < num_rsp; i ++) {
-      bool new_device = true; 
-      for (j = 0; j < devices_found; j ++) {
-	for (k = 0; k < 6; k ++) {
-	  bool all_equal = true; 
-	  if (ii[i].bdaddr.b[k] != devices[j].addr.b[k]) {
-	    all_equal = false;
-	  }
- 
-	  if (all_equal) new_device = false;
-	}
+  while ((opt = getopt(argc, argv, "la:i:w:pdf:s:r:o:u:F:T:R:n:N:t:h")) != -1) {
+    switch (opt) {
+    case 'l':
+      le = true;
+      break;
+    case 'a':
+      adapter_spec = optarg;
+      break;
+    case 'i':
+      interval_ms = atof(optarg);
+      break;
+    case 'w':
+      window_ms = atof(optarg);
+      break;
+    case 'p':
+      le_params.active = false;
+      break;
+    case 'd':
+      le_params.filter_dup = true;
+      break;
+    case 'f':
+      if (event_filter_parse(optarg, &filter) < 0 || filter == 0) {
+	printf("Invalid event filter: %s\n", optarg);
+	return -1;
       }
-      if (new_device && devices_found < MAX_DEVICES) {
-	devices[devices_found].addr = ii[i].bdaddr;
-	devices_found++;
-	ba2str(&ii[i].bdaddr, addr);
-	memset(name, 0, sizeof(name));
-	if (hci_read_remote_name(sock, &ii[i].bdaddr, sizeof(name), name, 0) < 0)
-	  strcpy(name, "[unknown]");
-	printf("%s %s\n", addr, name);
-      }	
-    }
-  }
-  
-  free(ii);
-  close(sock);
-  return 0; 
+      break;
+    case 's':
+      stats_ms = (uint64_t)(atof(optarg) * 1000);
+      break;
+    case 'r':
+      replay_file = optarg;
+      break;
+    case 'o':
+      if (output_parse_format(optarg, &format) < 0) {
+	printf("Invalid output format: %s\n", optarg);
+	return -1;
+      }
+      break;
+    case 'u':
+      socket_path = optarg;
+      break;
+    case 'F': {
+      /* 0 would make the event loop poll without sleeping */
+      int ms = atoi(optarg);
+      if (ms <= 0) {
+	printf("Invalid flush period: %s\n", optarg);
+	return -1;
+      }
+      flush_ms = (uint32_t)ms;
+      break;
+    }
+    case 'T':
+      presence_ms = (uint32_t)(atof(optarg) * 1000);
+      break;
+    case 'R':
+      rssi_delta = atoi(optarg);
+      break;
+    case 'n':
+      snprintf(cache_file, sizeof(cache_file), "%s", optarg);
+      break;
+    case 'N':
+      name_workers = atoi(optarg);
+      break;
+    case 't':
+      name_timeout = atoi(optarg);
+      break;
+    case 'h':
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : -1;
+    }
+  }
+
+  /* interval and window are limited to 2.5 ms .. 10.24 s by the spec,
+     checked before converting since out of range values do not fit in
+     the 16 bit units (written so that NaN fails too) */
+  if (!(window_ms >= 2.5 && window_ms <= interval_ms && interval_ms <= 10240)) {
+    printf("Invalid scan interval/window, need 2.5 ms <= window <= interval <= 10240 ms\n");
+    return -1;
+  }
+  le_params.interval = LE_SCAN_MS_TO_UNITS(interval_ms);
+  le_params.window = LE_SCAN_MS_TO_UNITS(window_ms);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = stop_handler;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  /* keep stdout clean for the structured formats */
+  FILE *info = format == OUTPUT_TEXT ? stdout : stderr;
+
+  if (presence_ms && !presence_init(&presence, presence_ms, PRESENCE_TICK_MS, rssi_delta)) {
+    printf("Error allocating memory\n");
+    return -1;
+  }
+
+  if (!output_init(&out, STDOUT_FILENO, format, OUTPUT_BUF_SIZE, flush_ms, socket_path)) {
+    printf("Error setting up output\n");
+    return -1;
+  }
+
+  if (replay_file) {
+    if (!device_table_init(&devices, 1024)) {
+      printf("Error allocating memory\n");
+      return -1;
+    }
+    res = run_replay(replay_file, presence_ms ? &presence : NULL, &out, &devices);
+    device_table_free(&devices);
+    if (presence_ms) presence_free(&presence);
+    output_close(&out);
+    return res;
+  }
+
+  if (adapter_spec) {
+    num_adapters = parse_adapters(adapter_spec, dev_ids);
+    if (num_adapters < 0) {
+      printf("Invalid adapter list: %s\n", adapter_spec);
+      return -1;
+    }
+  } else {
+    num_adapters = find_adapters(dev_ids);
+  }
+
+  /* classic inquiry only runs on the first adapter */
+  if (!le && num_adapters > 1) num_adapters = 1;
+
+  if (num_adapters == 0) {
+    printf("Error no bluetooth device found\n");
+    return -1;
+  }
+
+  for (int i = 0; i < num_adapters; i ++) {
+    adapter_t *a = &adapters[i];
+
+    a->dev_id = dev_ids[i];
+    a->sock = hci_open_dev(a->dev_id);
+    snprintf(a->name, sizeof(a->name), "hci%d", a->dev_id);
+
+    if (a->sock < 0) {
+      printf("Error opening socket or opening bluetooth device %s\n", a->name);
+      close_adapters(adapters, i);
+      return -1;
+    }
+
+    fprintf(info, "device_id: %d\nsocket_id: %d\n", a->dev_id, a->sock);
+
+    struct hci_dev_info di = { .dev_id = a->dev_id };
+
+    if (ioctl(a->sock, HCIGETDEVINFO, (void *) &di)) {
+      close_adapters(adapters, i + 1);
+      return 0;
+    }
+
+    ba2str(&di.bdaddr, addr);
+    fprintf(info, "Bluetooth device: %s\t%s\n", di.name, addr);
+    fflush(info);
+  }
+
+  if (!device_table_init(&devices, 1024)) {
+    printf("Error allocating memory\n");
+    close_adapters(adapters, num_adapters);
+    return -1;
+  }
+
+  if (le) {
+    res = run_le_scan(adapters, num_adapters, &le_params, filter, stats_ms,
+		      presence_ms ? &presence : NULL, &out, &devices);
+  } else {
+    /* LE devices put their names in the advertising data */
+    names = name_resolver_create(adapters[0].dev_id, name_workers, NAME_QUEUE_SIZE,
+				 name_timeout, cache_file[0] ? cache_file : NULL);
+    if (!names) {
+      printf("Error starting name resolver\n");
+      res = -1;
+    } else {
+      res = run_inquiry(&adapters[0], &devices, names, &out);
+      name_resolver_destroy(names);
+    }
+  }
+
+  device_table_free(&devices);
+  if (presence_ms) presence_free(&presence);
+  output_close(&out);
+  close_adapters(adapters, num_adapters);
+  return res; 
 }
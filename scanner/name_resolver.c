@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/hci_lib.h>
+
+#include "name_resolver.h"
+
+#define MAX_WORKERS 8
+
+/* A failed lookup is not retried until this many seconds have passed */
+#define RETRY_AFTER_S 600
+
+typedef enum {
+  NAME_EMPTY = 0,
+  NAME_PENDING,
+  NAME_RESOLVED,
+  NAME_FAILED
+} name_state_t;
+
+typedef struct {
+  bdaddr_t addr;
+  uint8_t state;
+  time_t failed_at;
+  char *name;
+} name_entry_t;
+
+struct name_resolver {
+  int dev_id;
+  int timeout_ms;
+  char *cache_file;
+  bool cache_dirty;
+
+  /* cache, open addressing, only used by the main thread */
+  name_entry_t *entries;
+  uint32_t num_entries;
+  uint32_t size;
+
+  /* request queue, main thread -> workers */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bdaddr_t *queue;
+  int queue_size;
+  int q_head;
+  int q_len;
+  int outstanding;  /* requested but not yet polled, at most queue_size */
+  bool stop;
+
+  /* result queue, workers -> main thread */
+  name_result_t *results;
+  int r_head;
+  int r_len;
+  int event_fd;
+
+  pthread_t workers[MAX_WORKERS];
+  int num_workers;
+};
+
+/* ------------------------------------------------------------
+   Cache
+   ------------------------------------------------------------ */
+
+static uint32_t hash_addr(const bdaddr_t *addr, uint32_t mask) {
+  uint64_t k = 0;
+  for (int i = 0; i < 6; i ++) k |= (uint64_t)addr->b[i] << (8 * i);
+  return (uint32_t)((k * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+static name_entry_t *cache_slot(name_resolver_t *r, const bdaddr_t *addr) {
+  uint32_t mask = r->size - 1;
+  uint32_t s = hash_addr(addr, mask);
+  while (r->entries[s].state != NAME_EMPTY &&
+	 bacmp(&r->entries[s].addr, addr) != 0) {
+    s = (s + 1) & mask;
+  }
+  return &r->entries[s];
+}
+
+static bool cache_grow(name_resolver_t *r) {
+  uint32_t old_size = r->size;
+  name_entry_t *old = r->entries;
+
+  name_entry_t *entries = calloc(old_size * 2, sizeof(name_entry_t));
+  if (!entries) return false;
+
+  r->entries = entries;
+  r->size = old_size * 2;
+  for (uint32_t i = 0; i < old_size; i ++) {
+    if (old[i].state != NAME_EMPTY) {
+      *cache_slot(r, &old[i].addr) = old[i];
+    }
+  }
+  free(old);
+  return true;
+}
+
+/* Returns the entry for addr, creating an empty one if needed */
+static name_entry_t *cache_get(name_resolver_t *r, const bdaddr_t *addr) {
+  name_entry_t *e = cache_slot(r, addr);
+  if (e->state != NAME_EMPTY) return e;
+
+  if (r->num_entries + 1 > r->size / 2) {
+    if (!cache_grow(r)) return NULL;
+    e = cache_slot(r, addr);
+  }
+  r->num_entries ++;
+  e->addr = *addr;
+  e->name = NULL;
+  return e;
+}
+
+static void cache_set_name(name_resolver_t *r, name_entry_t *e, const char *name) {
+  free(e->name);
+  e->name = strdup(name);
+  e->state = e->name ? NAME_RESOLVED : NAME_FAILED;
+  r->cache_dirty = true;
+}
+
+static void cache_load(name_resolver_t *r) {
+  FILE *f = fopen(r->cache_file, "r");
+  char line[32 + NAME_MAX_LEN];
+
+  if (!f) return;
+
+  while (fgets(line, sizeof(line), f)) {
+    bdaddr_t addr;
+    line[strcspn(line, "\n")] = 0;
+    if (strlen(line) < 18 || line[17] != ' ') continue;
+    line[17] = 0;
+    if (str2ba(line, &addr) < 0) continue;
+
+    name_entry_t *e = cache_get(r, &addr);
+    if (e) cache_set_name(r, e, line + 18);
+  }
+  fclose(f);
+  r->cache_dirty = false;
+}
+
+bool name_resolver_save(name_resolver_t *r) {
+  char tmp[4096];
+  char addr[19];
+
+  if (!r->cache_file || !r->cache_dirty) return true;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", r->cache_file);
+  FILE *f = fopen(tmp, "w");
+  if (!f) return false;
+
+  for (uint32_t i = 0; i < r->size; i ++) {
+    name_entry_t *e = &r->entries[i];
+    if (e->state != NAME_RESOLVED) continue;
+    ba2str(&e->addr, addr);
+    fprintf(f, "%s %s\n", addr, e->name);
+  }
+
+  if (fclose(f) != 0 || rename(tmp, r->cache_file) != 0) {
+    unlink(tmp);
+    return false;
+  }
+  r->cache_dirty = false;
+  return true;
+}
+
+/* ------------------------------------------------------------
+   Workers
+   ------------------------------------------------------------ */
+
+static void *worker(void *arg) {
+  name_resolver_t *r = (name_resolver_t *)arg;
+  name_result_t res;
+  uint64_t one = 1;
+
+  /* HCI requests on a shared socket would steal each others replies */
+  int sock = hci_open_dev(r->dev_id);
+
+  while (true) {
+    pthread_mutex_lock(&r->lock);
+    while (!r->stop && r->q_len == 0) {
+      pthread_cond_wait(&r->cond, &r->lock);
+    }
+    if (r->stop) {
+      pthread_mutex_unlock(&r->lock);
+      break;
+    }
+    res.addr = r->queue[r->q_head];
+    r->q_head = (r->q_head + 1) % r->queue_size;
+    r->q_len --;
+    pthread_mutex_unlock(&r->lock);
+
+    memset(res.name, 0, sizeof(res.name));
+    res.ok = sock >= 0 &&
+      hci_read_remote_name(sock, &res.addr, NAME_MAX_LEN, res.name, r->timeout_ms) >= 0;
+
+    pthread_mutex_lock(&r->lock);
+    /* there is room, requests are only accepted while fewer than
+       queue_size are outstanding */
+    r->results[(r->r_head + r->r_len) % r->queue_size] = res;
+    r->r_len ++;
+    pthread_mutex_unlock(&r->lock);
+
+    if (write(r->event_fd, &one, sizeof(one)) < 0) {
+      /* counter overflow can not happen in practice */
+    }
+  }
+
+  if (sock >= 0) hci_close_dev(sock);
+  return NULL;
+}
+
+/* ------------------------------------------------------------
+   Interface
+   ------------------------------------------------------------ */
+
+name_resolver_t *name_resolver_create(int dev_id, int num_workers,
+				      int queue_size, int timeout_ms,
+				      const char *cache_file) {
+  name_resolver_t *r = calloc(1, sizeof(name_resolver_t));
+  if (!r) return NULL;
+
+  if (num_workers < 1) num_workers = 1;
+  if (num_workers > MAX_WORKERS) num_workers = MAX_WORKERS;
+
+  r->dev_id = dev_id;
+  r->timeout_ms = timeout_ms;
+  r->queue_size = queue_size;
+  r->size = 1024;
+  r->entries = calloc(r->size, sizeof(name_entry_t));
+  r->queue = malloc(queue_size * sizeof(bdaddr_t));
+  r->results = malloc(queue_size * sizeof(name_result_t));
+  r->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  pthread_mutex_init(&r->lock, NULL);
+  pthread_cond_init(&r->cond, NULL);
+
+  if (!r->entries || !r->queue || !r->results || r->event_fd < 0) {
+    name_resolver_destroy(r);
+    return NULL;
+  }
+
+  if (cache_file) {
+    r->cache_file = strdup(cache_file);
+    cache_load(r);
+  }
+
+  for (int i = 0; i < num_workers; i ++) {
+    if (pthread_create(&r->workers[i], NULL, worker, r) != 0) break;
+    r->num_workers ++;
+  }
+  if (r->num_workers == 0) {
+    name_resolver_destroy(r);
+    return NULL;
+  }
+  return r;
+}
+
+void name_resolver_destroy(name_resolver_t *r) {
+  if (!r) return;
+
+  pthread_mutex_lock(&r->lock);
+  r->stop = true;
+  pthread_cond_broadcast(&r->cond);
+  pthread_mutex_unlock(&r->lock);
+
+  /* a worker may be stuck in hci_read_remote_name for timeout_ms */
+  for (int i = 0; i < r->num_workers; i ++) {
+    pthread_join(r->workers[i], NULL);
+  }
+
+  if (r->entries) {
+    name_resolver_poll(r, NULL, 0);
+    name_resolver_save(r);
+    for (uint32_t i = 0; i < r->size; i ++) free(r->entries[i].name);
+  }
+
+  if (r->event_fd >= 0) close(r->event_fd);
+  pthread_mutex_destroy(&r->lock);
+  pthread_cond_destroy(&r->cond);
+  free(r->entries);
+  free(r->queue);
+  free(r->results);
+  free(r->cache_file);
+  free(r);
+}
+
+int name_resolver_fd(name_resolver_t *r) {
+  return r->event_fd;
+}
+
+const char *name_resolver_lookup(name_resolver_t *r, const bdaddr_t *addr) {
+  name_entry_t *e = cache_slot(r, addr);
+  return e->state == NAME_RESOLVED ? e->name : NULL;
+}
+
+bool name_resolver_request(name_resolver_t *r, const bdaddr_t *addr) {
+  name_entry_t *e = cache_get(r, addr);
+  if (!e) return false;
+
+  switch (e->state) {
+  case NAME_PENDING:
+  case NAME_RESOLVED:
+    return true;
+  case NAME_FAILED:
+    if (time(NULL) - e->failed_at < RETRY_AFTER_S) return true;
+    break;
+  default:
+    break;
+  }
+
+  bool queued = false;
+  pthread_mutex_lock(&r->lock);
+  if (r->outstanding < r->queue_size) {
+    r->queue[(r->q_head + r->q_len) % r->queue_size] = *addr;
+    r->q_len ++;
+    r->outstanding ++;
+    queued = true;
+    pthread_cond_signal(&r->cond);
+  }
+  pthread_mutex_unlock(&r->lock);
+
+  if (queued) e->state = NAME_PENDING;
+  return queued;
+}
+
+/* With results == NULL all finished lookups go to the cache only */
+int name_resolver_poll(name_resolver_t *r, name_result_t *results, int max) {
+  uint64_t count;
+  int n = 0;
+  name_result_t res;
+
+  if (read(r->event_fd, &count, sizeof(count)) < 0) {
+    /* EAGAIN, nothing signalled, there may still be results */
+  }
+
+  while (results == NULL || n < max) {
+    pthread_mutex_lock(&r->lock);
+    if (r->r_len == 0) {
+      pthread_mutex_unlock(&r->lock);
+      break;
+    }
+    res = r->results[r->r_head];
+    r->r_head = (r->r_head + 1) % r->queue_size;
+    r->r_len --;
+    r->outstanding --;
+    pthread_mutex_unlock(&r->lock);
+
+    name_entry_t *e = cache_get(r, &res.addr);
+    if (e) {
+      if (res.ok) {
+	cache_set_name(r, e, res.name);
+      } else {
+	e->state = NAME_FAILED;
+	e->failed_at = time(NULL);
+      }
+    }
+    if (results) results[n] = res;
+    n ++;
+  }
+
+  /* more left than the caller took, keep the fd readable */
+  if (results && n == max) {
+    uint64_t one = 1;
+    if (write(r->event_fd, &one, sizeof(one)) < 0) {
+    }
+  }
+  return n;
+}
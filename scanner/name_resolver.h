@@ -0,0 +1,50 @@
+#ifndef NAME_RESOLVER_H
+#define NAME_RESOLVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <bluetooth/bluetooth.h>
+
+/* Background remote name resolution.
+ *
+ * Requests are put on a bounded queue served by a small pool of worker
+ * threads, each with its own HCI socket. An address that is queued,
+ * being resolved or already known is not queued again. Finished
+ * lookups are collected with name_resolver_poll, name_resolver_fd
+ * becomes readable when there are any, so it can sit in an epoll set.
+ *
+ * Resolved names are kept in a cache that is loaded from and saved to
+ * cache_file (if not NULL). All functions are for a single (main)
+ * thread, the workers never touch the cache.
+ */
+
+#define NAME_MAX_LEN 248
+
+typedef struct {
+  bdaddr_t addr;
+  bool ok;
+  char name[NAME_MAX_LEN + 1];
+} name_result_t;
+
+typedef struct name_resolver name_resolver_t;
+
+extern name_resolver_t *name_resolver_create(int dev_id, int num_workers,
+					     int queue_size, int timeout_ms,
+					     const char *cache_file);
+extern void name_resolver_destroy(name_resolver_t *r);
+
+extern int name_resolver_fd(name_resolver_t *r);
+
+/* Returns the cached name or NULL */
+extern const char *name_resolver_lookup(name_resolver_t *r, const bdaddr_t *addr);
+
+/* Queues addr for resolution. Returns false if the queue is full, the
+   request can then be repeated at a later sighting. */
+extern bool name_resolver_request(name_resolver_t *r, const bdaddr_t *addr);
+
+/* Moves up to max finished lookups into results and the cache */
+extern int name_resolver_poll(name_resolver_t *r, name_result_t *results, int max);
+
+extern bool name_resolver_save(name_resolver_t *r);
+
+#endif
@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "ad_decoder.h"
+#include "output.h"
+
+/* longest formatted record */
+#define SCRATCH_SIZE 4096
+
+static const char *event_names[] = { "new", "arrive", "leave", "rssi", "name" };
+
+static const char *format_names[] = { "text", "ndjson", "csv", "binary" };
+
+int output_parse_format(const char *name, output_format_t *format) {
+  for (int i = 0; i < (int)(sizeof(format_names) / sizeof(format_names[0])); i ++) {
+    if (strcmp(name, format_names[i]) == 0) {
+      *format = (output_format_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* Stream header, sent once to stdout and to each new socket client */
+static int stream_header(output_format_t format, char *buf) {
+  switch (format) {
+  case OUTPUT_CSV:
+    strcpy(buf, "time_ms,event,adapter,addr,addr_type,rssi,name,fields\n");
+    return (int)strlen(buf);
+  case OUTPUT_BINARY:
+    memcpy(buf, OUTPUT_BINARY_MAGIC, 4);
+    buf[4] = OUTPUT_BINARY_VERSION;
+    return 5;
+  default:
+    return 0;
+  }
+}
+
+static void write_all(int fd, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  while (len) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    p += n;
+    len -= n;
+  }
+}
+
+static void client_close(output_client_t *c) {
+  close(c->fd);
+  free(c->pending);
+  memset(c, 0, sizeof(output_client_t));
+  c->fd = -1;
+}
+
+/* Sends as much of the queue as the socket takes. Returns false when
+   the client is gone. */
+static bool client_send_pending(output_client_t *c) {
+  while (c->off < c->len) {
+    ssize_t n = send(c->fd, c->pending + c->off, c->len - c->off,
+		     MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    c->off += n;
+  }
+  c->off = c->len = 0;
+  return true;
+}
+
+/* Appends to the queue. Returns false when the backlog limit is hit. */
+static bool client_queue(output_client_t *c, const uint8_t *data, size_t len) {
+  if (c->off > 0) {
+    memmove(c->pending, c->pending + c->off, c->len - c->off);
+    c->len -= c->off;
+    c->off = 0;
+  }
+  if (c->len + len > OUTPUT_CLIENT_BACKLOG) return false;
+
+  if (c->len + len > c->size) {
+    size_t size = c->size ? c->size : 65536;
+    while (size < c->len + len) size *= 2;
+    if (size > OUTPUT_CLIENT_BACKLOG) size = OUTPUT_CLIENT_BACKLOG;
+    uint8_t *p = realloc(c->pending, size);
+    if (!p) return false;
+    c->pending = p;
+    c->size = size;
+  }
+  memcpy(c->pending + c->len, data, len);
+  c->len += len;
+  return true;
+}
+
+/* Sends what the socket takes now and queues the rest. Returns false
+   when the client is gone or too far behind. */
+static bool client_write(output_client_t *c, const uint8_t *data, size_t len) {
+  if (!client_send_pending(c)) return false;
+
+  while (c->len == 0 && len > 0) {
+    ssize_t n = send(c->fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+      break;
+    }
+    data += n;
+    len -= n;
+  }
+  return len == 0 || client_queue(c, data, len);
+}
+
+static void drop_client(output_t *o, int i) {
+  client_close(&o->clients[i]);
+  o->clients[i] = o->clients[-- o->num_clients];
+}
+
+/* Records reach a client in order and whole, a partial record would
+   corrupt its stream. What the socket does not take now waits in the
+   client's queue, only a client OUTPUT_CLIENT_BACKLOG behind is dropped. */
+static void send_clients(output_t *o, const void *data, size_t len) {
+  for (int i = 0; i < o->num_clients; ) {
+    if (!client_write(&o->clients[i], data, len)) {
+      drop_client(o, i);
+      continue;
+    }
+    i ++;
+  }
+}
+
+static void send_clients_pending(output_t *o) {
+  for (int i = 0; i < o->num_clients; ) {
+    if (!client_send_pending(&o->clients[i])) {
+      drop_client(o, i);
+      continue;
+    }
+    i ++;
+  }
+}
+
+static void accept_clients(output_t *o) {
+  char header[64];
+  int header_len = stream_header(o->format, header);
+
+  if (o->listen_fd < 0) return;
+
+  while (true) {
+    int fd = accept4(o->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) break;
+
+    if (o->num_clients == OUTPUT_MAX_CLIENTS) {
+      close(fd);
+      continue;
+    }
+    output_client_t *c = &o->clients[o->num_clients ++];
+    memset(c, 0, sizeof(output_client_t));
+    c->fd = fd;
+    if (header_len && !client_write(c, (const uint8_t *)header, header_len)) {
+      drop_client(o, o->num_clients - 1);
+    }
+  }
+}
+
+static int listen_unix(const char *path) {
+  struct sockaddr_un sa;
+
+  if (strlen(path) >= sizeof(sa.sun_path)) {
+    printf("Error socket path too long: %s\n", path);
+    return -1;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("Error creating output socket");
+    return -1;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strcpy(sa.sun_path, path);
+  unlink(path);
+
+  if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(fd, 4) < 0) {
+    perror("Error binding output socket");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool output_init(output_t *o, int fd, output_format_t format, size_t buf_size,
+		 uint32_t flush_ms, const char *socket_path) {
+  char header[64];
+
+  memset(o, 0, sizeof(output_t));
+  o->format = format;
+  o->fd = fd;
+  o->flush_ms = flush_ms;
+  o->listen_fd = -1;
+  o->size = buf_size < SCRATCH_SIZE ? SCRATCH_SIZE : buf_size;
+
+  o->buf = malloc(o->size);
+  if (!o->buf) return false;
+
+  if (socket_path) {
+    o->listen_fd = listen_unix(socket_path);
+    if (o->listen_fd < 0) {
+      free(o->buf);
+      o->buf = NULL;
+      return false;
+    }
+  }
+
+  int n = stream_header(format, header);
+  if (n) write_all(o->fd, header, n);
+  return true;
+}
+
+void output_flush(output_t *o) {
+  if (o->len == 0) return;
+  write_all(o->fd, o->buf, o->len);
+  send_clients(o, o->buf, o->len);
+  o->len = 0;
+}
+
+void output_tick(output_t *o, uint64_t now) {
+  accept_clients(o);
+  send_clients_pending(o);
+  if (o->len && now - o->first_ms >= o->flush_ms) output_flush(o);
+}
+
+void output_close(output_t *o) {
+  output_flush(o);
+  /* the rest of the queues, waiting a little for slow readers */
+  for (int i = 0; i < o->num_clients; i ++) {
+    output_client_t *c = &o->clients[i];
+    struct timeval tv = { 1, 0 };
+    fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) & ~O_NONBLOCK);
+    setsockopt(c->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    while (c->off < c->len) {
+      ssize_t n = send(c->fd, c->pending + c->off, c->len - c->off, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) break;
+      c->off += n;
+    }
+    client_close(c);
+  }
+  if (o->listen_fd >= 0) close(o->listen_fd);
+  free(o->buf);
+  memset(o, 0, sizeof(output_t));
+  o->listen_fd = -1;
+}
+
+/* snprintf that keeps the position at the end of the buffer on overflow */
+static int append(char *buf, int pos, const char *fmt, ...)
+  __attribute__((format(printf, 3, 4)));
+
+static int append(char *buf, int pos, const char *fmt, ...) {
+  va_list ap;
+  if (pos >= SCRATCH_SIZE - 1) return pos;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf + pos, SCRATCH_SIZE - pos, fmt, ap);
+  va_end(ap);
+  if (n < 0) return pos;
+  return pos + n < SCRATCH_SIZE ? pos + n : SCRATCH_SIZE - 1;
+}
+
+static int append_hex(char *buf, int pos, const uint8_t *data, int len) {
+  static const char digits[] = "0123456789abcdef";
+  for (int i = 0; i < len && pos < SCRATCH_SIZE - 3; i ++) {
+    buf[pos ++] = digits[data[i] >> 4];
+    buf[pos ++] = digits[data[i] & 0xf];
+  }
+  buf[pos] = 0;
+  return pos;
+}
+
+/* Length of the well formed UTF-8 sequence starting at s, 0 if there is
+   none. Names are cut at the length of the AD field, so the last
+   character may be incomplete. */
+static int utf8_seq_len(const unsigned char *s, int len) {
+  int n;
+  uint32_t cp;
+  if (s[0] < 0x80) return 1;
+  if (s[0] >= 0xc2 && s[0] <= 0xdf) { n = 2; cp = s[0] & 0x1f; }
+  else if (s[0] >= 0xe0 && s[0] <= 0xef) { n = 3; cp = s[0] & 0x0f; }
+  else if (s[0] >= 0xf0 && s[0] <= 0xf4) { n = 4; cp = s[0] & 0x07; }
+  else return 0;
+  if (n > len) return 0;
+  for (int i = 1; i < n; i ++) {
+    if ((s[i] & 0xc0) != 0x80) return 0;
+    cp = (cp << 6) | (s[i] & 0x3f);
+  }
+  /* overlong forms, surrogates and values past U+10FFFF */
+  if ((n == 3 && cp < 0x800) || (n == 4 && cp < 0x10000) ||
+      (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff) return 0;
+  return n;
+}
+
+/* Invalid UTF-8 is written as U+FFFD so that the output stays valid JSON */
+static int append_json_string(char *buf, int pos, const char *s, int len) {
+  const unsigned char *u = (const unsigned char *)s;
+  pos = append(buf, pos, "\"");
+  for (int i = 0; i < len; ) {
+    unsigned char c = u[i];
+    int n = utf8_seq_len(u + i, len - i);
+    if (n == 0) { pos = append(buf, pos, "\\ufffd"); i ++; continue; }
+    if (c == '"' || c == '\\') pos = append(buf, pos, "\\%c", c);
+    else if (c < 0x20 || c == 0x7f) pos = append(buf, pos, "\\u%04x", c);
+    else pos = append(buf, pos, "%.*s", n, s + i);
+    i += n;
+  }
+  return append(buf, pos, "\"");
+}
+
+static int append_csv_string(char *buf, int pos, const char *s, int len) {
+  pos = append(buf, pos, "\"");
+  for (int i = 0; i < len; i ++) {
+    if (s[i] == '"') pos = append(buf, pos, "\"\"");
+    else if (s[i] == '\n' || s[i] == '\r') pos = append(buf, pos, " ");
+    else pos = append(buf, pos, "%c", s[i]);
+  }
+  return append(buf, pos, "\"");
+}
+
+static int format_json_ad(char *buf, int pos, const ad_info_t *ad) {
+  char uuid[37];
+
+  if (ad->has_flags) pos = append(buf, pos, ",\"flags\":%u", ad->flags);
+  if (ad->has_tx_power) pos = append(buf, pos, ",\"tx_power\":%d", ad->tx_power);
+
+  if (ad->num_uuid16_views + ad->num_uuid32_views + ad->num_uuid128_views) {
+    const char *sep = "";
+    pos = append(buf, pos, ",\"uuids\":[");
+    for (int v = 0; v < ad->num_uuid16_views; v ++) {
+      for (int i = 0; i < ad->uuid16[v].len / 2; i ++, sep = ",") {
+	pos = append(buf, pos, "%s\"%04x\"", sep, ad_uuid16(&ad->uuid16[v], i));
+      }
+    }
+    for (int v = 0; v < ad->num_uuid32_views; v ++) {
+      for (int i = 0; i < ad->uuid32[v].len / 4; i ++, sep = ",") {
+	pos = append(buf, pos, "%s\"%08x\"", sep, ad_uuid32(&ad->uuid32[v], i));
+      }
+    }
+    for (int v = 0; v < ad->num_uuid128_views; v ++) {
+      for (int i = 0; i < ad->uuid128[v].len / 16; i ++, sep = ",") {
+	ad_uuid128_str(ad_uuid128(&ad->uuid128[v], i), uuid);
+	pos = append(buf, pos, "%s\"%s\"", sep, uuid);
+      }
+    }
+    pos = append(buf, pos, "]");
+  }
+
+  if (ad->num_service_data) {
+    pos = append(buf, pos, ",\"service_data\":[");
+    for (int i = 0; i < ad->num_service_data; i ++) {
+      const ad_service_data_t *sd = &ad->service_data[i];
+      if (sd->uuid_len == 2) {
+	pos = append(buf, pos, "%s{\"uuid\":\"%04x\",\"data\":\"", i ? "," : "", ad_get_le16(sd->uuid));
+      } else if (sd->uuid_len == 4) {
+	pos = append(buf, pos, "%s{\"uuid\":\"%08x\",\"data\":\"", i ? "," : "", ad_get_le32(sd->uuid));
+      } else {
+	ad_uuid128_str(sd->uuid, uuid);
+	pos = append(buf, pos, "%s{\"uuid\":\"%s\",\"data\":\"", i ? "," : "", uuid);
+      }
+      pos = append_hex(buf, pos, sd->data.data, sd->data.len);
+      pos = append(buf, pos, "\"}");
+    }
+    pos = append(buf, pos, "]");
+  }
+
+  if (ad->num_manufacturer) {
+    pos = append(buf, pos, ",\"manufacturer_data\":[");
+    for (int i = 0; i < ad->num_manufacturer; i ++) {
+      const ad_manufacturer_data_t *md = &ad->manufacturer[i];
+      pos = append(buf, pos, "%s{\"company\":%u,\"data\":\"", i ? "," : "", md->company);
+      pos = append_hex(buf, pos, md->data.data, md->data.len);
+      pos = append(buf, pos, "\"}");
+    }
+    pos = append(buf, pos, "]");
+  }
+  return pos;
+}
+
+static int format_binary(const output_record_t *r, const char *name, int name_len,
+			 uint8_t *out) {
+  uint8_t *p = out + 2;
+
+  if (name_len > 255) name_len = 255;
+
+  *p ++ = (uint8_t)r->event;
+  *p ++ = (uint8_t)r->adapter;
+  *p ++ = r->addr_type;
+  *p ++ = (uint8_t)r->rssi;
+  for (int i = 0; i < 8; i ++) *p ++ = (uint8_t)(r->time_ms >> (8 * i));
+  memcpy(p, r->addr, 6);
+  p += 6;
+  *p ++ = (uint8_t)name_len;
+  memcpy(p, name, name_len);
+  p += name_len;
+  *p ++ = r->data ? r->data_len : 0;
+  if (r->data) {
+    memcpy(p, r->data, r->data_len);
+    p += r->data_len;
+  }
+
+  int len = (int)(p - out);
+  out[0] = (uint8_t)(len - 2);
+  out[1] = (uint8_t)((len - 2) >> 8);
+  return len;
+}
+
+void output_record(output_t *o, const output_record_t *r, uint64_t now) {
+  char scratch[SCRATCH_SIZE];
+  char addr[19] = {0};
+  char fields[1024] = {0};
+  ad_info_t ad;
+  bool has_ad = r->data != NULL && r->data_len > 0;
+  const char *name = r->name;
+  int name_len = name ? (int)strlen(name) : 0;
+  int pos = 0;
+
+  if (has_ad) ad_decode(r->data, r->data_len, &ad);
+  if (!name && has_ad && ad.name.data) {
+    name = (const char *)ad.name.data;
+    name_len = ad.name.len;
+  }
+
+  ba2str(r->addr, addr);
+
+  switch (o->format) {
+  case OUTPUT_TEXT:
+    switch (r->event) {
+    case OUTPUT_LEAVE:
+      pos = append(scratch, pos, "leave %s\n", addr);
+      break;
+    case OUTPUT_RSSI:
+      pos = append(scratch, pos, "rssi %s %d\n", addr, r->rssi);
+      break;
+    case OUTPUT_NAME:
+      pos = append(scratch, pos, "%s %.*s\n", addr, name_len, name ? name : "");
+      break;
+    default:
+      if (has_ad) ad_format(&ad, fields, sizeof(fields));
+      if (name_len > 31) name_len = 31;
+      pos = append(scratch, pos, "%s%s %s %d %.*s %s\n",
+		   r->event == OUTPUT_ARRIVE ? "arrive " : "", r->adapter_name, addr, r->rssi,
+		   name ? name_len : 9, name ? name : "[unknown]", fields);
+      break;
+    }
+    break;
+
+  case OUTPUT_NDJSON:
+    pos = append(scratch, pos, "{\"time_ms\":%llu,\"event\":\"%s\",\"adapter\":\"%s\",\"addr\":\"%s\"",
+		 (unsigned long long)r->time_ms, event_names[r->event],
+		 r->adapter_name, addr);
+    if (r->event != OUTPUT_NAME) pos = append(scratch, pos, ",\"addr_type\":%u", r->addr_type);
+    if (r->rssi != 127) pos = append(scratch, pos, ",\"rssi\":%d", r->rssi);
+    if (name) {
+      pos = append(scratch, pos, ",\"name\":");
+      pos = append_json_string(scratch, pos, name, name_len);
+    }
+    if (has_ad) pos = format_json_ad(scratch, pos, &ad);
+    pos = append(scratch, pos, "}\n");
+    break;
+
+  case OUTPUT_CSV:
+    if (has_ad) ad_format(&ad, fields, sizeof(fields));
+    pos = append(scratch, pos, "%llu,%s,%s,%s,%u,", (unsigned long long)r->time_ms,
+		 event_names[r->event], r->adapter_name, addr, r->addr_type);
+    if (r->rssi != 127) pos = append(scratch, pos, "%d", r->rssi);
+    pos = append(scratch, pos, ",");
+    if (name) pos = append_csv_string(scratch, pos, name, name_len);
+    pos = append(scratch, pos, ",");
+    pos = append_csv_string(scratch, pos, fields, (int)strlen(fields));
+    pos = append(scratch, pos, "\n");
+    break;
+
+  case OUTPUT_BINARY:
+    pos = format_binary(r, name, name_len, (uint8_t *)scratch);
+    break;
+  }
+
+  if (o->len + pos > o->size) output_flush(o);
+  if (o->len == 0) o->first_ms = now;
+  memcpy(o->buf + o->len, scratch, pos);
+  o->len += pos;
+}
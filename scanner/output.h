@@ -0,0 +1,103 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <bluetooth/bluetooth.h>
+
+/* Device records written to stdout and optionally to the clients of a
+ * Unix domain socket.
+ *
+ * Records are formatted into one large buffer that is written out when
+ * it fills up, when output_tick finds it older than the flush period and
+ * from output_close. What a socket client does not take at once is
+ * queued for it and sent as it reads, a client whose queue grows past
+ * OUTPUT_CLIENT_BACKLOG is dropped rather than allowed to stall the
+ * scanner.
+ */
+
+typedef enum {
+  OUTPUT_TEXT = 0,
+  OUTPUT_NDJSON,
+  OUTPUT_CSV,
+  OUTPUT_BINARY
+} output_format_t;
+
+typedef enum {
+  OUTPUT_NEW = 0,       /* first sighting */
+  OUTPUT_ARRIVE,
+  OUTPUT_LEAVE,
+  OUTPUT_RSSI,
+  OUTPUT_NAME           /* remote name of a classic device */
+} output_event_t;
+
+/* Binary stream layout, all little endian:
+ *
+ *   stream header: "BLES" version(1)
+ *   record:        len(2)  bytes that follow
+ *                  event(1) adapter(1) addr_type(1) rssi(1)
+ *                  time_ms(8) addr(6)
+ *                  name_len(1) name  data_len(1) data
+ */
+#define OUTPUT_BINARY_MAGIC   "BLES"
+#define OUTPUT_BINARY_VERSION 1
+
+#define OUTPUT_MAX_CLIENTS 8
+
+/* bytes queued for a socket client before it is dropped */
+#define OUTPUT_CLIENT_BACKLOG (8 * 1024 * 1024)
+
+typedef struct {
+  output_event_t event;
+  int adapter;
+  const char *adapter_name;
+  const bdaddr_t *addr;
+  uint8_t addr_type;
+  int8_t rssi;          /* 127 when unknown */
+  uint64_t time_ms;     /* ms since the unix epoch */
+  const char *name;     /* remote name, NULL to take it from data */
+  const uint8_t *data;  /* advertising data or NULL */
+  uint8_t data_len;
+} output_record_t;
+
+typedef struct {
+  int fd;
+  uint8_t *pending;     /* output the socket has not taken yet */
+  size_t off;           /* sent part of pending */
+  size_t len;
+  size_t size;
+} output_client_t;
+
+typedef struct {
+  output_format_t format;
+  int fd;
+
+  uint8_t *buf;
+  size_t len;
+  size_t size;
+  uint64_t first_ms;    /* time of the oldest unflushed record */
+  uint32_t flush_ms;
+
+  int listen_fd;
+  output_client_t clients[OUTPUT_MAX_CLIENTS];
+  int num_clients;
+} output_t;
+
+extern int output_parse_format(const char *name, output_format_t *format);
+
+/* Writes to fd and, unless socket_path is NULL, to the socket clients.
+   Returns false on an allocation or socket error. */
+extern bool output_init(output_t *o, int fd, output_format_t format, size_t buf_size,
+			uint32_t flush_ms, const char *socket_path);
+extern void output_close(output_t *o);
+
+extern void output_record(output_t *o, const output_record_t *r, uint64_t now);
+
+/* Flushes if the oldest buffered record is older than the flush period,
+   sends queued output to socket clients and takes in new ones. now is
+   ms on any monotonic clock. */
+extern void output_tick(output_t *o, uint64_t now);
+extern void output_flush(output_t *o);
+
+#endif
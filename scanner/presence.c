@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "presence.h"
+
+#define NONE     0xffffffffu
+#define NO_SLOT  0xffff
+#define MASK     (PRESENCE_SLOTS - 1)
+
+bool presence_init(presence_t *p, uint32_t timeout_ms, uint32_t tick_ms, int rssi_delta) {
+  memset(p, 0, sizeof(presence_t));
+
+  p->tick_ms = tick_ms ? tick_ms : 1;
+  p->timeout_ms = timeout_ms;
+  p->timeout_ticks = (timeout_ms + p->tick_ms - 1) / p->tick_ms;
+  if (p->timeout_ticks == 0) p->timeout_ticks = 1;
+  p->rssi_delta = rssi_delta;
+
+  for (int i = 0; i < PRESENCE_LEVELS * PRESENCE_SLOTS; i ++) p->heads[i] = NONE;
+
+  p->num_entries = 1024;
+  p->entries = malloc(p->num_entries * sizeof(presence_entry_t));
+  if (!p->entries) return false;
+  for (uint32_t i = 0; i < p->num_entries; i ++) {
+    p->entries[i].slot = NO_SLOT;
+    p->entries[i].present = false;
+  }
+  return true;
+}
+
+void presence_free(presence_t *p) {
+  free(p->entries);
+  p->entries = NULL;
+}
+
+static bool ensure(presence_t *p, uint32_t ix) {
+  if (ix < p->num_entries) return true;
+
+  uint32_t n = p->num_entries * 2;
+  while (n <= ix) n *= 2;
+
+  presence_entry_t *e = realloc(p->entries, n * sizeof(presence_entry_t));
+  if (!e) return false;
+
+  for (uint32_t i = p->num_entries; i < n; i ++) {
+    e[i].slot = NO_SLOT;
+    e[i].present = false;
+  }
+  p->entries = e;
+  p->num_entries = n;
+  return true;
+}
+
+static void unlink_entry(presence_t *p, uint32_t ix) {
+  presence_entry_t *e = &p->entries[ix];
+
+  if (e->prev != NONE) p->entries[e->prev].next = e->next;
+  else p->heads[e->slot] = e->next;
+  if (e->next != NONE) p->entries[e->next].prev = e->prev;
+
+  e->slot = NO_SLOT;
+  p->armed --;
+}
+
+/* Places ix in the lowest level whose range covers its deadline */
+static void link_entry(presence_t *p, uint32_t ix) {
+  presence_entry_t *e = &p->entries[ix];
+  uint32_t delta = e->expires - p->tick;
+  int level = 0;
+
+  while (level < PRESENCE_LEVELS - 1 &&
+	 delta >= (1u << (PRESENCE_SLOT_BITS * (level + 1)))) {
+    level ++;
+  }
+
+  /* beyond the top level, park in the furthest top slot and retry later */
+  uint32_t at = e->expires;
+  if (level == PRESENCE_LEVELS - 1 &&
+      delta >= (1u << (PRESENCE_SLOT_BITS * PRESENCE_LEVELS)) - 1) {
+    at = p->tick - 1;
+  }
+
+  uint16_t slot = level * PRESENCE_SLOTS + ((at >> (PRESENCE_SLOT_BITS * level)) & MASK);
+
+  e->slot = slot;
+  e->prev = NONE;
+  e->next = p->heads[slot];
+  if (e->next != NONE) p->entries[e->next].prev = ix;
+  p->heads[slot] = ix;
+  p->armed ++;
+}
+
+static void start(presence_t *p, uint64_t now) {
+  if (p->started) return;
+  p->tick = (uint32_t)(now / p->tick_ms);
+  p->started = true;
+}
+
+int presence_sighting(presence_t *p, uint32_t ix, int8_t rssi, uint64_t now) {
+  int event = PRESENCE_NONE;
+
+  start(p, now);
+  if (!ensure(p, ix)) return -1;
+
+  presence_entry_t *e = &p->entries[ix];
+
+  if (!e->present) {
+    e->present = true;
+    e->rssi = rssi;
+    event = PRESENCE_ARRIVE;
+  } else if (abs(rssi - e->rssi) >= p->rssi_delta) {
+    e->rssi = rssi;
+    event = PRESENCE_RSSI;
+  }
+
+  if (e->slot != NO_SLOT) unlink_entry(p, ix);
+  /* one extra tick so a device never leaves before the full timeout */
+  e->expires = p->tick + p->timeout_ticks + 1;
+  link_entry(p, ix);
+
+  return event;
+}
+
+/* Moves every entry of a slot down to where it belongs now */
+static void cascade(presence_t *p, int level) {
+  uint16_t slot = level * PRESENCE_SLOTS + ((p->tick >> (PRESENCE_SLOT_BITS * level)) & MASK);
+  uint32_t ix = p->heads[slot];
+
+  p->heads[slot] = NONE;
+  while (ix != NONE) {
+    uint32_t next = p->entries[ix].next;
+    p->entries[ix].slot = NO_SLOT;
+    p->armed --;
+    link_entry(p, ix);
+    ix = next;
+  }
+}
+
+void presence_advance(presence_t *p, uint64_t now, presence_leave_cb cb, void *arg) {
+  start(p, now);
+
+  uint32_t target = (uint32_t)(now / p->tick_ms);
+
+  while ((int32_t)(target - p->tick) > 0) {
+    if (p->armed == 0) {
+      /* nothing to expire, skip the idle ticks */
+      p->tick = target;
+      break;
+    }
+
+    p->tick ++;
+
+    /* when level 0 wraps, level 1 has reached a new slot and so on up.
+       Higher levels go first so entries can fall through several. */
+    int top = 0;
+    while (top < PRESENCE_LEVELS - 1 &&
+	   (p->tick & ((1u << (PRESENCE_SLOT_BITS * (top + 1))) - 1)) == 0) {
+      top ++;
+    }
+    for (int level = top; level > 0; level --) cascade(p, level);
+
+    uint16_t slot = p->tick & MASK;
+    uint32_t ix = p->heads[slot];
+
+    p->heads[slot] = NONE;
+    while (ix != NONE) {
+      presence_entry_t *e = &p->entries[ix];
+      uint32_t next = e->next;
+
+      e->slot = NO_SLOT;
+      p->armed --;
+      if (e->expires == p->tick) {
+	e->present = false;
+	cb(ix, arg);
+      } else {
+	link_entry(p, ix);
+      }
+      ix = next;
+    }
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Presence tracking of devices by device table index.
+ *
+ * Every present device has a leave deadline that is pushed forward on
+ * each sighting. Deadlines live in a hierarchical timer wheel: level 0
+ * has one slot per tick and every level above covers 64 times the range
+ * of the one below. A sighting unlinks and relinks the device in O(1),
+ * an expiry is O(1) plus at most one move per level on the way down.
+ */
+
+#define PRESENCE_LEVELS    4
+#define PRESENCE_SLOT_BITS 6
+#define PRESENCE_SLOTS     (1 << PRESENCE_SLOT_BITS)
+
+typedef enum {
+  PRESENCE_NONE = 0,
+  PRESENCE_ARRIVE,
+  PRESENCE_LEAVE,
+  PRESENCE_RSSI
+} presence_event_t;
+
+typedef struct {
+  uint32_t next;
+  uint32_t prev;
+  uint32_t expires;     /* tick */
+  uint16_t slot;        /* level * PRESENCE_SLOTS + slot */
+  int8_t rssi;          /* last reported */
+  bool present;
+} presence_entry_t;
+
+typedef struct {
+  presence_entry_t *entries;
+  uint32_t num_entries;
+
+  uint32_t heads[PRESENCE_LEVELS * PRESENCE_SLOTS];
+  uint32_t tick;        /* current tick, all earlier deadlines are handled */
+  uint32_t armed;       /* devices currently in the wheel */
+  bool started;
+
+  uint32_t tick_ms;
+  uint32_t timeout_ms;
+  uint32_t timeout_ticks;
+  int rssi_delta;
+} presence_t;
+
+/* Called for each device that leaves, ix is its device table index */
+typedef void (*presence_leave_cb)(uint32_t ix, void *arg);
+
+extern bool presence_init(presence_t *p, uint32_t timeout_ms, uint32_t tick_ms, int rssi_delta);
+extern void presence_free(presence_t *p);
+
+/* Records a sighting of device ix at time now (ms). Returns PRESENCE_ARRIVE
+   for a device that was not present, PRESENCE_RSSI when rssi has moved at
+   least rssi_delta from the last reported value, PRESENCE_NONE otherwise
+   and -1 if out of memory. */
+extern int presence_sighting(presence_t *p, uint32_t ix, int8_t rssi, uint64_t now);
+
+/* Runs the wheel up to time now and reports the devices that left */
+extern void presence_advance(presence_t *p, uint64_t now, presence_leave_cb cb, void *arg);
+
+#endif